@@ -0,0 +1,12 @@
+; an alist of 10 fixnum keys, see hash-10.scm for the same with a table
+(define n 10)
+(define lookups 300000)
+(define (assv-loop key l)
+  (if (null? l)
+      #f
+      (if (= key (car (car l))) (car l) (assv-loop key (cdr l)))))
+(define table (quote ()))
+(do ((i 0 (+ i 1))) ((= i n)) (set! table (cons (cons i (* i 2)) table)))
+(do ((i 0 (+ i 1))
+     (sum 0 (+ sum (cdr (assv-loop (remainder (* i 7919) n) table)))))
+    ((= i lookups) sum))
@@ -0,0 +1,14 @@
+; an alist of a million fixnum keys, see hash-1m.scm for the same with a table;
+; the keys are spread over the alist, so each lookup scans about half of it
+; and ten outweigh building it
+(define n 1000000)
+(define lookups 10)
+(define (assv-loop key l)
+  (if (null? l)
+      #f
+      (if (= key (car (car l))) (car l) (assv-loop key (cdr l)))))
+(define table (quote ()))
+(do ((i 0 (+ i 1))) ((= i n)) (set! table (cons (cons i (* i 2)) table)))
+(do ((i 0 (+ i 1))
+     (sum 0 (+ sum (cdr (assv-loop (remainder (* i 100003) n) table)))))
+    ((= i lookups) sum))
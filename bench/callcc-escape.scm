@@ -0,0 +1,18 @@
+; early exit from a recursion through escape-only continuations, with
+; a deep stack below each capture
+(define (search n k)
+  (if (= n 0)
+      (k 1)
+      (+ 1 (search (- n 1) k))))
+
+(define (escape i acc)
+  (if (= i 0)
+      acc
+      (escape (- i 1) (+ acc (call/1cc (lambda (k) (search 20 k)))))))
+
+(define (under d)
+  (if (= d 0)
+      (escape 100000 0)
+      (+ 0 (under (- d 1)))))
+
+(under 10000)
@@ -0,0 +1,28 @@
+; a generator built on re-entrant call/cc: every value jumps back and
+; forth between consumer and producer, with a deep stack below both
+(define return #f)
+(define resume #f)
+
+(define (produce i n)
+  (if (= i n)
+      (return -1)
+      (produce (+ i 1 (call/cc (lambda (k) (set! resume k) (return i))))
+               n)))
+
+(define (next)
+  (call/cc (lambda (r) (set! return r) (resume 0))))
+
+(define (consume v acc)
+  (if (= v -1)
+      acc
+      (consume (next) (+ acc v))))
+
+(define (start n)
+  (consume (call/cc (lambda (r) (set! return r) (produce 0 n))) 0))
+
+(define (under d)
+  (if (= d 0)
+      (start 100000)
+      (+ 0 (under (- d 1)))))
+
+(under 10000)
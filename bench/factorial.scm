@@ -0,0 +1,12 @@
+; bignum multiplication; the last products are large enough for Karatsuba
+(define (fact n)
+  (if (= n 0)
+      1
+      (* n (fact (- n 1)))))
+(define (product lo hi)
+  (if (= lo hi)
+      lo
+      (* (product lo (quotient (+ lo hi) 2))
+         (product (+ (quotient (+ lo hi) 2) 1) hi))))
+(remainder (fact 3000) 1000000007)
+(remainder (product 1 20000) 1000000007)
@@ -0,0 +1,6 @@
+; doubly recursive calls, non-tail, on small fixnums
+(define (fib n)
+  (if (< n 2)
+      n
+      (+ (fib (- n 1)) (fib (- n 2)))))
+(fib 29)
@@ -0,0 +1,6 @@
+; tail recursive fixnum arithmetic, stays on the inline fast path
+(define (sum i acc)
+  (if (= i 0)
+      acc
+      (sum (- i 1) (+ acc i))))
+(sum 1000000 0)
@@ -0,0 +1,7 @@
+; flonum kernel: midpoint rule for the integral of 4/(1+x^2) over [0,1]
+(define (integrate i n h acc)
+  (if (= i n)
+      (* acc h)
+      (integrate (+ i 1) n h
+                 (+ acc (/ 4.0 (+ 1.0 (* (* (+ i 0.5) h) (* (+ i 0.5) h))))))))
+(integrate 0 500000 (/ 1.0 500000) 0.0)
@@ -0,0 +1,8 @@
+; an eqv hash table of 1000 fixnum keys, see alist-1k.scm
+(define n 1000)
+(define lookups 5000)
+(define table (make-hash-table 'eqv))
+(do ((i 0 (+ i 1))) ((= i n)) (hash-table-set! table i (* i 2)))
+(do ((i 0 (+ i 1))
+     (sum 0 (+ sum (hash-table-ref table (remainder (* i 7919) n)))))
+    ((= i lookups) sum))
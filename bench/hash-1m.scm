@@ -0,0 +1,9 @@
+; an eqv hash table of a million fixnum keys, see alist-1m.scm; twice as many
+; lookups as keys, so that they outweigh filling the table
+(define n 1000000)
+(define lookups 2000000)
+(define table (make-hash-table 'eqv))
+(do ((i 0 (+ i 1))) ((= i n)) (hash-table-set! table i (* i 2)))
+(do ((i 0 (+ i 1))
+     (sum 0 (+ sum (hash-table-ref table (remainder (* i 7919) n)))))
+    ((= i lookups) sum))
@@ -0,0 +1,20 @@
+; building lists with cons and reversing them, mostly allocation
+(define (iota n acc)
+  (if (= n 0)
+      acc
+      (iota (- n 1) (cons n acc))))
+(define (reverse-onto l acc)
+  (if (null? l)
+      acc
+      (reverse-onto (cdr l) (cons (car l) acc))))
+(define (sum l acc)
+  (if (null? l)
+      acc
+      (sum (cdr l) (+ acc (car l)))))
+(define (rounds i acc)
+  (if (= i 0)
+      acc
+      (rounds (- i 1)
+              (+ acc (sum (reverse-onto (reverse-onto (iota 10000 '()) '()) '())
+                          0)))))
+(rounds 30 0)
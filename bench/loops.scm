@@ -0,0 +1,7 @@
+; the same sum as a named let, a do loop and a helper procedure
+(define (sum-let n) (let loop ((i 0) (acc 0)) (if (= i n) acc (loop (+ i 1) (+ acc i)))))
+(define (sum-do n) (do ((i 0 (+ i 1)) (acc 0 (+ acc i))) ((= i n) acc)))
+(define (sum-helper i n acc) (if (= i n) acc (sum-helper (+ i 1) n (+ acc i))))
+(sum-let 1000000)
+(sum-do 1000000)
+(sum-helper 0 1000000 0)
@@ -0,0 +1,81 @@
+; macro expansion at compile time: recursive syntax-rules macros walking
+; long argument lists, and one whose expansion doubles at every level;
+; equal forms, as the two halves of a tree or the tails any and all
+; share, are expanded once
+(define-syntax count-args
+  (syntax-rules ()
+    ((_ () acc) acc)
+    ((_ (x rest ...) acc) (count-args (rest ...) (+ acc 1)))))
+
+(define-syntax tree
+  (syntax-rules ()
+    ((_ () leaf) leaf)
+    ((_ (x rest ...) leaf) (cons (tree (rest ...) leaf) (tree (rest ...) leaf)))))
+
+(define-syntax my-and
+  (syntax-rules ()
+    ((_) #t)
+    ((_ e) e)
+    ((_ e1 e2 ...) (if e1 (my-and e2 ...) #f))))
+
+(define-syntax my-or
+  (syntax-rules ()
+    ((_) #f)
+    ((_ e) e)
+    ((_ e1 e2 ...) (if e1 #t (my-or e2 ...)))))
+
+(define-syntax my-let*
+  (syntax-rules ()
+    ((_ () body) body)
+    ((_ ((x v) rest ...) body) ((lambda (x) (my-let* (rest ...) body)) v))))
+
+(count-args (x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 x12 x13 x14 x15 x16 x17 x18 x19 x20 x21 x22 x23 x24 x25 x26 x27 x28 x29 x30 x31 x32 x33 x34 x35 x36 x37 x38 x39 x40 x41 x42 x43 x44 x45 x46 x47 x48 x49 x50 x51 x52 x53 x54 x55 x56 x57 x58 x59 x60 x61 x62 x63 x64 x65 x66 x67 x68 x69 x70 x71 x72 x73 x74 x75 x76 x77 x78 x79 x80 x81 x82 x83 x84 x85 x86 x87 x88 x89 x90 x91 x92 x93 x94 x95 x96 x97 x98 x99 x100 x101 x102 x103 x104 x105 x106 x107 x108 x109 x110 x111 x112 x113 x114 x115 x116 x117 x118 x119) 0)
+(count-args (x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 x12 x13 x14 x15 x16 x17 x18 x19 x20 x21 x22 x23 x24 x25 x26 x27 x28 x29 x30 x31 x32 x33 x34 x35 x36 x37 x38 x39 x40 x41 x42 x43 x44 x45 x46 x47 x48 x49 x50 x51 x52 x53 x54 x55 x56 x57 x58 x59 x60 x61 x62 x63 x64 x65 x66 x67 x68 x69 x70 x71 x72 x73 x74 x75 x76 x77 x78 x79 x80 x81 x82 x83 x84 x85 x86 x87 x88 x89 x90 x91 x92 x93 x94 x95 x96 x97 x98 x99 x100 x101 x102 x103 x104 x105 x106 x107 x108 x109 x110 x111 x112 x113 x114 x115 x116 x117 x118 x119) 1)
+(count-args (x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 x12 x13 x14 x15 x16 x17 x18 x19 x20 x21 x22 x23 x24 x25 x26 x27 x28 x29 x30 x31 x32 x33 x34 x35 x36 x37 x38 x39 x40 x41 x42 x43 x44 x45 x46 x47 x48 x49 x50 x51 x52 x53 x54 x55 x56 x57 x58 x59 x60 x61 x62 x63 x64 x65 x66 x67 x68 x69 x70 x71 x72 x73 x74 x75 x76 x77 x78 x79 x80 x81 x82 x83 x84 x85 x86 x87 x88 x89 x90 x91 x92 x93 x94 x95 x96 x97 x98 x99 x100 x101 x102 x103 x104 x105 x106 x107 x108 x109 x110 x111 x112 x113 x114 x115 x116 x117 x118 x119) 2)
+(count-args (x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 x12 x13 x14 x15 x16 x17 x18 x19 x20 x21 x22 x23 x24 x25 x26 x27 x28 x29 x30 x31 x32 x33 x34 x35 x36 x37 x38 x39 x40 x41 x42 x43 x44 x45 x46 x47 x48 x49 x50 x51 x52 x53 x54 x55 x56 x57 x58 x59 x60 x61 x62 x63 x64 x65 x66 x67 x68 x69 x70 x71 x72 x73 x74 x75 x76 x77 x78 x79 x80 x81 x82 x83 x84 x85 x86 x87 x88 x89 x90 x91 x92 x93 x94 x95 x96 x97 x98 x99 x100 x101 x102 x103 x104 x105 x106 x107 x108 x109 x110 x111 x112 x113 x114 x115 x116 x117 x118 x119) 3)
+(count-args (x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 x12 x13 x14 x15 x16 x17 x18 x19 x20 x21 x22 x23 x24 x25 x26 x27 x28 x29 x30 x31 x32 x33 x34 x35 x36 x37 x38 x39 x40 x41 x42 x43 x44 x45 x46 x47 x48 x49 x50 x51 x52 x53 x54 x55 x56 x57 x58 x59 x60 x61 x62 x63 x64 x65 x66 x67 x68 x69 x70 x71 x72 x73 x74 x75 x76 x77 x78 x79 x80 x81 x82 x83 x84 x85 x86 x87 x88 x89 x90 x91 x92 x93 x94 x95 x96 x97 x98 x99 x100 x101 x102 x103 x104 x105 x106 x107 x108 x109 x110 x111 x112 x113 x114 x115 x116 x117 x118 x119) 4)
+(count-args (x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 x12 x13 x14 x15 x16 x17 x18 x19 x20 x21 x22 x23 x24 x25 x26 x27 x28 x29 x30 x31 x32 x33 x34 x35 x36 x37 x38 x39 x40 x41 x42 x43 x44 x45 x46 x47 x48 x49 x50 x51 x52 x53 x54 x55 x56 x57 x58 x59 x60 x61 x62 x63 x64 x65 x66 x67 x68 x69 x70 x71 x72 x73 x74 x75 x76 x77 x78 x79 x80 x81 x82 x83 x84 x85 x86 x87 x88 x89 x90 x91 x92 x93 x94 x95 x96 x97 x98 x99 x100 x101 x102 x103 x104 x105 x106 x107 x108 x109 x110 x111 x112 x113 x114 x115 x116 x117 x118 x119) 5)
+(count-args (x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 x12 x13 x14 x15 x16 x17 x18 x19 x20 x21 x22 x23 x24 x25 x26 x27 x28 x29 x30 x31 x32 x33 x34 x35 x36 x37 x38 x39 x40 x41 x42 x43 x44 x45 x46 x47 x48 x49 x50 x51 x52 x53 x54 x55 x56 x57 x58 x59 x60 x61 x62 x63 x64 x65 x66 x67 x68 x69 x70 x71 x72 x73 x74 x75 x76 x77 x78 x79 x80 x81 x82 x83 x84 x85 x86 x87 x88 x89 x90 x91 x92 x93 x94 x95 x96 x97 x98 x99 x100 x101 x102 x103 x104 x105 x106 x107 x108 x109 x110 x111 x112 x113 x114 x115 x116 x117 x118 x119) 6)
+(count-args (x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 x12 x13 x14 x15 x16 x17 x18 x19 x20 x21 x22 x23 x24 x25 x26 x27 x28 x29 x30 x31 x32 x33 x34 x35 x36 x37 x38 x39 x40 x41 x42 x43 x44 x45 x46 x47 x48 x49 x50 x51 x52 x53 x54 x55 x56 x57 x58 x59 x60 x61 x62 x63 x64 x65 x66 x67 x68 x69 x70 x71 x72 x73 x74 x75 x76 x77 x78 x79 x80 x81 x82 x83 x84 x85 x86 x87 x88 x89 x90 x91 x92 x93 x94 x95 x96 x97 x98 x99 x100 x101 x102 x103 x104 x105 x106 x107 x108 x109 x110 x111 x112 x113 x114 x115 x116 x117 x118 x119) 7)
+(count-args (x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 x12 x13 x14 x15 x16 x17 x18 x19 x20 x21 x22 x23 x24 x25 x26 x27 x28 x29 x30 x31 x32 x33 x34 x35 x36 x37 x38 x39 x40 x41 x42 x43 x44 x45 x46 x47 x48 x49 x50 x51 x52 x53 x54 x55 x56 x57 x58 x59 x60 x61 x62 x63 x64 x65 x66 x67 x68 x69 x70 x71 x72 x73 x74 x75 x76 x77 x78 x79 x80 x81 x82 x83 x84 x85 x86 x87 x88 x89 x90 x91 x92 x93 x94 x95 x96 x97 x98 x99 x100 x101 x102 x103 x104 x105 x106 x107 x108 x109 x110 x111 x112 x113 x114 x115 x116 x117 x118 x119) 8)
+(count-args (x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 x12 x13 x14 x15 x16 x17 x18 x19 x20 x21 x22 x23 x24 x25 x26 x27 x28 x29 x30 x31 x32 x33 x34 x35 x36 x37 x38 x39 x40 x41 x42 x43 x44 x45 x46 x47 x48 x49 x50 x51 x52 x53 x54 x55 x56 x57 x58 x59 x60 x61 x62 x63 x64 x65 x66 x67 x68 x69 x70 x71 x72 x73 x74 x75 x76 x77 x78 x79 x80 x81 x82 x83 x84 x85 x86 x87 x88 x89 x90 x91 x92 x93 x94 x95 x96 x97 x98 x99 x100 x101 x102 x103 x104 x105 x106 x107 x108 x109 x110 x111 x112 x113 x114 x115 x116 x117 x118 x119) 9)
+(count-args (x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 x12 x13 x14 x15 x16 x17 x18 x19 x20 x21 x22 x23 x24 x25 x26 x27 x28 x29 x30 x31 x32 x33 x34 x35 x36 x37 x38 x39 x40 x41 x42 x43 x44 x45 x46 x47 x48 x49 x50 x51 x52 x53 x54 x55 x56 x57 x58 x59 x60 x61 x62 x63 x64 x65 x66 x67 x68 x69 x70 x71 x72 x73 x74 x75 x76 x77 x78 x79 x80 x81 x82 x83 x84 x85 x86 x87 x88 x89 x90 x91 x92 x93 x94 x95 x96 x97 x98 x99 x100 x101 x102 x103 x104 x105 x106 x107 x108 x109 x110 x111 x112 x113 x114 x115 x116 x117 x118 x119) 10)
+(count-args (x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 x12 x13 x14 x15 x16 x17 x18 x19 x20 x21 x22 x23 x24 x25 x26 x27 x28 x29 x30 x31 x32 x33 x34 x35 x36 x37 x38 x39 x40 x41 x42 x43 x44 x45 x46 x47 x48 x49 x50 x51 x52 x53 x54 x55 x56 x57 x58 x59 x60 x61 x62 x63 x64 x65 x66 x67 x68 x69 x70 x71 x72 x73 x74 x75 x76 x77 x78 x79 x80 x81 x82 x83 x84 x85 x86 x87 x88 x89 x90 x91 x92 x93 x94 x95 x96 x97 x98 x99 x100 x101 x102 x103 x104 x105 x106 x107 x108 x109 x110 x111 x112 x113 x114 x115 x116 x117 x118 x119) 11)
+(define (any0 n) (my-or (= n 0) (= n 1) (= n 2) (= n 3) (= n 4) (= n 5) (= n 6) (= n 7) (= n 8) (= n 9) (= n 10) (= n 11) (= n 12) (= n 13) (= n 14) (= n 15) (= n 16) (= n 17) (= n 18) (= n 19) (= n 20) (= n 21) (= n 22) (= n 23) (= n 24) (= n 25) (= n 26) (= n 27) (= n 28) (= n 29) (= n 30) (= n 31) (= n 32) (= n 33) (= n 34) (= n 35) (= n 36) (= n 37) (= n 38) (= n 39) (= n 40) (= n 41) (= n 42) (= n 43) (= n 44) (= n 45) (= n 46) (= n 47) (= n 48) (= n 49) (= n 50) (= n 51) (= n 52) (= n 53) (= n 54) (= n 55) (= n 56) (= n 57) (= n 58) (= n 59)))
+(define (all0 n) (my-and (< n 0) (< n 1) (< n 2) (< n 3) (< n 4) (< n 5) (< n 6) (< n 7) (< n 8) (< n 9) (< n 10) (< n 11) (< n 12) (< n 13) (< n 14) (< n 15) (< n 16) (< n 17) (< n 18) (< n 19) (< n 20) (< n 21) (< n 22) (< n 23) (< n 24) (< n 25) (< n 26) (< n 27) (< n 28) (< n 29) (< n 30) (< n 31) (< n 32) (< n 33) (< n 34) (< n 35) (< n 36) (< n 37) (< n 38) (< n 39) (< n 40) (< n 41) (< n 42) (< n 43) (< n 44) (< n 45) (< n 46) (< n 47) (< n 48) (< n 49) (< n 50) (< n 51) (< n 52) (< n 53) (< n 54) (< n 55) (< n 56) (< n 57) (< n 58) (< n 59)))
+(define (any1 n) (my-or (= n 0) (= n 1) (= n 2) (= n 3) (= n 4) (= n 5) (= n 6) (= n 7) (= n 8) (= n 9) (= n 10) (= n 11) (= n 12) (= n 13) (= n 14) (= n 15) (= n 16) (= n 17) (= n 18) (= n 19) (= n 20) (= n 21) (= n 22) (= n 23) (= n 24) (= n 25) (= n 26) (= n 27) (= n 28) (= n 29) (= n 30) (= n 31) (= n 32) (= n 33) (= n 34) (= n 35) (= n 36) (= n 37) (= n 38) (= n 39) (= n 40) (= n 41) (= n 42) (= n 43) (= n 44) (= n 45) (= n 46) (= n 47) (= n 48) (= n 49) (= n 50) (= n 51) (= n 52) (= n 53) (= n 54) (= n 55) (= n 56) (= n 57) (= n 58) (= n 59)))
+(define (all1 n) (my-and (< n 1) (< n 2) (< n 3) (< n 4) (< n 5) (< n 6) (< n 7) (< n 8) (< n 9) (< n 10) (< n 11) (< n 12) (< n 13) (< n 14) (< n 15) (< n 16) (< n 17) (< n 18) (< n 19) (< n 20) (< n 21) (< n 22) (< n 23) (< n 24) (< n 25) (< n 26) (< n 27) (< n 28) (< n 29) (< n 30) (< n 31) (< n 32) (< n 33) (< n 34) (< n 35) (< n 36) (< n 37) (< n 38) (< n 39) (< n 40) (< n 41) (< n 42) (< n 43) (< n 44) (< n 45) (< n 46) (< n 47) (< n 48) (< n 49) (< n 50) (< n 51) (< n 52) (< n 53) (< n 54) (< n 55) (< n 56) (< n 57) (< n 58) (< n 59) (< n 60)))
+(define (any2 n) (my-or (= n 0) (= n 1) (= n 2) (= n 3) (= n 4) (= n 5) (= n 6) (= n 7) (= n 8) (= n 9) (= n 10) (= n 11) (= n 12) (= n 13) (= n 14) (= n 15) (= n 16) (= n 17) (= n 18) (= n 19) (= n 20) (= n 21) (= n 22) (= n 23) (= n 24) (= n 25) (= n 26) (= n 27) (= n 28) (= n 29) (= n 30) (= n 31) (= n 32) (= n 33) (= n 34) (= n 35) (= n 36) (= n 37) (= n 38) (= n 39) (= n 40) (= n 41) (= n 42) (= n 43) (= n 44) (= n 45) (= n 46) (= n 47) (= n 48) (= n 49) (= n 50) (= n 51) (= n 52) (= n 53) (= n 54) (= n 55) (= n 56) (= n 57) (= n 58) (= n 59)))
+(define (all2 n) (my-and (< n 2) (< n 3) (< n 4) (< n 5) (< n 6) (< n 7) (< n 8) (< n 9) (< n 10) (< n 11) (< n 12) (< n 13) (< n 14) (< n 15) (< n 16) (< n 17) (< n 18) (< n 19) (< n 20) (< n 21) (< n 22) (< n 23) (< n 24) (< n 25) (< n 26) (< n 27) (< n 28) (< n 29) (< n 30) (< n 31) (< n 32) (< n 33) (< n 34) (< n 35) (< n 36) (< n 37) (< n 38) (< n 39) (< n 40) (< n 41) (< n 42) (< n 43) (< n 44) (< n 45) (< n 46) (< n 47) (< n 48) (< n 49) (< n 50) (< n 51) (< n 52) (< n 53) (< n 54) (< n 55) (< n 56) (< n 57) (< n 58) (< n 59) (< n 60) (< n 61)))
+(define (any3 n) (my-or (= n 0) (= n 1) (= n 2) (= n 3) (= n 4) (= n 5) (= n 6) (= n 7) (= n 8) (= n 9) (= n 10) (= n 11) (= n 12) (= n 13) (= n 14) (= n 15) (= n 16) (= n 17) (= n 18) (= n 19) (= n 20) (= n 21) (= n 22) (= n 23) (= n 24) (= n 25) (= n 26) (= n 27) (= n 28) (= n 29) (= n 30) (= n 31) (= n 32) (= n 33) (= n 34) (= n 35) (= n 36) (= n 37) (= n 38) (= n 39) (= n 40) (= n 41) (= n 42) (= n 43) (= n 44) (= n 45) (= n 46) (= n 47) (= n 48) (= n 49) (= n 50) (= n 51) (= n 52) (= n 53) (= n 54) (= n 55) (= n 56) (= n 57) (= n 58) (= n 59)))
+(define (all3 n) (my-and (< n 3) (< n 4) (< n 5) (< n 6) (< n 7) (< n 8) (< n 9) (< n 10) (< n 11) (< n 12) (< n 13) (< n 14) (< n 15) (< n 16) (< n 17) (< n 18) (< n 19) (< n 20) (< n 21) (< n 22) (< n 23) (< n 24) (< n 25) (< n 26) (< n 27) (< n 28) (< n 29) (< n 30) (< n 31) (< n 32) (< n 33) (< n 34) (< n 35) (< n 36) (< n 37) (< n 38) (< n 39) (< n 40) (< n 41) (< n 42) (< n 43) (< n 44) (< n 45) (< n 46) (< n 47) (< n 48) (< n 49) (< n 50) (< n 51) (< n 52) (< n 53) (< n 54) (< n 55) (< n 56) (< n 57) (< n 58) (< n 59) (< n 60) (< n 61) (< n 62)))
+(define (any4 n) (my-or (= n 0) (= n 1) (= n 2) (= n 3) (= n 4) (= n 5) (= n 6) (= n 7) (= n 8) (= n 9) (= n 10) (= n 11) (= n 12) (= n 13) (= n 14) (= n 15) (= n 16) (= n 17) (= n 18) (= n 19) (= n 20) (= n 21) (= n 22) (= n 23) (= n 24) (= n 25) (= n 26) (= n 27) (= n 28) (= n 29) (= n 30) (= n 31) (= n 32) (= n 33) (= n 34) (= n 35) (= n 36) (= n 37) (= n 38) (= n 39) (= n 40) (= n 41) (= n 42) (= n 43) (= n 44) (= n 45) (= n 46) (= n 47) (= n 48) (= n 49) (= n 50) (= n 51) (= n 52) (= n 53) (= n 54) (= n 55) (= n 56) (= n 57) (= n 58) (= n 59)))
+(define (all4 n) (my-and (< n 4) (< n 5) (< n 6) (< n 7) (< n 8) (< n 9) (< n 10) (< n 11) (< n 12) (< n 13) (< n 14) (< n 15) (< n 16) (< n 17) (< n 18) (< n 19) (< n 20) (< n 21) (< n 22) (< n 23) (< n 24) (< n 25) (< n 26) (< n 27) (< n 28) (< n 29) (< n 30) (< n 31) (< n 32) (< n 33) (< n 34) (< n 35) (< n 36) (< n 37) (< n 38) (< n 39) (< n 40) (< n 41) (< n 42) (< n 43) (< n 44) (< n 45) (< n 46) (< n 47) (< n 48) (< n 49) (< n 50) (< n 51) (< n 52) (< n 53) (< n 54) (< n 55) (< n 56) (< n 57) (< n 58) (< n 59) (< n 60) (< n 61) (< n 62) (< n 63)))
+(define (any5 n) (my-or (= n 0) (= n 1) (= n 2) (= n 3) (= n 4) (= n 5) (= n 6) (= n 7) (= n 8) (= n 9) (= n 10) (= n 11) (= n 12) (= n 13) (= n 14) (= n 15) (= n 16) (= n 17) (= n 18) (= n 19) (= n 20) (= n 21) (= n 22) (= n 23) (= n 24) (= n 25) (= n 26) (= n 27) (= n 28) (= n 29) (= n 30) (= n 31) (= n 32) (= n 33) (= n 34) (= n 35) (= n 36) (= n 37) (= n 38) (= n 39) (= n 40) (= n 41) (= n 42) (= n 43) (= n 44) (= n 45) (= n 46) (= n 47) (= n 48) (= n 49) (= n 50) (= n 51) (= n 52) (= n 53) (= n 54) (= n 55) (= n 56) (= n 57) (= n 58) (= n 59)))
+(define (all5 n) (my-and (< n 5) (< n 6) (< n 7) (< n 8) (< n 9) (< n 10) (< n 11) (< n 12) (< n 13) (< n 14) (< n 15) (< n 16) (< n 17) (< n 18) (< n 19) (< n 20) (< n 21) (< n 22) (< n 23) (< n 24) (< n 25) (< n 26) (< n 27) (< n 28) (< n 29) (< n 30) (< n 31) (< n 32) (< n 33) (< n 34) (< n 35) (< n 36) (< n 37) (< n 38) (< n 39) (< n 40) (< n 41) (< n 42) (< n 43) (< n 44) (< n 45) (< n 46) (< n 47) (< n 48) (< n 49) (< n 50) (< n 51) (< n 52) (< n 53) (< n 54) (< n 55) (< n 56) (< n 57) (< n 58) (< n 59) (< n 60) (< n 61) (< n 62) (< n 63) (< n 64)))
+(define (any6 n) (my-or (= n 0) (= n 1) (= n 2) (= n 3) (= n 4) (= n 5) (= n 6) (= n 7) (= n 8) (= n 9) (= n 10) (= n 11) (= n 12) (= n 13) (= n 14) (= n 15) (= n 16) (= n 17) (= n 18) (= n 19) (= n 20) (= n 21) (= n 22) (= n 23) (= n 24) (= n 25) (= n 26) (= n 27) (= n 28) (= n 29) (= n 30) (= n 31) (= n 32) (= n 33) (= n 34) (= n 35) (= n 36) (= n 37) (= n 38) (= n 39) (= n 40) (= n 41) (= n 42) (= n 43) (= n 44) (= n 45) (= n 46) (= n 47) (= n 48) (= n 49) (= n 50) (= n 51) (= n 52) (= n 53) (= n 54) (= n 55) (= n 56) (= n 57) (= n 58) (= n 59)))
+(define (all6 n) (my-and (< n 6) (< n 7) (< n 8) (< n 9) (< n 10) (< n 11) (< n 12) (< n 13) (< n 14) (< n 15) (< n 16) (< n 17) (< n 18) (< n 19) (< n 20) (< n 21) (< n 22) (< n 23) (< n 24) (< n 25) (< n 26) (< n 27) (< n 28) (< n 29) (< n 30) (< n 31) (< n 32) (< n 33) (< n 34) (< n 35) (< n 36) (< n 37) (< n 38) (< n 39) (< n 40) (< n 41) (< n 42) (< n 43) (< n 44) (< n 45) (< n 46) (< n 47) (< n 48) (< n 49) (< n 50) (< n 51) (< n 52) (< n 53) (< n 54) (< n 55) (< n 56) (< n 57) (< n 58) (< n 59) (< n 60) (< n 61) (< n 62) (< n 63) (< n 64) (< n 65)))
+(define (any7 n) (my-or (= n 0) (= n 1) (= n 2) (= n 3) (= n 4) (= n 5) (= n 6) (= n 7) (= n 8) (= n 9) (= n 10) (= n 11) (= n 12) (= n 13) (= n 14) (= n 15) (= n 16) (= n 17) (= n 18) (= n 19) (= n 20) (= n 21) (= n 22) (= n 23) (= n 24) (= n 25) (= n 26) (= n 27) (= n 28) (= n 29) (= n 30) (= n 31) (= n 32) (= n 33) (= n 34) (= n 35) (= n 36) (= n 37) (= n 38) (= n 39) (= n 40) (= n 41) (= n 42) (= n 43) (= n 44) (= n 45) (= n 46) (= n 47) (= n 48) (= n 49) (= n 50) (= n 51) (= n 52) (= n 53) (= n 54) (= n 55) (= n 56) (= n 57) (= n 58) (= n 59)))
+(define (all7 n) (my-and (< n 7) (< n 8) (< n 9) (< n 10) (< n 11) (< n 12) (< n 13) (< n 14) (< n 15) (< n 16) (< n 17) (< n 18) (< n 19) (< n 20) (< n 21) (< n 22) (< n 23) (< n 24) (< n 25) (< n 26) (< n 27) (< n 28) (< n 29) (< n 30) (< n 31) (< n 32) (< n 33) (< n 34) (< n 35) (< n 36) (< n 37) (< n 38) (< n 39) (< n 40) (< n 41) (< n 42) (< n 43) (< n 44) (< n 45) (< n 46) (< n 47) (< n 48) (< n 49) (< n 50) (< n 51) (< n 52) (< n 53) (< n 54) (< n 55) (< n 56) (< n 57) (< n 58) (< n 59) (< n 60) (< n 61) (< n 62) (< n 63) (< n 64) (< n 65) (< n 66)))
+(define (any8 n) (my-or (= n 0) (= n 1) (= n 2) (= n 3) (= n 4) (= n 5) (= n 6) (= n 7) (= n 8) (= n 9) (= n 10) (= n 11) (= n 12) (= n 13) (= n 14) (= n 15) (= n 16) (= n 17) (= n 18) (= n 19) (= n 20) (= n 21) (= n 22) (= n 23) (= n 24) (= n 25) (= n 26) (= n 27) (= n 28) (= n 29) (= n 30) (= n 31) (= n 32) (= n 33) (= n 34) (= n 35) (= n 36) (= n 37) (= n 38) (= n 39) (= n 40) (= n 41) (= n 42) (= n 43) (= n 44) (= n 45) (= n 46) (= n 47) (= n 48) (= n 49) (= n 50) (= n 51) (= n 52) (= n 53) (= n 54) (= n 55) (= n 56) (= n 57) (= n 58) (= n 59)))
+(define (all8 n) (my-and (< n 8) (< n 9) (< n 10) (< n 11) (< n 12) (< n 13) (< n 14) (< n 15) (< n 16) (< n 17) (< n 18) (< n 19) (< n 20) (< n 21) (< n 22) (< n 23) (< n 24) (< n 25) (< n 26) (< n 27) (< n 28) (< n 29) (< n 30) (< n 31) (< n 32) (< n 33) (< n 34) (< n 35) (< n 36) (< n 37) (< n 38) (< n 39) (< n 40) (< n 41) (< n 42) (< n 43) (< n 44) (< n 45) (< n 46) (< n 47) (< n 48) (< n 49) (< n 50) (< n 51) (< n 52) (< n 53) (< n 54) (< n 55) (< n 56) (< n 57) (< n 58) (< n 59) (< n 60) (< n 61) (< n 62) (< n 63) (< n 64) (< n 65) (< n 66) (< n 67)))
+(define (any9 n) (my-or (= n 0) (= n 1) (= n 2) (= n 3) (= n 4) (= n 5) (= n 6) (= n 7) (= n 8) (= n 9) (= n 10) (= n 11) (= n 12) (= n 13) (= n 14) (= n 15) (= n 16) (= n 17) (= n 18) (= n 19) (= n 20) (= n 21) (= n 22) (= n 23) (= n 24) (= n 25) (= n 26) (= n 27) (= n 28) (= n 29) (= n 30) (= n 31) (= n 32) (= n 33) (= n 34) (= n 35) (= n 36) (= n 37) (= n 38) (= n 39) (= n 40) (= n 41) (= n 42) (= n 43) (= n 44) (= n 45) (= n 46) (= n 47) (= n 48) (= n 49) (= n 50) (= n 51) (= n 52) (= n 53) (= n 54) (= n 55) (= n 56) (= n 57) (= n 58) (= n 59)))
+(define (all9 n) (my-and (< n 9) (< n 10) (< n 11) (< n 12) (< n 13) (< n 14) (< n 15) (< n 16) (< n 17) (< n 18) (< n 19) (< n 20) (< n 21) (< n 22) (< n 23) (< n 24) (< n 25) (< n 26) (< n 27) (< n 28) (< n 29) (< n 30) (< n 31) (< n 32) (< n 33) (< n 34) (< n 35) (< n 36) (< n 37) (< n 38) (< n 39) (< n 40) (< n 41) (< n 42) (< n 43) (< n 44) (< n 45) (< n 46) (< n 47) (< n 48) (< n 49) (< n 50) (< n 51) (< n 52) (< n 53) (< n 54) (< n 55) (< n 56) (< n 57) (< n 58) (< n 59) (< n 60) (< n 61) (< n 62) (< n 63) (< n 64) (< n 65) (< n 66) (< n 67) (< n 68)))
+(define (any10 n) (my-or (= n 0) (= n 1) (= n 2) (= n 3) (= n 4) (= n 5) (= n 6) (= n 7) (= n 8) (= n 9) (= n 10) (= n 11) (= n 12) (= n 13) (= n 14) (= n 15) (= n 16) (= n 17) (= n 18) (= n 19) (= n 20) (= n 21) (= n 22) (= n 23) (= n 24) (= n 25) (= n 26) (= n 27) (= n 28) (= n 29) (= n 30) (= n 31) (= n 32) (= n 33) (= n 34) (= n 35) (= n 36) (= n 37) (= n 38) (= n 39) (= n 40) (= n 41) (= n 42) (= n 43) (= n 44) (= n 45) (= n 46) (= n 47) (= n 48) (= n 49) (= n 50) (= n 51) (= n 52) (= n 53) (= n 54) (= n 55) (= n 56) (= n 57) (= n 58) (= n 59)))
+(define (all10 n) (my-and (< n 10) (< n 11) (< n 12) (< n 13) (< n 14) (< n 15) (< n 16) (< n 17) (< n 18) (< n 19) (< n 20) (< n 21) (< n 22) (< n 23) (< n 24) (< n 25) (< n 26) (< n 27) (< n 28) (< n 29) (< n 30) (< n 31) (< n 32) (< n 33) (< n 34) (< n 35) (< n 36) (< n 37) (< n 38) (< n 39) (< n 40) (< n 41) (< n 42) (< n 43) (< n 44) (< n 45) (< n 46) (< n 47) (< n 48) (< n 49) (< n 50) (< n 51) (< n 52) (< n 53) (< n 54) (< n 55) (< n 56) (< n 57) (< n 58) (< n 59) (< n 60) (< n 61) (< n 62) (< n 63) (< n 64) (< n 65) (< n 66) (< n 67) (< n 68) (< n 69)))
+(define (any11 n) (my-or (= n 0) (= n 1) (= n 2) (= n 3) (= n 4) (= n 5) (= n 6) (= n 7) (= n 8) (= n 9) (= n 10) (= n 11) (= n 12) (= n 13) (= n 14) (= n 15) (= n 16) (= n 17) (= n 18) (= n 19) (= n 20) (= n 21) (= n 22) (= n 23) (= n 24) (= n 25) (= n 26) (= n 27) (= n 28) (= n 29) (= n 30) (= n 31) (= n 32) (= n 33) (= n 34) (= n 35) (= n 36) (= n 37) (= n 38) (= n 39) (= n 40) (= n 41) (= n 42) (= n 43) (= n 44) (= n 45) (= n 46) (= n 47) (= n 48) (= n 49) (= n 50) (= n 51) (= n 52) (= n 53) (= n 54) (= n 55) (= n 56) (= n 57) (= n 58) (= n 59)))
+(define (all11 n) (my-and (< n 11) (< n 12) (< n 13) (< n 14) (< n 15) (< n 16) (< n 17) (< n 18) (< n 19) (< n 20) (< n 21) (< n 22) (< n 23) (< n 24) (< n 25) (< n 26) (< n 27) (< n 28) (< n 29) (< n 30) (< n 31) (< n 32) (< n 33) (< n 34) (< n 35) (< n 36) (< n 37) (< n 38) (< n 39) (< n 40) (< n 41) (< n 42) (< n 43) (< n 44) (< n 45) (< n 46) (< n 47) (< n 48) (< n 49) (< n 50) (< n 51) (< n 52) (< n 53) (< n 54) (< n 55) (< n 56) (< n 57) (< n 58) (< n 59) (< n 60) (< n 61) (< n 62) (< n 63) (< n 64) (< n 65) (< n 66) (< n 67) (< n 68) (< n 69) (< n 70)))
+(define (chain0 v0) (my-let* ((v1 (+ v0 1)) (v2 (+ v1 1)) (v3 (+ v2 1)) (v4 (+ v3 1)) (v5 (+ v4 1)) (v6 (+ v5 1)) (v7 (+ v6 1)) (v8 (+ v7 1)) (v9 (+ v8 1)) (v10 (+ v9 1)) (v11 (+ v10 1)) (v12 (+ v11 1)) (v13 (+ v12 1)) (v14 (+ v13 1)) (v15 (+ v14 1)) (v16 (+ v15 1)) (v17 (+ v16 1)) (v18 (+ v17 1)) (v19 (+ v18 1)) (v20 (+ v19 1)) (v21 (+ v20 1)) (v22 (+ v21 1)) (v23 (+ v22 1)) (v24 (+ v23 1)) (v25 (+ v24 1)) (v26 (+ v25 1)) (v27 (+ v26 1)) (v28 (+ v27 1)) (v29 (+ v28 1)) (v30 (+ v29 1)) (v31 (+ v30 1)) (v32 (+ v31 1)) (v33 (+ v32 1)) (v34 (+ v33 1)) (v35 (+ v34 1)) (v36 (+ v35 1)) (v37 (+ v36 1)) (v38 (+ v37 1)) (v39 (+ v38 1)) (v40 (+ v39 1))) v40))
+(define (chain1 v0) (my-let* ((v1 (+ v0 1)) (v2 (+ v1 1)) (v3 (+ v2 1)) (v4 (+ v3 1)) (v5 (+ v4 1)) (v6 (+ v5 1)) (v7 (+ v6 1)) (v8 (+ v7 1)) (v9 (+ v8 1)) (v10 (+ v9 1)) (v11 (+ v10 1)) (v12 (+ v11 1)) (v13 (+ v12 1)) (v14 (+ v13 1)) (v15 (+ v14 1)) (v16 (+ v15 1)) (v17 (+ v16 1)) (v18 (+ v17 1)) (v19 (+ v18 1)) (v20 (+ v19 1)) (v21 (+ v20 1)) (v22 (+ v21 1)) (v23 (+ v22 1)) (v24 (+ v23 1)) (v25 (+ v24 1)) (v26 (+ v25 1)) (v27 (+ v26 1)) (v28 (+ v27 1)) (v29 (+ v28 1)) (v30 (+ v29 1)) (v31 (+ v30 1)) (v32 (+ v31 1)) (v33 (+ v32 1)) (v34 (+ v33 1)) (v35 (+ v34 1)) (v36 (+ v35 1)) (v37 (+ v36 1)) (v38 (+ v37 1)) (v39 (+ v38 1)) (v40 (+ v39 1))) v40))
+(define (chain2 v0) (my-let* ((v1 (+ v0 1)) (v2 (+ v1 1)) (v3 (+ v2 1)) (v4 (+ v3 1)) (v5 (+ v4 1)) (v6 (+ v5 1)) (v7 (+ v6 1)) (v8 (+ v7 1)) (v9 (+ v8 1)) (v10 (+ v9 1)) (v11 (+ v10 1)) (v12 (+ v11 1)) (v13 (+ v12 1)) (v14 (+ v13 1)) (v15 (+ v14 1)) (v16 (+ v15 1)) (v17 (+ v16 1)) (v18 (+ v17 1)) (v19 (+ v18 1)) (v20 (+ v19 1)) (v21 (+ v20 1)) (v22 (+ v21 1)) (v23 (+ v22 1)) (v24 (+ v23 1)) (v25 (+ v24 1)) (v26 (+ v25 1)) (v27 (+ v26 1)) (v28 (+ v27 1)) (v29 (+ v28 1)) (v30 (+ v29 1)) (v31 (+ v30 1)) (v32 (+ v31 1)) (v33 (+ v32 1)) (v34 (+ v33 1)) (v35 (+ v34 1)) (v36 (+ v35 1)) (v37 (+ v36 1)) (v38 (+ v37 1)) (v39 (+ v38 1)) (v40 (+ v39 1))) v40))
+(define (chain3 v0) (my-let* ((v1 (+ v0 1)) (v2 (+ v1 1)) (v3 (+ v2 1)) (v4 (+ v3 1)) (v5 (+ v4 1)) (v6 (+ v5 1)) (v7 (+ v6 1)) (v8 (+ v7 1)) (v9 (+ v8 1)) (v10 (+ v9 1)) (v11 (+ v10 1)) (v12 (+ v11 1)) (v13 (+ v12 1)) (v14 (+ v13 1)) (v15 (+ v14 1)) (v16 (+ v15 1)) (v17 (+ v16 1)) (v18 (+ v17 1)) (v19 (+ v18 1)) (v20 (+ v19 1)) (v21 (+ v20 1)) (v22 (+ v21 1)) (v23 (+ v22 1)) (v24 (+ v23 1)) (v25 (+ v24 1)) (v26 (+ v25 1)) (v27 (+ v26 1)) (v28 (+ v27 1)) (v29 (+ v28 1)) (v30 (+ v29 1)) (v31 (+ v30 1)) (v32 (+ v31 1)) (v33 (+ v32 1)) (v34 (+ v33 1)) (v35 (+ v34 1)) (v36 (+ v35 1)) (v37 (+ v36 1)) (v38 (+ v37 1)) (v39 (+ v38 1)) (v40 (+ v39 1))) v40))
+(define (chain4 v0) (my-let* ((v1 (+ v0 1)) (v2 (+ v1 1)) (v3 (+ v2 1)) (v4 (+ v3 1)) (v5 (+ v4 1)) (v6 (+ v5 1)) (v7 (+ v6 1)) (v8 (+ v7 1)) (v9 (+ v8 1)) (v10 (+ v9 1)) (v11 (+ v10 1)) (v12 (+ v11 1)) (v13 (+ v12 1)) (v14 (+ v13 1)) (v15 (+ v14 1)) (v16 (+ v15 1)) (v17 (+ v16 1)) (v18 (+ v17 1)) (v19 (+ v18 1)) (v20 (+ v19 1)) (v21 (+ v20 1)) (v22 (+ v21 1)) (v23 (+ v22 1)) (v24 (+ v23 1)) (v25 (+ v24 1)) (v26 (+ v25 1)) (v27 (+ v26 1)) (v28 (+ v27 1)) (v29 (+ v28 1)) (v30 (+ v29 1)) (v31 (+ v30 1)) (v32 (+ v31 1)) (v33 (+ v32 1)) (v34 (+ v33 1)) (v35 (+ v34 1)) (v36 (+ v35 1)) (v37 (+ v36 1)) (v38 (+ v37 1)) (v39 (+ v38 1)) (v40 (+ v39 1))) v40))
+(define (chain5 v0) (my-let* ((v1 (+ v0 1)) (v2 (+ v1 1)) (v3 (+ v2 1)) (v4 (+ v3 1)) (v5 (+ v4 1)) (v6 (+ v5 1)) (v7 (+ v6 1)) (v8 (+ v7 1)) (v9 (+ v8 1)) (v10 (+ v9 1)) (v11 (+ v10 1)) (v12 (+ v11 1)) (v13 (+ v12 1)) (v14 (+ v13 1)) (v15 (+ v14 1)) (v16 (+ v15 1)) (v17 (+ v16 1)) (v18 (+ v17 1)) (v19 (+ v18 1)) (v20 (+ v19 1)) (v21 (+ v20 1)) (v22 (+ v21 1)) (v23 (+ v22 1)) (v24 (+ v23 1)) (v25 (+ v24 1)) (v26 (+ v25 1)) (v27 (+ v26 1)) (v28 (+ v27 1)) (v29 (+ v28 1)) (v30 (+ v29 1)) (v31 (+ v30 1)) (v32 (+ v31 1)) (v33 (+ v32 1)) (v34 (+ v33 1)) (v35 (+ v34 1)) (v36 (+ v35 1)) (v37 (+ v36 1)) (v38 (+ v37 1)) (v39 (+ v38 1)) (v40 (+ v39 1))) v40))
+(define (chain6 v0) (my-let* ((v1 (+ v0 1)) (v2 (+ v1 1)) (v3 (+ v2 1)) (v4 (+ v3 1)) (v5 (+ v4 1)) (v6 (+ v5 1)) (v7 (+ v6 1)) (v8 (+ v7 1)) (v9 (+ v8 1)) (v10 (+ v9 1)) (v11 (+ v10 1)) (v12 (+ v11 1)) (v13 (+ v12 1)) (v14 (+ v13 1)) (v15 (+ v14 1)) (v16 (+ v15 1)) (v17 (+ v16 1)) (v18 (+ v17 1)) (v19 (+ v18 1)) (v20 (+ v19 1)) (v21 (+ v20 1)) (v22 (+ v21 1)) (v23 (+ v22 1)) (v24 (+ v23 1)) (v25 (+ v24 1)) (v26 (+ v25 1)) (v27 (+ v26 1)) (v28 (+ v27 1)) (v29 (+ v28 1)) (v30 (+ v29 1)) (v31 (+ v30 1)) (v32 (+ v31 1)) (v33 (+ v32 1)) (v34 (+ v33 1)) (v35 (+ v34 1)) (v36 (+ v35 1)) (v37 (+ v36 1)) (v38 (+ v37 1)) (v39 (+ v38 1)) (v40 (+ v39 1))) v40))
+(define (chain7 v0) (my-let* ((v1 (+ v0 1)) (v2 (+ v1 1)) (v3 (+ v2 1)) (v4 (+ v3 1)) (v5 (+ v4 1)) (v6 (+ v5 1)) (v7 (+ v6 1)) (v8 (+ v7 1)) (v9 (+ v8 1)) (v10 (+ v9 1)) (v11 (+ v10 1)) (v12 (+ v11 1)) (v13 (+ v12 1)) (v14 (+ v13 1)) (v15 (+ v14 1)) (v16 (+ v15 1)) (v17 (+ v16 1)) (v18 (+ v17 1)) (v19 (+ v18 1)) (v20 (+ v19 1)) (v21 (+ v20 1)) (v22 (+ v21 1)) (v23 (+ v22 1)) (v24 (+ v23 1)) (v25 (+ v24 1)) (v26 (+ v25 1)) (v27 (+ v26 1)) (v28 (+ v27 1)) (v29 (+ v28 1)) (v30 (+ v29 1)) (v31 (+ v30 1)) (v32 (+ v31 1)) (v33 (+ v32 1)) (v34 (+ v33 1)) (v35 (+ v34 1)) (v36 (+ v35 1)) (v37 (+ v36 1)) (v38 (+ v37 1)) (v39 (+ v38 1)) (v40 (+ v39 1))) v40))
+(define (chain8 v0) (my-let* ((v1 (+ v0 1)) (v2 (+ v1 1)) (v3 (+ v2 1)) (v4 (+ v3 1)) (v5 (+ v4 1)) (v6 (+ v5 1)) (v7 (+ v6 1)) (v8 (+ v7 1)) (v9 (+ v8 1)) (v10 (+ v9 1)) (v11 (+ v10 1)) (v12 (+ v11 1)) (v13 (+ v12 1)) (v14 (+ v13 1)) (v15 (+ v14 1)) (v16 (+ v15 1)) (v17 (+ v16 1)) (v18 (+ v17 1)) (v19 (+ v18 1)) (v20 (+ v19 1)) (v21 (+ v20 1)) (v22 (+ v21 1)) (v23 (+ v22 1)) (v24 (+ v23 1)) (v25 (+ v24 1)) (v26 (+ v25 1)) (v27 (+ v26 1)) (v28 (+ v27 1)) (v29 (+ v28 1)) (v30 (+ v29 1)) (v31 (+ v30 1)) (v32 (+ v31 1)) (v33 (+ v32 1)) (v34 (+ v33 1)) (v35 (+ v34 1)) (v36 (+ v35 1)) (v37 (+ v36 1)) (v38 (+ v37 1)) (v39 (+ v38 1)) (v40 (+ v39 1))) v40))
+(define (chain9 v0) (my-let* ((v1 (+ v0 1)) (v2 (+ v1 1)) (v3 (+ v2 1)) (v4 (+ v3 1)) (v5 (+ v4 1)) (v6 (+ v5 1)) (v7 (+ v6 1)) (v8 (+ v7 1)) (v9 (+ v8 1)) (v10 (+ v9 1)) (v11 (+ v10 1)) (v12 (+ v11 1)) (v13 (+ v12 1)) (v14 (+ v13 1)) (v15 (+ v14 1)) (v16 (+ v15 1)) (v17 (+ v16 1)) (v18 (+ v17 1)) (v19 (+ v18 1)) (v20 (+ v19 1)) (v21 (+ v20 1)) (v22 (+ v21 1)) (v23 (+ v22 1)) (v24 (+ v23 1)) (v25 (+ v24 1)) (v26 (+ v25 1)) (v27 (+ v26 1)) (v28 (+ v27 1)) (v29 (+ v28 1)) (v30 (+ v29 1)) (v31 (+ v30 1)) (v32 (+ v31 1)) (v33 (+ v32 1)) (v34 (+ v33 1)) (v35 (+ v34 1)) (v36 (+ v35 1)) (v37 (+ v36 1)) (v38 (+ v37 1)) (v39 (+ v38 1)) (v40 (+ v39 1))) v40))
+(define (chain10 v0) (my-let* ((v1 (+ v0 1)) (v2 (+ v1 1)) (v3 (+ v2 1)) (v4 (+ v3 1)) (v5 (+ v4 1)) (v6 (+ v5 1)) (v7 (+ v6 1)) (v8 (+ v7 1)) (v9 (+ v8 1)) (v10 (+ v9 1)) (v11 (+ v10 1)) (v12 (+ v11 1)) (v13 (+ v12 1)) (v14 (+ v13 1)) (v15 (+ v14 1)) (v16 (+ v15 1)) (v17 (+ v16 1)) (v18 (+ v17 1)) (v19 (+ v18 1)) (v20 (+ v19 1)) (v21 (+ v20 1)) (v22 (+ v21 1)) (v23 (+ v22 1)) (v24 (+ v23 1)) (v25 (+ v24 1)) (v26 (+ v25 1)) (v27 (+ v26 1)) (v28 (+ v27 1)) (v29 (+ v28 1)) (v30 (+ v29 1)) (v31 (+ v30 1)) (v32 (+ v31 1)) (v33 (+ v32 1)) (v34 (+ v33 1)) (v35 (+ v34 1)) (v36 (+ v35 1)) (v37 (+ v36 1)) (v38 (+ v37 1)) (v39 (+ v38 1)) (v40 (+ v39 1))) v40))
+(define (chain11 v0) (my-let* ((v1 (+ v0 1)) (v2 (+ v1 1)) (v3 (+ v2 1)) (v4 (+ v3 1)) (v5 (+ v4 1)) (v6 (+ v5 1)) (v7 (+ v6 1)) (v8 (+ v7 1)) (v9 (+ v8 1)) (v10 (+ v9 1)) (v11 (+ v10 1)) (v12 (+ v11 1)) (v13 (+ v12 1)) (v14 (+ v13 1)) (v15 (+ v14 1)) (v16 (+ v15 1)) (v17 (+ v16 1)) (v18 (+ v17 1)) (v19 (+ v18 1)) (v20 (+ v19 1)) (v21 (+ v20 1)) (v22 (+ v21 1)) (v23 (+ v22 1)) (v24 (+ v23 1)) (v25 (+ v24 1)) (v26 (+ v25 1)) (v27 (+ v26 1)) (v28 (+ v27 1)) (v29 (+ v28 1)) (v30 (+ v29 1)) (v31 (+ v30 1)) (v32 (+ v31 1)) (v33 (+ v32 1)) (v34 (+ v33 1)) (v35 (+ v34 1)) (v36 (+ v35 1)) (v37 (+ v36 1)) (v38 (+ v37 1)) (v39 (+ v38 1)) (v40 (+ v39 1))) v40))
+(define t (tree (a b c d e f g h i j k l m n o) 1))
+(list (any3 59) (all5 0) (chain7 0) (car (car (car (car (car (car (car (car (car (car (car (car (car (car (car t))))))))))))))))
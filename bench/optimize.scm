@@ -0,0 +1,14 @@
+; constant expressions, immediately applied lambdas and small helper
+; procedures in a hot loop; compare with -O0 and the --no-* switches
+(define (square x) (* x x))
+(define (inc x) (+ x 1))
+
+(define (loop i acc)
+  (if (= i 0)
+      acc
+      (loop (- i 1)
+            ((lambda (a b) (inc (+ a (square b))))
+             acc
+             (if #t (- (* 2 (+ 3 4)) 13) 0)))))
+
+(loop 1000000 0)
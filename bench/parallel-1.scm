@@ -0,0 +1,12 @@
+; options: --workers 1
+; fib of 20 for 64 items with parallel-map on one worker, the
+; reference for parallel-8.scm and parallel-16.scm
+(define (fib n)
+  (if (< n 2)
+      n
+      (+ (fib (- n 1)) (fib (- n 2)))))
+(define (make-items n acc)
+  (if (= n 0) acc (make-items (- n 1) (cons 20 acc))))
+(define (sum l acc)
+  (if (null? l) acc (sum (cdr l) (+ acc (car l)))))
+(sum (parallel-map fib (make-items 64 '())) 0)
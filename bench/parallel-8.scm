@@ -0,0 +1,11 @@
+; options: --workers 8
+; parallel-1.scm on 8 workers: near 8 times faster with as many cores
+(define (fib n)
+  (if (< n 2)
+      n
+      (+ (fib (- n 1)) (fib (- n 2)))))
+(define (make-items n acc)
+  (if (= n 0) acc (make-items (- n 1) (cons 20 acc))))
+(define (sum l acc)
+  (if (null? l) acc (sum (cdr l) (+ acc (car l)))))
+(sum (parallel-map fib (make-items 64 '())) 0)
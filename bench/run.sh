@@ -0,0 +1,130 @@
+#!/bin/sh
+# usage: bench/run.sh PROGRAM RESULTS.json [BASELINE.json]
+#
+# Runs every bench/*.scm, and a large datum generated here for the
+# reader, BENCH_RUNS times each with PROGRAM -b -s and the options on a
+# first line of the form "; options: ...", if any.  Writes the fastest
+# wall time and the instructions, cells allocated and collections of
+# each to RESULTS.json, one benchmark per line.  With a baseline, exits
+# with 1 if a benchmark got more than BENCH_THRESHOLD percent slower or
+# ran or allocated that much more.
+
+prog=$1
+results=$2
+baseline=$3
+runs=${BENCH_RUNS:-3}
+threshold=${BENCH_THRESHOLD:-5}
+dir=$(dirname "$0")
+
+if [ -z "$prog" ] || [ -z "$results" ]; then
+  echo "usage: $0 PROGRAM RESULTS.json [BASELINE.json]" >&2
+  exit 2
+fi
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT INT TERM
+
+# 600000 numbers, symbols and strings in lists of ten, in one quoted datum
+awk 'BEGIN {
+  print "(define data (quote ("
+  for(i = 0; i < 60000; i++){
+    printf "(%d sym-%d \"str %d\" %d.5 (%d %d) #t a-longer-symbol-name %d -%d)\n",
+           i, i, i, i, i, i + 1, i * 7, i
+  }
+  print ")))"
+  print "(car (car data))"
+}' > "$tmp/parse.scm"
+
+# the statistics -s prints, as a JSON object
+parse_stats() {
+  awk -v name="$1" '
+    /^time: / { wall = $2 }
+    /^instructions: / { instructions = $2 }
+    /^cells allocated: / { cells = $3 }
+    /^collections: / { gcs = $2 + 0; gc_ms = $3; gc_max = $6 }
+    END {
+      printf "{\"name\": \"%s\", \"wall_ms\": %s, \"instructions\": %s, \"cells\": %s, \"gc_count\": %s, \"gc_ms\": %s, \"gc_max_ms\": %s}\n",
+             name, wall, instructions, cells, gcs, gc_ms, gc_max
+    }'
+}
+
+# name wall_ms instructions cells gc_count gc_ms, from the lines of a
+# results file
+fields() {
+  awk '/"name": / {
+    line = $0
+    gsub(/[{}",:]/, " ", line)
+    n = split(line, w, " ")
+    for(i = 1; i < n; i += 2) v[w[i]] = w[i + 1]
+    print v["name"], v["wall_ms"], v["instructions"], v["cells"], v["gc_count"], v["gc_ms"]
+  }' "$@"
+}
+
+wall_of() {
+  echo "$1" | fields | awk '{ print $2 }'
+}
+
+run_one() {
+  name=$1
+  file=$2
+  best=""
+  i=0
+  options=$(sed -n '1s/^; options: //p' "$file")
+  while [ $i -lt "$runs" ]; do
+    if ! "$prog" -b -s $options < "$file" > /dev/null 2> "$tmp/stats"; then
+      echo "$name: failed" >&2
+      cat "$tmp/stats" >&2
+      exit 1
+    fi
+    line=$(parse_stats "$name" < "$tmp/stats")
+    # keep the run with the lowest wall time
+    if [ -z "$best" ] || awk -v a="$(wall_of "$line")" -v b="$(wall_of "$best")" \
+         'BEGIN { exit !(a + 0 < b + 0) }'; then
+      best=$line
+    fi
+    i=$((i + 1))
+  done
+  echo "$best"
+}
+
+{
+  echo "{\"benchmarks\": ["
+  first=1
+  for file in "$dir"/*.scm "$tmp/parse.scm"; do
+    name=$(basename "$file" .scm)
+    line=$(run_one "$name" "$file") || exit 1
+    if [ $first -eq 0 ]; then echo ","; fi
+    printf '  %s' "$line"
+    first=0
+  done
+  echo ""
+  echo "]}"
+} > "$tmp/results.json" || exit 1
+mv "$tmp/results.json" "$results"
+
+if [ -z "$baseline" ] || [ ! -f "$baseline" ]; then
+  printf '%-18s %10s %14s %12s %5s %9s\n' benchmark "ms" instructions cells gcs "gc ms"
+  fields "$results" | while read -r name wall ins cells gcs gcms; do
+    printf '%-18s %10.1f %14s %12s %5s %9.1f\n' "$name" "$wall" "$ins" "$cells" "$gcs" "$gcms"
+  done
+  exit 0
+fi
+
+fields "$baseline" > "$tmp/old"
+fields "$results" > "$tmp/new"
+awk -v threshold="$threshold" '
+  function change(old, new){ return old > 0 ? (new - old) * 100 / old : 0 }
+  NR == FNR { wall[$1] = $2; ins[$1] = $3; cells[$1] = $4; next }
+  {
+    if(!($1 in wall)){
+      printf "%-18s %10.1f ms  (new)\n", $1, $2
+      next
+    }
+    w = change(wall[$1], $2); i = change(ins[$1], $3); c = change(cells[$1], $4)
+    flag = ""
+    if(w > threshold || i > threshold || c > threshold){ flag = "  REGRESSION"; bad++ }
+    printf "%-18s %10.1f ms %+7.1f%%   instructions %+7.1f%%   cells %+7.1f%%%s\n",
+           $1, $2, w, i, c, flag
+  }
+  END { exit bad > 0 }
+' "$tmp/old" "$tmp/new"
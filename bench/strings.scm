@@ -0,0 +1,10 @@
+; strings built up in the output buffer by write and display
+(define (emit i)
+  (if (= i 0)
+      0
+      (begin
+        (write "a string with \"quotes\" and a \\ backslash")
+        (display " and ")
+        (display i)
+        (emit (- i 1)))))
+(emit 400000)
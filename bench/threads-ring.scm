@@ -0,0 +1,25 @@
+; a chain of 20000 green threads, each waiting on its channel to pass the
+; number it gets, plus one, on to the next; ten numbers go down the chain
+(define (relay in out)
+  (lambda ()
+    (let loop ()
+      (channel-put out (+ (channel-get in) 1))
+      (loop))))
+
+(define (chain n out)
+  (if (= n 0)
+      out
+      (let ((in (make-channel)))
+        (spawn (relay in out))
+        (chain (- n 1) in))))
+
+(define last (make-channel))
+(define first (chain 20000 last))
+
+(define (pass k sum)
+  (if (= k 0)
+      sum
+      (begin
+        (channel-put first k)
+        (pass (- k 1) (+ sum (channel-get last))))))
+(pass 10 0)
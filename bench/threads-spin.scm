@@ -0,0 +1,18 @@
+; 64 green threads computing at once, switched every few thousand
+; instructions, with the results gathered over a channel
+(define (fib n)
+  (if (< n 2)
+      n
+      (+ (fib (- n 1)) (fib (- n 2)))))
+(define results (make-channel))
+(define (start n)
+  (if (> n 0)
+      (begin
+        (spawn (lambda () (channel-put results (fib 18))))
+        (start (- n 1)))))
+(define (gather n sum)
+  (if (= n 0) sum (gather (- n 1) (+ sum (channel-get results)))))
+(define (run n)
+  (start n)
+  (gather n 0))
+(run 64)
@@ -0,0 +1,20 @@
+; a sieve of Eratosthenes over a vector, refilled and copied each
+; round, mostly vector-ref and vector-set!
+(define n 100000)
+(define flags (make-vector n #t))
+(define copy (make-vector n #f))
+(define (sieve)
+  (vector-fill! flags #t)
+  (do ((i 2 (+ i 1)))
+      ((> (* i i) n))
+    (if (vector-ref flags i)
+        (do ((j (* i i) (+ j i)))
+            ((> j (- n 1)))
+          (vector-set! flags j #f))))
+  (vector-copy! copy 0 flags)
+  (do ((i 2 (+ i 1))
+       (primes 0 (if (vector-ref copy i) (+ primes 1) primes)))
+      ((= i n) primes)))
+(do ((i 0 (+ i 1))
+     (acc 0 (+ acc (sieve))))
+    ((= i 3) acc))
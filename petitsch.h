@@ -0,0 +1,136 @@
+// petitsch.h -- running the interpreter inside another program
+//
+// A Context is an interpreter of its own: its heap, globals, macros and
+// symbols are shared with nothing else, so contexts on different threads
+// run in parallel without locks.  Contexts made from another one share
+// its heap and globals instead, and may run on threads of their own at
+// the same time; a collection stops them all.  Each context is used by
+// one thread at a time, and a registered procedure calls back into the
+// context it is given only.  Errors in Scheme code are thrown as
+// std::logic_error.
+//
+//   PetitScheme::Context ctx;
+//   ctx.define("twice", [](PetitScheme::Context &c,
+//                          const std::vector<PetitScheme::Value> &args){
+//     return c.number(args[0].toint() * 2);
+//   }, 1, 1);
+//   ctx.eval("(define (f x) (+ (twice x) 1))");
+//   long n = ctx.call(ctx.lookup("f"), 20).toint();   // 41
+
+#ifndef PETITSCH_H
+#define PETITSCH_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace PetitScheme {
+  namespace Base {
+    class cell;
+    class cell_manager;
+  }
+
+  class Context;
+  class context_entry;
+
+  // A value on the heap of a context, kept alive while a Value refers to
+  // it.  Values must not outlive the last context on their heap, and may
+  // be used by any context on it.  The default one is ().
+  class Value {
+    Base::cell_manager *heap_;
+    Base::cell *cell_;
+
+    friend class Context;
+    Value(Base::cell_manager *heap, Base::cell *c);
+
+  public:
+    Value();
+    Value(const Value &v);
+    Value &operator=(const Value &v);
+    ~Value();
+
+    bool isnull() const;
+    bool isboolean() const;
+    bool isnumber() const;      // exact integers and flonums
+    bool isstring() const;
+    bool issymbol() const;
+    bool ispair() const;
+    bool isprocedure() const;
+
+    // false for #f only
+    bool tobool() const;
+    // an exact integer that fits a long
+    long toint() const;
+    double todouble() const;
+    // the characters of a string or the name of a symbol
+    std::string tostring() const;
+    Value car() const;
+    Value cdr() const;
+    // the external representation, as write prints it
+    std::string write() const;
+
+    // the same object
+    bool operator==(const Value &v) const { return cell_ == v.cell_; }
+    bool operator!=(const Value &v) const { return cell_ != v.cell_; }
+  };
+
+  class Context {
+    struct impl;
+    impl *impl_;
+
+    friend class context_entry;
+    Context(const Context &);
+    Context &operator=(const Context &);
+    Base::cell *own(const Value &v, const char *who);
+    Value wrap(Base::cell *c);
+
+  public:
+    // a procedure of the embedding program, called with the arguments
+    typedef std::function<Value(Context &, const std::vector<Value> &)>
+      native_function;
+
+    Context();
+    // a context on the heap of parent, sharing its globals and macros
+    explicit Context(Context &parent);
+    ~Context();
+
+    // reads and runs the forms in source, returns the value of the last
+    Value eval(const std::string &source);
+    Value call(const Value &proc, const std::vector<Value> &args);
+    template <class... Args>
+    Value call(const Value &proc, const Args &... args){
+      return call(proc, std::vector<Value>{ make(args)... });
+    }
+
+    // Limits on each eval and call, 0 for none: the instructions run,
+    // the cells allocated and the time taken.  Going over one throws
+    // std::logic_error, and the context can be used again after that.
+    void set_limits(unsigned long instructions, unsigned long cells = 0,
+                    unsigned long milliseconds = 0);
+
+    // the value of a global variable; throws if it is unbound
+    Value lookup(const std::string &name);
+    void define(const std::string &name, const Value &value);
+    // min_args and max_args as for builtins, -1: no limit
+    void define(const std::string &name, native_function fn,
+                int min_args = 0, int max_args = -1);
+
+    Value number(long n);
+    Value number(double d);
+    Value boolean(bool b);
+    Value string(const std::string &s);
+    Value symbol(const std::string &name);
+    Value cons(const Value &car, const Value &cdr);
+    Value list(const std::vector<Value> &elems);
+
+    Value make(const Value &v){ return v; }
+    Value make(int n){ return number(static_cast<long>(n)); }
+    Value make(long n){ return number(n); }
+    Value make(double d){ return number(d); }
+    Value make(bool b){ return boolean(b); }
+    Value make(const char *s){ return string(s); }
+    Value make(const std::string &s){ return string(s); }
+  };
+}
+
+#endif /* PETITSCH_H */
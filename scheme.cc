@@ -3,28 +3,180 @@
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
+#include <cerrno>
+#include <climits>
+#include <limits>
+#include <cmath>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <charconv>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <stdexcept>
+#include <new>
+#include <cstdint>
 #include <setjmp.h>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <memory>
+#include <fstream>
+#include <csignal>
+#include <sys/time.h>
+#include "petitsch.h"
 
 
 namespace PetitScheme {
   namespace Base {
 
 
+    class cell;
+    class cell_manager;
+    class scoped_heap;
+
+    // A hash table, open addressing with linear probing: the header is
+    // followed by a power of two of slots, each a key and its value.
+    // NULL keys are free slots, DELETED ones removed entries that
+    // lookups probe past until the table is rebuilt.
+    struct hash_table {
+      enum KIND { EQ, EQV, EQUAL, STRING };
+      static cell *const DELETED;
+
+      KIND kind_;
+      size_t count_;   // entries
+      size_t used_;    // entries and deleted slots
+      size_t mask_;    // slots - 1
+
+      cell **slots(){ return reinterpret_cast<cell **>(this + 1); }
+      size_t capacity() const { return mask_ + 1; }
+      static size_t bytes(size_t capacity){
+        return sizeof(hash_table) + 2 * capacity * sizeof(cell *);
+      }
+    };
+
+    // What an evaluation with limits has left, shared by the VMs that
+    // run its futures.  Each takes instructions and cells from it a few
+    // at a time, see draw; the maximum of a kind is no limit.  Once the
+    // evaluation fails, its futures stop at their next check.
+    struct limits {
+      std::atomic<unsigned long> fuel_;
+      std::atomic<size_t> cells_;
+      const std::chrono::steady_clock::time_point deadline_;
+      std::atomic<bool> failed_;
+
+      limits(unsigned long fuel, size_t cells,
+             std::chrono::steady_clock::time_point deadline)
+        : fuel_(fuel), cells_(cells), deadline_(deadline), failed_(false) {}
+    };
+
+    // takes up to n from what pool has left
+    template<class T> T draw(std::atomic<T> &pool, T n){
+      T left = pool.load();
+      while(left != std::numeric_limits<T>::max()){
+        T take = std::min(left, n);
+        if(pool.compare_exchange_weak(left, left - take)) return take;
+      }
+      return n;
+    }
+
+    // returns n not used to pool
+    template<class T> void give_back(std::atomic<T> &pool, T n){
+      if(pool.load() != std::numeric_limits<T>::max()) pool += n;
+    }
+
+    // The value of a (future thunk), or a chunk of a parallel-map: the
+    // procedure applied to count_ items from items_, or to none if
+    // count_ is -1.  Whoever moves state_ from PENDING to RUNNING runs
+    // it and stores value_, or error_ if it threw.  A worker runs it
+    // within the limits of the evaluation that made it, if any, and
+    // stops it once cancel_ is set.
+    struct future {
+      enum STATE { PENDING, RUNNING, DONE, FAILED };
+
+      std::atomic<int> state_;
+      cell *proc_;
+      cell *items_;
+      long count_;
+      cell *value_;
+      std::string error_;
+      bool located_;   // error_ tells where in the source it happened
+      std::shared_ptr<limits> limits_;
+      // set by a touch that gave up waiting, or when the evaluation
+      // that made it failed
+      std::atomic<bool> cancel_;
+
+      // value is () until there is one; cell is incomplete here
+      future(cell *proc, cell *items, long count, cell *value)
+        : state_(PENDING), proc_(proc), items_(items), count_(count),
+          value_(value), located_(false), cancel_(false) {}
+    };
+
+    // A channel between the green threads of a VM, see VM::block.  It
+    // queues the values put and not yet taken, at most capacity_ of
+    // them, the threads waiting to get one, and (thread . value) per
+    // thread waiting to put one, each a list and its last pair.  Threads
+    // are the VM's records; only the VM that made the channel (owner_)
+    // may use it.
+    struct channel {
+      size_t capacity_;
+      size_t count_;
+      const void *owner_;
+      cell *values_, *values_last_;
+      cell *getters_, *getters_last_;
+      cell *putters_, *putters_last_;
+
+      // nil is (); cell is incomplete here
+      channel(size_t capacity, const void *owner, cell *nil)
+        : capacity_(capacity), count_(0), owner_(owner), values_(nil),
+          values_last_(nil), getters_(nil), getters_last_(nil),
+          putters_(nil), putters_last_(nil) {}
+    };
+
+    // A builtin procedure.  The VM checks the argument count against
+    // min_args/max_args (-1: no limit) before calling func with the
+    // arguments in place on its stack.  Procedures registered by an
+    // embedding program have no func; closure is called with the
+    // procedure itself, whose data it owns.
+    struct native_proc {
+      typedef cell*(*funcp)(cell *const *argv, int argc);
+      typedef cell*(*closurep)(const native_proc *self,
+                               cell *const *argv, int argc);
+
+      const char *name;
+      int min_args;
+      int max_args;
+      funcp func;
+      closurep closure;
+      void *data;
+
+      cell *call(cell *const *argv, int argc) const {
+        if(func != NULL) return func(argv, argc);
+        return closure(this, argv, argc);
+      }
+    };
+
     class cell {
     public:
-      typedef cell*(*funcp)(cell *, cell *);
+      typedef native_proc::funcp funcp;
 
     private:
-      short flag_;
+      int flag_;
       union _object {
         cell *cell_;
-        int ivalue_;
+        long ivalue_;
+        double fvalue_;
         void *cobj_;
-        funcp func_;
+        const native_proc *proc_;
         struct {
           cell* car_;
           cell* cdr_;
@@ -33,10 +185,27 @@ namespace PetitScheme {
           char *str_;
           size_t len_;
         } str_;
+        struct {
+          cell **data_;
+          size_t len_;
+        } vec_;
+        struct {
+          unsigned char *data_;
+          size_t len_;
+        } bytes_;
+        hash_table *table_;
+        future *future_;
+        channel *channel_;
+        struct {
+          unsigned int *limbs_; // little endian base 2^32 magnitude
+          int size_;            // number of limbs, negative if value < 0
+        } big_;
       } object_;
 
 
       cell(const cell &_cell);
+      // heap snapshots copy and relocate cells as they are
+      friend class cell_manager;
     public:
 
       enum CELL_TYPE {
@@ -50,19 +219,47 @@ namespace PetitScheme {
         T_CLOSURE = 64,
         T_CONTINUATION = 128,
         T_OPCODE = 256,
-        T_MARK = 32768
+        T_BIGNUM = 512,
+        T_FLONUM = 1024,
+        T_VECTOR = 2048,
+        T_BYTEVECTOR = 4096,
+        T_TABLE = 8192,
+        T_FUTURE = 16384,
+        T_CHANNEL = 32768,
+        // transient bits owned by the printer; never set outside a print
+        T_PRINT_ACTIVE = 1 << 27,
+        T_PRINT_DONE = 1 << 28,
+        T_PRINT_LABEL = 1 << 29,
+        T_PRINT_BITS = T_PRINT_ACTIVE | T_PRINT_DONE | T_PRINT_LABEL,
+        T_MARK = 1 << 30
       };
 
       static cell *NIL,*T,*F;
-      static cell ___NIL___,___T___,___F___;
 
 
       cell() : flag_(T_UNKNOWN) {}
       ~cell() {
         if(isstring() || issymbol() || issyntax()) free(object_.str_.str_);
+        if(isbignum()) free(object_.big_.limbs_);
+        if(iscontinuation() || isvector()) free(object_.vec_.data_);
+        if(isbytevector()) free(object_.bytes_.data_);
+        if(istable()) free(object_.table_);
+        if(isfuture()) delete object_.future_;
+        if(ischannel()) delete object_.channel_;
       }
-      cell* init(CELL_TYPE type, int arg)
+      cell* init(CELL_TYPE type, long arg)
       { flag_ = type; object_.ivalue_ = arg; return this; }
+      cell* init(double arg)
+      { flag_ = T_FLONUM; object_.fvalue_ = arg; return this; }
+      cell* init(const unsigned int *limbs, int size){
+        size_t len = size < 0 ? -size : size;
+        flag_ = T_BIGNUM;
+        object_.big_.limbs_ =
+          static_cast<unsigned int *>(malloc(len * sizeof(unsigned int)));
+        memcpy(object_.big_.limbs_, limbs, len * sizeof(unsigned int));
+        object_.big_.size_ = size;
+        return this;
+      }
       cell* init(CELL_TYPE type, const char *arg){
         flag_ = type;
         object_.str_.str_ = strdup(arg);
@@ -77,8 +274,58 @@ namespace PetitScheme {
       }
       cell* init()
       { flag_ = T_UNKNOWN; return this; }
-      cell* init(cell* (*arg)(cell *, cell *))
-      { flag_ = T_PROC; object_.func_ = arg; return this; }
+      cell* init(const native_proc *arg)
+      { flag_ = T_PROC; object_.proc_ = arg; return this; }
+      // a stack chunk of capacity words, none of them frozen yet
+      cell* init(CELL_TYPE type, size_t capacity){
+        flag_ = type;
+        object_.vec_.data_ =
+          static_cast<cell **>(malloc(capacity * sizeof(cell *)));
+        if(object_.vec_.data_ == NULL)
+          throw std::logic_error("Can't allocate memory");
+        object_.vec_.len_ = 0;
+        return this;
+      }
+      // a vector or bytevector owning data, from the large-object space
+      cell* init(cell **data, size_t len){
+        flag_ = T_VECTOR;
+        object_.vec_.data_ = data;
+        object_.vec_.len_ = len;
+        return this;
+      }
+      cell* init(unsigned char *data, size_t len){
+        flag_ = T_BYTEVECTOR;
+        object_.bytes_.data_ = data;
+        object_.bytes_.len_ = len;
+        return this;
+      }
+      cell* init(hash_table *table){
+        flag_ = T_TABLE;
+        object_.table_ = table;
+        return this;
+      }
+      cell* init(future *f){
+        flag_ = T_FUTURE;
+        object_.future_ = f;
+        return this;
+      }
+      cell* init(channel *ch){
+        flag_ = T_CHANNEL;
+        object_.channel_ = ch;
+        return this;
+      }
+      cell* init(CELL_TYPE type, cell *const *data, size_t len){
+        flag_ = type;
+        object_.vec_.data_ =
+          static_cast<cell **>(malloc(len * sizeof(cell *)));
+        object_.vec_.len_ = 0;
+        if(len == 0) return this;
+        if(object_.vec_.data_ == NULL)
+          throw std::logic_error("Can't allocate memory");
+        memcpy(object_.vec_.data_, data, len * sizeof(cell *));
+        object_.vec_.len_ = len;
+        return this;
+      }
       cell* init(cell *arg){
         this->clear();
         flag_ = arg->flag_;
@@ -88,12 +335,20 @@ namespace PetitScheme {
           object_.cons_.car_ = arg->object_.cons_.car_;
           object_.cons_.cdr_ = arg->object_.cons_.cdr_;
         }else if(isproc()){
-          object_.func_ = arg->object_.func_;
+          object_.proc_ = arg->object_.proc_;
+        }else if(iscontinuation()){
+          flag_ = T_UNKNOWN;
+          init(T_CONTINUATION, arg->object_.vec_.data_, arg->object_.vec_.len_);
         }else if(issymbol() || isstring() || issyntax()){
           object_.str_.str_ = strdup(arg->object_.str_.str_);
           object_.str_.len_ = arg->object_.str_.len_;
         }else if(isopcode() || isnumber()){
           object_.ivalue_ = arg->object_.ivalue_;
+        }else if(isflonum()){
+          object_.fvalue_ = arg->object_.fvalue_;
+        }else if(isbignum()){
+          flag_ = T_UNKNOWN;
+          init(arg->object_.big_.limbs_, arg->object_.big_.size_);
         }else{
           throw std::logic_error("unknown type");
         }
@@ -113,22 +368,65 @@ namespace PetitScheme {
       bool ispair() const { return flag_ & T_PAIR; }
       bool isclosure() const { return flag_ & T_CLOSURE; }
       bool iscontinuation() const { return flag_ & T_CONTINUATION; }
+      bool isbignum() const { return flag_ & T_BIGNUM; }
+      bool isflonum() const { return flag_ & T_FLONUM; }
+      bool isvector() const { return flag_ & T_VECTOR; }
+      bool isbytevector() const { return flag_ & T_BYTEVECTOR; }
+      bool istable() const { return flag_ & T_TABLE; }
+      bool isfuture() const { return flag_ & T_FUTURE; }
+      bool ischannel() const { return flag_ & T_CHANNEL; }
       bool ismarked() const {return flag_ & T_MARK; }
       bool issametype(cell *a) const { return flag_ == a->flag_; }
       void setmark(){ flag_ |= T_MARK; }
       void clrmark(){ flag_ &= (T_MARK - 1); }
+      bool hasflag(int bits) const { return flag_ & bits; }
+      void setflag(int bits){ flag_ |= bits; }
+      void clrflag(int bits){ flag_ &= ~bits; }
 
-      int ivalue() const {
+      long ivalue() const {
         if(!isnumber() && !isopcode()) return 0;
         else return object_.ivalue_;
       }
+      // unchecked accessors for the numeric fast paths
+      long fixnum() const { return object_.ivalue_; }
+      double fvalue() const { return object_.fvalue_; }
+      const unsigned int *limbs() const { return object_.big_.limbs_; }
+      int limb_size() const { return object_.big_.size_; }
       const char *str() const {
         if(!isstring() && !issymbol()) return "";
         else return object_.str_.str_;
       }
+      // the length of str()
+      size_t length() const {
+        if(!isstring() && !issymbol()) return 0;
+        else return object_.str_.len_;
+      }
+      const native_proc *proc() const {
+        if(!isproc()) return NULL;
+        else return object_.proc_;
+      }
       funcp func() const {
         if(!isproc()) return NULL;
-        else return object_.func_;
+        else return object_.proc_->func;
+      }
+      // The elements of a vector, or a chunk of the VM stack.
+      // Continuations refer to pieces of a chunk's [0, size()), which
+      // are never written again and are all the collector traces.
+      cell **data() const { return object_.vec_.data_; }
+      size_t size() const {
+        return isbytevector() ? object_.bytes_.len_ : object_.vec_.len_;
+      }
+      unsigned char *bytes() const { return object_.bytes_.data_; }
+      hash_table *table() const { return object_.table_; }
+      // a table is rebuilt into a new one when it grows
+      void table(hash_table *t){ if(istable()) object_.table_ = t; }
+      future *fut() const { return object_.future_; }
+      channel *chan() const { return object_.channel_; }
+      // what a vector, bytevector or table holds in the large-object space
+      size_t large_size() const;
+      void freeze(size_t len){
+        if(iscontinuation() && len > object_.vec_.len_)
+          object_.vec_.len_ = len;
       }
       cell *car() const {
         if(!ispair()) return NIL;
@@ -150,6 +448,12 @@ namespace PetitScheme {
 
       void clear(){
         if(isstring() || issymbol() || issyntax()) free(object_.str_.str_);
+        if(isbignum()) free(object_.big_.limbs_);
+        if(iscontinuation() || isvector()) free(object_.vec_.data_);
+        if(isbytevector()) free(object_.bytes_.data_);
+        if(istable()) free(object_.table_);
+        if(isfuture()) delete object_.future_;
+        if(ischannel()) delete object_.channel_;
         flag_ = T_UNKNOWN;
       }
 
@@ -160,21 +464,36 @@ namespace PetitScheme {
         }else if(isstring()){
           printf("string; value=\"%s\"", object_.str_.str_);
         }else if(isnumber()){
-          printf("number; value=\"%d\"", object_.ivalue_);
+          printf("number; value=\"%ld\"", object_.ivalue_);
+        }else if(isflonum()){
+          printf("flonum; value=\"%g\"", object_.fvalue_);
+        }else if(isbignum()){
+          printf("bignum; size=\"%d\"", object_.big_.size_);
         }else if(issymbol()){
           printf("symbol; value=\"%s\"", object_.str_.str_);
         }else if(issyntax()){
           printf("syntax; value=\"%s\"", object_.str_.str_);
         }else if(isproc()){
-          printf("proc; func_addr=\"%p\"", reinterpret_cast<void*>(reinterpret_cast<unsigned long>(object_.func_)));
+          printf("proc; name=\"%s\"", object_.proc_->name);
         }else if(ispair()){
           printf("pair; car=\"%p\",cdr=\"%p\"",
                  reinterpret_cast<void *>(object_.cons_.car_),
                  reinterpret_cast<void *>(object_.cons_.cdr_));
         }else if(isclosure()){
         }else if(iscontinuation()){
+          printf("continuation; size=\"%zu\"", object_.vec_.len_);
+        }else if(isvector()){
+          printf("vector; size=\"%zu\"", object_.vec_.len_);
+        }else if(isbytevector()){
+          printf("bytevector; size=\"%zu\"", object_.bytes_.len_);
+        }else if(istable()){
+          printf("table; count=\"%zu\"", object_.table_->count_);
+        }else if(isfuture()){
+          printf("future; state=\"%d\"", object_.future_->state_.load());
+        }else if(ischannel()){
+          printf("channel; count=\"%zu\"", object_.channel_->count_);
         }else if(isopcode()){
-          printf("opcode; value=\"%d\"", object_.ivalue_);
+          printf("opcode; value=\"%ld\"", object_.ivalue_);
         }
         printf("\n");
       }
@@ -185,8 +504,9 @@ namespace PetitScheme {
         int size_;
         cell *cells_;
         cell *free_cell_;
+        int free_count_;
 
-        cell_block(int size = 512) : size_(size) {
+        cell_block(int size = 512) : size_(size), free_count_(0) {
           if(size == 0) return;
           cells_ = new cell[size_];
           connect_freecell();
@@ -194,10 +514,12 @@ namespace PetitScheme {
 
         void connect_freecell(){
           free_cell_ = cell::NIL;
+          free_count_ = 0;
           for(int i = size_ - 1; i >= 0; i--){
             if(cells_[i].isunused()){
               cells_[i].connect(free_cell_);
               free_cell_ = &(cells_[i]);
+              free_count_++;
             }
           }
         }
@@ -208,7 +530,9 @@ namespace PetitScheme {
           }
         }
 
-        void sweep(){
+        // returns the bytes of the large-object space freed
+        size_t sweep(){
+          size_t freed = 0;
           for(int i = 0; i < size_; i++){
             if(cells_[i].ismarked()){
               cells_[i].clrmark();
@@ -217,194 +541,1054 @@ namespace PetitScheme {
               printf("sweeped %p", &cells_[i]);
               cells_[i].dump();
 #endif /* DEBUG */
+              freed += cells_[i].large_size();
               cells_[i].clear();
             }
           }
           connect_freecell();
+          return freed;
         }
 
-        void mark_cell(cell *bemarked){
-#ifdef DEBUG
-          bemarked->dump();
-#endif /* DEBUG */
-          if(bemarked == cell::NIL || bemarked == cell::F
-             || bemarked == cell::T) return;
-          if(bemarked->ismarked()) return;
-          bemarked->setmark();
-          if(bemarked->ispair()){
-            mark_cell(bemarked->car());
-            mark_cell(bemarked->cdr());
-          }
+        // true if ptr points at the head of one of our cells
+        bool contains(const cell *ptr) const {
+          const char *p = reinterpret_cast<const char *>(ptr);
+          const char *begin = reinterpret_cast<const char *>(cells_);
+          if(p < begin || p >= begin + size_ * sizeof(cell)) return false;
+          return (p - begin) % sizeof(cell) == 0;
         }
 
-        void mark_register(cell **registers, int n){
-          cell **register_ptr = registers;
-          cell *heap_begin = cells_;
-          cell *heap_end = heap_begin + size_;
-#ifdef DEBUG
-          printf("NIL: %p, T: %p, F: %p\n", cell::NIL,cell::T,cell::F);
-          printf("heap_begin: %p, heap_end: %p\n", heap_begin, heap_end);
-#endif /* DEBUG */
-          for(int i = 0; i < n; i++){
-            if(heap_begin <= *register_ptr && heap_end > *register_ptr){
-#ifdef DEBUG
-              printf("found register %p <= %p < %p \n",
-                     heap_begin, *register_ptr, heap_end);
-#endif /* DEBUG */
-              for(int i = 0; i < size_; i++)
-                if(*register_ptr == &(cells_[i]))
-                  mark_cell(*register_ptr);
+        ~cell_block(){
+          delete[] cells_;
+        }
+      };
+
+      static const size_t MIN_HEAP_BLOCKS = 32;
+      // the cells a mutator with a limit draws at least at a time
+      static const size_t CELL_LEASE = 512;
+      // the large-object space may grow this much before it collects
+      static const size_t MIN_LARGE_LIMIT = 1 << 23;
+
+      // blocks_ in allocation order, sorted_ by address for root lookups
+      std::vector<cell_block*> blocks_;
+      std::vector<cell_block*> sorted_;
+      size_t cursor_;
+      std::vector<cell*> mark_stack_;
+      // precise roots outside the C stack: single slots and [begin, *end)
+      std::vector<cell**> roots_;
+      std::vector<std::pair<cell***, cell***> > root_ranges_;
+    public:
+      // key -> value maps that hold their keys weakly: an entry lives
+      // (and keeps its value alive) only as long as its key is reachable
+      typedef std::unordered_map<cell*, cell*> ephemeron_map;
+      // the same for values that are not cells
+      typedef std::unordered_map<cell*, uint64_t> weak_table;
+
+      // A thread of control on the heap: the standalone VM or a context.
+      // It allocates from free cells of its own, taken from the blocks a
+      // free list at a time, and stops at safepoints when another one
+      // collects.  Only a stopped mutator's stack is scanned; one that
+      // is outside holds cells in precise roots alone.
+      struct mutator {
+        enum STATE { OUTSIDE, RUNNING, STOPPED };
+
+        cell_manager *heap_;
+        cell *free_cell_;
+        size_t taken_;       // cells taken from blocks since the last collection
+        size_t budget_;      // cells it may still take, see set_budget
+        std::atomic<size_t> *pool_;   // where more come from, if limited
+        STATE state_;
+        cell **stack_top_;
+        cell **stack_end_;
+        jmp_buf registers_;
+      };
+    private:
+      std::vector<ephemeron_map*> ephemerons_;
+      std::vector<weak_table*> weak_tables_;
+      std::vector<mutator*> mutators_;
+      // lock_ guards everything shared but the cells: the blocks, roots,
+      // symbols and mutators.  A collection holds it from the moment all
+      // mutators but the collecting one are stopped or outside.
+      std::mutex lock_;
+      std::condition_variable changed_;
+      std::atomic<bool> stop_;
+      size_t running_;
+      // The contents of vectors, bytevectors and tables are the
+      // large-object space: malloc'd outside the blocks so big ones
+      // don't take up runs of cells, freed by the sweep of the cell
+      // that owns them, and counted so that allocating them leads to
+      // collections too.
+      size_t large_bytes_;
+      size_t large_limit_;
+      // statistics
+      size_t allocated_;
+      size_t collections_;
+      std::chrono::steady_clock::duration pause_total_;
+      std::chrono::steady_clock::duration pause_max_;
+
+      static size_t list_length(cell *free_cell){
+        size_t n = 0;
+        for(; free_cell != cell::NIL; free_cell = free_cell->next_freecell()) n++;
+        return n;
+      }
+
+      // the cells m has allocated, its free ones given back
+      size_t retire_free_cells(mutator *m){
+        size_t used = m->taken_ - list_length(m->free_cell_);
+        m->free_cell_ = cell::NIL;
+        m->taken_ = 0;
+        return used;
+      }
+      // interned symbols, keyed by the name the symbol cell owns
+      std::unordered_map<std::string_view, cell*> symbols_;
+      // The immortal region [region_begin_, region_end_): cells mapped
+      // from a heap snapshot.  They are never marked or swept, so their
+      // pages stay shared with other processes mapping the same file
+      // until written.  A region pair or vector that is assigned to is
+      // remembered and its fields traced as roots, as is every region
+      // hash table, which is rebuilt in the heap when mapped.
+      static const char *region_begin_;
+      static const char *region_end_;
+      std::unordered_set<cell*> remembered_;
+
+      // the mutator of this thread, see get_instance()
+      static thread_local mutator *current_;
+      friend class scoped_heap;
+
+      static bool block_less(const cell_block *a, const cell_block *b){
+        return a->cells_ < b->cells_;
+      }
+
+      void append_block(){
+        cell_block *block = new cell_block();
+        blocks_.push_back(block);
+        sorted_.insert(std::upper_bound(sorted_.begin(), sorted_.end(),
+                                        block, block_less), block);
+      }
+
+      // takes n cells off the budget of m
+      static void charge(mutator *m, size_t n){
+        if(n > m->budget_ && m->pool_ != NULL){
+          size_t want = n - m->budget_;
+          m->budget_ += draw(*m->pool_, want > CELL_LEASE ? want : CELL_LEASE);
+        }
+        if(n > m->budget_){
+          m->budget_ = 0;
+          throw std::logic_error("heap limit exceeded");
+        }
+        m->budget_ -= n;
+      }
+
+      // gives m the free cells of the next block that has any, or as
+      // many of them as its budget has left
+      bool take_block(mutator *m){
+        for(; cursor_ < blocks_.size(); cursor_++){
+          cell_block *block = blocks_[cursor_];
+          if(block->free_cell_ != cell::NIL){
+            size_t n = block->free_count_;
+            if(m->budget_ < n && m->pool_ != NULL)
+              m->budget_ += draw(*m->pool_, n - m->budget_);
+            if(m->budget_ < n){
+              take_cells(m, block);
+              return true;
             }
-            register_ptr++;
-#ifdef DEBUG
-            printf("register survey %p <= %p, %p\n", registers,
-                   register_ptr, *register_ptr);
-#endif /* DEBUG */
+            charge(m, block->free_count_);
+            m->free_cell_ = block->free_cell_;
+            m->taken_ += block->free_count_;
+            block->free_cell_ = cell::NIL;
+            block->free_count_ = 0;
+            cursor_++;
+            return true;
           }
         }
+        return false;
+      }
+
+      // the first of the free cells of block that m's budget allows,
+      // or throws if it allows none
+      void take_cells(mutator *m, cell_block *block){
+        size_t n = m->budget_ > 0 ? m->budget_ : 1;
+        // with nothing left, throws unless another mutator gave some back
+        charge(m, n);
+        cell *last = block->free_cell_;
+        for(size_t i = 1; i < n; i++) last = last->next_freecell();
+        m->free_cell_ = block->free_cell_;
+        block->free_cell_ = last->next_freecell();
+        last->connect(cell::NIL);
+        m->taken_ += n;
+        block->free_count_ -= n;
+      }
 
-        void mark_stack(cell **stack_top, cell **stack_end){
-          if(stack_top > stack_end){
-            cell **tmp = stack_top;
-            stack_top = stack_end;
-            stack_end = tmp;
+      // m waits, with lock_ held by hold, until the collection another
+      // mutator asked for is done.  The registers and this frame bound
+      // the part of its stack to scan.
+      void stop(mutator *m, std::unique_lock<std::mutex> &hold){
+        // glibc's setjmp saves the frame pointer mangled, so a cell only
+        // that register holds would be missed; this spills every
+        // callee-saved register to this frame, which is scanned too
+        __builtin_unwind_init();
+        setjmp(m->registers_);
+        cell *end;
+        m->stack_end_ = &end;
+        m->state_ = mutator::STOPPED;
+        running_--;
+        changed_.notify_all();
+        changed_.wait(hold, [this]{ return !stop_; });
+        m->state_ = mutator::RUNNING;
+        running_++;
+      }
+
+      // stops the other mutators and collects; m is the caller
+      size_t collect(mutator *m, std::unique_lock<std::mutex> &hold){
+        std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+        stop_ = true;
+        __builtin_unwind_init();   // see stop
+        setjmp(m->registers_);
+        cell *end;
+        m->stack_end_ = &end;
+        m->state_ = mutator::STOPPED;
+        running_--;
+        changed_.wait(hold, [this]{ return running_ == 0; });
+        size_t free_cells = gc();
+        m->state_ = mutator::RUNNING;
+        running_++;
+        stop_ = false;
+        changed_.notify_all();
+        std::chrono::steady_clock::duration pause =
+          std::chrono::steady_clock::now() - start;
+        collections_++;
+        pause_total_ += pause;
+        pause_max_ = std::max(pause_max_, pause);
+        return free_cells;
+      }
+
+      // the allocation slow path: m has used up its free cells
+      cell *refill(mutator *m){
+        std::unique_lock<std::mutex> hold(lock_);
+        while(!take_block(m)){
+          if(stop_){
+            stop(m, hold);
+            continue;
           }
-          cell **stack_ptr = stack_top;
-          cell *heap_begin = cells_;
-          cell *heap_end = heap_begin + size_;
-#ifdef DEBUG
-          dump();
-          printf("NIL: %p, T: %p, F: %p\n", cell::NIL,cell::T,cell::F);
-          printf("heap_begin: %p, heap_end: %p\n", heap_begin, heap_end);
-#endif /* DEBUG */
-          while(stack_ptr < stack_end){
-            if(heap_begin <= *stack_ptr && *stack_ptr < heap_end){
+          // collecting a tiny heap over and over costs more than it frees
+          if(blocks_.size() < MIN_HEAP_BLOCKS){
+            append_block();
+            continue;
+          }
+          size_t free_cells = collect(m, hold);
+          // keep at least a quarter of the heap free, otherwise a big live
+          // set would trigger a full collection every few hundred conses
+          size_t total = blocks_.size() * blocks_[0]->size_;
+          while(free_cells * 4 < total){
+            append_block();
+            free_cells += blocks_.back()->free_count_;
+            total += blocks_.back()->size_;
+          }
+          if(free_cells == 0)
+            throw std::logic_error("Can't allocate memory");
+        }
+        cell *ret = m->free_cell_;
+        m->free_cell_ = ret->next_freecell();
+        return ret;
+      }
+
+      bool isheap(cell *ptr) const {
+        if(sorted_.empty() || ptr < sorted_.front()->cells_) return false;
+        std::vector<cell_block*>::const_iterator it =
+          std::upper_bound(sorted_.begin(), sorted_.end(), ptr, addr_less);
+        return (*--it)->contains(ptr);
+      }
+
+      static bool addr_less(const cell *ptr, const cell_block *b){
+        return ptr < b->cells_;
+      }
+
+      // iterative so that long lists and deep stacks don't overflow
+      void mark_cell(cell *bemarked){
+        mark_stack_.push_back(bemarked);
+        while(!mark_stack_.empty()){
+          cell *c = mark_stack_.back();
+          mark_stack_.pop_back();
+          while(c != cell::NIL && c != cell::F && c != cell::T
+                && !c->ismarked() && !isimmortal(c)){
 #ifdef DEBUG
-              printf("found stack %p <= %p < %p \n",
-                     heap_begin, *stack_ptr, heap_end);
+            c->dump();
 #endif /* DEBUG */
-              for(int i = 0; i < size_; i++)
-                if(*stack_ptr == &(cells_[i]))
-                  mark_cell(*stack_ptr);
+            c->setmark();
+            if(c->iscontinuation() || c->isvector()){
+              mark_stack_.insert(mark_stack_.end(),
+                                 c->data(), c->data() + c->size());
+              break;
             }
-            stack_ptr++;
+            if(c->istable()){
+              hash_table *t = c->table();
+              cell **slot = t->slots();
+              for(size_t i = 0; i < t->capacity(); i++, slot += 2){
+                if(slot[0] == NULL || slot[0] == hash_table::DELETED) continue;
+                mark_stack_.push_back(slot[0]);
+                mark_stack_.push_back(slot[1]);
+              }
+              break;
+            }
+            if(c->isfuture()){
+              future *f = c->fut();
+              mark_stack_.push_back(f->proc_);
+              mark_stack_.push_back(f->items_);
+              mark_stack_.push_back(f->value_);
+              break;
+            }
+            if(c->ischannel()){
+              channel *ch = c->chan();
+              mark_stack_.push_back(ch->values_);
+              mark_stack_.push_back(ch->getters_);
+              mark_stack_.push_back(ch->putters_);
+              break;
+            }
+            if(!c->ispair()) break;
+            mark_stack_.push_back(c->car());
+            c = c->cdr();
+          }
+        }
+      }
+
+      static bool islive(const cell *c){
+        return c->ismarked() || isimmortal(c);
+      }
+
+      // a value may be the only path to another key, so repeat until no
+      // more values get marked, then forget the entries of dead keys
+      void mark_ephemerons(){
+        bool marked = true;
+        while(marked){
+          marked = false;
+          for(size_t i = 0; i < ephemerons_.size(); i++){
+            ephemeron_map::iterator it;
+            for(it = ephemerons_[i]->begin(); it != ephemerons_[i]->end(); ++it){
+              if(islive(it->first) && !it->second->ismarked()){
+                mark_cell(it->second);
+                marked = marked || it->second->ismarked();
+              }
+            }
+          }
+        }
+        for(size_t i = 0; i < ephemerons_.size(); i++){
+          ephemeron_map::iterator it = ephemerons_[i]->begin();
+          while(it != ephemerons_[i]->end()){
+            if(islive(it->first)) ++it;
+            else it = ephemerons_[i]->erase(it);
+          }
+        }
+        for(size_t i = 0; i < weak_tables_.size(); i++){
+          weak_table::iterator it = weak_tables_[i]->begin();
+          while(it != weak_tables_[i]->end()){
+            if(islive(it->first)) ++it;
+            else it = weak_tables_[i]->erase(it);
+          }
+        }
+      }
+
+      void mark_words(cell **begin, cell **end){
+        if(begin > end) std::swap(begin, end);
+        for(cell **ptr = begin; ptr < end; ptr++){
+          if(isheap(*ptr)){
 #ifdef DEBUG
-            printf("stack survey %p <= %p < %p, %p\n",
-                   stack_top, stack_ptr, stack_end, *stack_ptr);
+            printf("found root %p at %p\n", *ptr, ptr);
 #endif /* DEBUG */
+            mark_cell(*ptr);
           }
         }
+      }
+
+      // A heap snapshot file is laid out as the memory it is mapped to:
+      // the header, the addresses of the roots, the cells and the data
+      // they own (names, limbs, stack chunk and vector words, bytes,
+      // table entries).  Pointers are those of the cells mapped at base,
+      // so a process that maps the file there writes nothing but the
+      // builtin procedures, which move with the executable, and the hash
+      // tables.
+      struct snapshot_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t nroots;
+        uint64_t base;
+        uint64_t size;
+        uint64_t cells_at;
+        uint64_t ncells;
+        uint64_t constants;   // () when saved; #t and #f follow it
+        uint64_t builtins;    // the builtin table when saved
+        uint64_t nbuiltins;
+      };
+
+      static const uint32_t SNAPSHOT_VERSION = 1;
 
-        cell *get_cell(){
-          if(free_cell_ == cell::NIL) return free_cell_;
-          cell *ret = free_cell_;
-          free_cell_ = free_cell_->next_freecell();
-          return ret;
+      static size_t align(size_t n){ return (n + 63) & ~size_t(63); }
+
+      // where the cells of a snapshot go when saved
+      static cell *snapshot_address(const std::unordered_map<cell*, size_t> &index,
+                                    size_t cells_at, cell *c){
+        if(c == cell::NIL || c == cell::T || c == cell::F) return c;
+        std::unordered_map<cell*, size_t>::const_iterator it = index.find(c);
+        return reinterpret_cast<cell *>(REGION_ADDRESS + cells_at
+                                        + it->second * sizeof(cell));
+      }
+
+      static void append_data(std::string &data, const void *p, size_t len){
+        data.append(static_cast<const char *>(p), len);
+        while(data.size() % sizeof(cell *) != 0) data.push_back('\0');
+      }
+
+      // a pointer of a mapped snapshot, saved for a region at old_base
+      // that is now at old_base + delta
+      template <class T>
+      static void relocate(T *&p, const snapshot_header &h, ptrdiff_t delta){
+        uint64_t addr = reinterpret_cast<uint64_t>(p);
+        if(addr >= h.base && addr < h.base + h.size){
+          if(delta != 0) p = reinterpret_cast<T *>(addr + delta);
+        }else{
+          throw std::logic_error("snapshot: corrupt");
         }
+      }
 
-        ~cell_block(){
-          delete[] cells_;
+      static void relocate_cell(cell *&p, const snapshot_header &h,
+                                ptrdiff_t delta){
+        uint64_t addr = reinterpret_cast<uint64_t>(p);
+        for(int i = 0; i < 3; i++){
+          if(addr == h.constants + i * sizeof(cell)){
+            if(p != cell::NIL + i) p = cell::NIL + i;
+            return;
+          }
         }
-      };
+        relocate(p, h, delta);
+      }
 
-      cell_block** blocks_;
-      int block_siz_;
-      cell **stack_top_;
-      cell **stack_end_;
+    public:
+      // addresses of (), #t and #f and of the region a heap snapshot is
+      // laid out for, away from where the system puts anything
+      static const uintptr_t CONSTANTS_ADDRESS = 0x1f0000000000;
+      static const uintptr_t REGION_ADDRESS = 0x200000000000;
 
-      cell_manager() : block_siz_(1) {
-        blocks_ = new cell_block*[1];
-        blocks_[0] = new cell_block();
+      cell_manager() : cursor_(0), stop_(false), running_(0),
+                       large_bytes_(0), large_limit_(MIN_LARGE_LIMIT),
+                       allocated_(0), collections_(0), pause_total_(0),
+                       pause_max_(0) {
+        append_block();
       }
 
       ~cell_manager(){
-        for(int i = 0; i < block_siz_; i++)
+        for(size_t i = 0; i < blocks_.size(); i++)
           delete blocks_[i];
-        delete[] blocks_;
-        delete cell::NIL;
-        delete cell::T;
-        delete cell::F;
+        for(size_t i = 0; i < mutators_.size(); i++)
+          delete mutators_[i];
       }
 
-      void append_block(){
-        cell_block **new_blocks = new cell_block*[block_siz_+1];
-        for(int i = 0; i < block_siz_; i++)
-          new_blocks[i] = blocks_[i];
-        new_blocks[block_siz_] = new cell_block();
-        delete[] blocks_;
-        blocks_ = new_blocks;
-        block_siz_++;
+      // Cells of one heap never point into another; only (), #t and #f
+      // are shared.  The heap of a thread is that of its current mutator,
+      // set with scoped_heap.  Without one, a thread gets a heap of its
+      // own on first use, with itself running on it.
+      static cell_manager& get_instance(){
+        if(current_ == NULL){
+          cell_manager *heap = new cell_manager();
+          current_ = heap->attach();
+          heap->enter(current_);
+        }
+        return *current_->heap_;
+      }
+
+      // a new mutator, outside until it enters
+      mutator *attach(){
+        mutator *m = new mutator();
+        m->heap_ = this;
+        m->free_cell_ = cell::NIL;
+        m->taken_ = 0;
+        m->budget_ = SIZE_MAX;
+        m->pool_ = NULL;
+        m->state_ = mutator::OUTSIDE;
+        m->stack_top_ = m->stack_end_ = NULL;
+        std::lock_guard<std::mutex> hold(lock_);
+        mutators_.push_back(m);
+        return m;
+      }
+
+      void detach(mutator *m){
+        std::lock_guard<std::mutex> hold(lock_);
+        allocated_ += retire_free_cells(m);
+        mutators_.erase(std::remove(mutators_.begin(), mutators_.end(), m),
+                        mutators_.end());
+        delete m;
+      }
+
+      // m starts running on the heap, after a collection in progress
+      void enter(mutator *m){
+        std::unique_lock<std::mutex> hold(lock_);
+        changed_.wait(hold, [this]{ return !stop_; });
+        m->state_ = mutator::RUNNING;
+        running_++;
+      }
+
+      void leave(mutator *m){
+        std::lock_guard<std::mutex> hold(lock_);
+        m->state_ = mutator::OUTSIDE;
+        running_--;
+        changed_.notify_all();
+      }
+
+      // polled by the VM; the slow path is out of line
+      bool stopping() const {
+        return stop_.load(std::memory_order_relaxed);
+      }
+
+      __attribute__((noinline)) void safepoint(){
+        std::unique_lock<std::mutex> hold(lock_);
+        if(stop_) stop(current_, hold);
       }
 
-      cell *search_cell(){
-        for(int i = 0; i < block_siz_; i++){
-          cell *ret = blocks_[i]->get_cell();
-          if(ret != cell::NIL) return ret;
+      // Calls wait, which must not touch the heap, with the current
+      // mutator stopped as at a safepoint, so that others may collect
+      // while it blocks.  It runs again once no collection is going on.
+      // One that is outside just waits.
+      template <class F>
+      __attribute__((noinline)) void blocking(F wait){
+        mutator *m = current_;
+        if(m->state_ != mutator::RUNNING){
+          wait();
+          return;
         }
-        return cell::NIL;
+        cell *end;
+        {
+          std::lock_guard<std::mutex> hold(lock_);
+          __builtin_unwind_init();   // see stop
+          setjmp(m->registers_);
+          m->stack_end_ = &end;
+          m->state_ = mutator::STOPPED;
+          running_--;
+          changed_.notify_all();
+        }
+        wait();
+        std::unique_lock<std::mutex> hold(lock_);
+        changed_.wait(hold, [this]{ return !stop_; });
+        m->state_ = mutator::RUNNING;
+        running_++;
       }
 
-    public:
-      static cell_manager& get_instance(){
-        static cell_manager *instance = NULL;
-        if(instance == NULL){
-          instance = new cell_manager();
+      // The cells the current mutator may allocate from now on are taken
+      // from pool, NULL for no limit, which VMs running parts of the
+      // same evaluation share.  They are counted as they are taken from
+      // the blocks, and large objects by the cells their size would
+      // take; the allocation that goes over throws.  Going from one pool
+      // to another, the free cells it has are left for the sweep and
+      // what it drew and didn't allocate goes back.
+      void set_budget(std::atomic<size_t> *pool){
+        mutator *m = current_;
+        if(pool != NULL && pool->load() == SIZE_MAX) pool = NULL;
+        if(pool == m->pool_) return;
+        size_t unused = list_length(m->free_cell_);
+        if(m->pool_ != NULL) give_back(*m->pool_, m->budget_ + unused);
+        if(m->pool_ != NULL || pool != NULL){
+          m->taken_ -= unused;
+          m->free_cell_ = cell::NIL;
+        }
+        m->pool_ = pool;
+        m->budget_ = pool != NULL ? 0 : SIZE_MAX;
+      }
+
+      // room for the contents of a vector or bytevector, after a
+      // collection if the space has grown enough since the last one
+      void *allocate_large(size_t bytes){
+        {
+          std::unique_lock<std::mutex> hold(lock_);
+          while(stop_) stop(current_, hold);
+          charge(current_, (bytes + sizeof(cell) - 1) / sizeof(cell));
+          if(large_bytes_ + bytes > large_limit_) collect(current_, hold);
+          large_bytes_ += bytes;
+        }
+        void *p = malloc(bytes > 0 ? bytes : 1);
+        if(p == NULL){
+          std::lock_guard<std::mutex> hold(lock_);
+          large_bytes_ -= bytes;
+          throw std::logic_error("Can't allocate memory");
+        }
+        return p;
+      }
+
+      // gives back what allocate_large returned
+      void free_large(void *p, size_t bytes){
+        {
+          std::lock_guard<std::mutex> hold(lock_);
+          large_bytes_ -= bytes;
         }
-        return *instance;
+        free(p);
+      }
+
+      void print_stats(std::ostream &os){
+        std::lock_guard<std::mutex> hold(lock_);
+        size_t allocated = allocated_;
+        for(size_t i = 0; i < mutators_.size(); i++)
+          allocated += mutators_[i]->taken_
+            - list_length(mutators_[i]->free_cell_);
+        os << "cells allocated: " << allocated << "\n"
+           << "collections: " << collections_ << ", "
+           << std::chrono::duration<double, std::milli>(pause_total_).count()
+           << " ms total, "
+           << std::chrono::duration<double, std::milli>(pause_max_).count()
+           << " ms max" << "\n";
       }
 
       void set_stack_top(cell **stack_top){
-        stack_top_ = stack_top;
+        current_->stack_top_ = stack_top;
+      }
+
+      void add_root(cell **root){
+        std::lock_guard<std::mutex> hold(lock_);
+        roots_.push_back(root);
+      }
+
+      void remove_root(cell **root){
+        std::lock_guard<std::mutex> hold(lock_);
+        roots_.erase(std::remove(roots_.begin(), roots_.end(), root),
+                     roots_.end());
+      }
+
+      // every slot in [*begin, *end) is a live cell pointer
+      void add_root_range(cell ***begin, cell ***end){
+        std::lock_guard<std::mutex> hold(lock_);
+        root_ranges_.push_back(std::make_pair(begin, end));
+      }
+
+      void remove_root_range(cell ***begin){
+        std::lock_guard<std::mutex> hold(lock_);
+        for(size_t i = 0; i < root_ranges_.size(); i++){
+          if(root_ranges_[i].first == begin){
+            root_ranges_.erase(root_ranges_.begin() + i);
+            return;
+          }
+        }
+      }
+
+      static bool isimmortal(const cell *c){
+        const char *p = reinterpret_cast<const char *>(c);
+        return p >= region_begin_ && p < region_end_;
+      }
+
+      // called after a field of c changes
+      static void write_barrier(cell *c){
+        if(isimmortal(c)) remember(c);
       }
 
+      // out of line, set_car is inlined everywhere
+      __attribute__((noinline)) static void remember(cell *c){
+        cell_manager &heap = get_instance();
+        std::lock_guard<std::mutex> hold(heap.lock_);
+        heap.remembered_.insert(c);
+      }
+
+      void add_ephemerons(ephemeron_map *map){
+        std::lock_guard<std::mutex> hold(lock_);
+        ephemerons_.push_back(map);
+      }
+
+      void remove_ephemerons(ephemeron_map *map){
+        std::lock_guard<std::mutex> hold(lock_);
+        ephemerons_.erase(std::remove(ephemerons_.begin(), ephemerons_.end(),
+                                      map), ephemerons_.end());
+      }
+
+      void add_weak_table(weak_table *table){
+        std::lock_guard<std::mutex> hold(lock_);
+        weak_tables_.push_back(table);
+      }
+
+      void remove_weak_table(weak_table *table){
+        std::lock_guard<std::mutex> hold(lock_);
+        weak_tables_.erase(std::remove(weak_tables_.begin(),
+                                       weak_tables_.end(), table),
+                           weak_tables_.end());
+      }
+
+      // Writes the cells reachable from roots to a heap snapshot at path.
+      // Builtins are saved as pointers into table, which must be the same
+      // table of the same executable when the snapshot is loaded.
+      void save_snapshot(const char *path, const std::vector<cell*> &roots,
+                         const native_proc *table, size_t ntable){
+        std::unordered_map<cell*, size_t> index;
+        std::vector<cell*> cells, work(roots.begin(), roots.end());
+        while(!work.empty()){
+          cell *c = work.back();
+          work.pop_back();
+          if(c == cell::NIL || c == cell::T || c == cell::F
+             || index.count(c) != 0)
+            continue;
+          index[c] = cells.size();
+          cells.push_back(c);
+          if(c->ispair()){
+            work.push_back(c->cdr());
+            work.push_back(c->car());
+          }else if(c->iscontinuation() || c->isvector()){
+            work.insert(work.end(), c->data(), c->data() + c->size());
+          }else if(c->istable()){
+            hash_table *t = c->table();
+            cell **slot = t->slots();
+            for(size_t i = 0; i < t->capacity(); i++, slot += 2){
+              if(slot[0] == NULL || slot[0] == hash_table::DELETED) continue;
+              work.push_back(slot[0]);
+              work.push_back(slot[1]);
+            }
+          }
+        }
+        snapshot_header h;
+        memcpy(h.magic, "PSHEAP\0\0", sizeof(h.magic));
+        h.version = SNAPSHOT_VERSION;
+        h.nroots = roots.size();
+        h.base = REGION_ADDRESS;
+        h.cells_at = align(sizeof(h) + roots.size() * sizeof(uint64_t));
+        h.ncells = cells.size();
+        h.constants = reinterpret_cast<uint64_t>(cell::NIL);
+        h.builtins = reinterpret_cast<uint64_t>(table);
+        h.nbuiltins = ntable;
+        size_t data_at = h.cells_at + cells.size() * sizeof(cell);
+        std::vector<uint64_t> root_addrs;
+        for(size_t i = 0; i < roots.size(); i++)
+          root_addrs.push_back(reinterpret_cast<uint64_t>(
+            snapshot_address(index, h.cells_at, roots[i])));
+        std::vector<char> bytes(cells.size() * sizeof(cell));
+        std::string data;
+        for(size_t i = 0; i < cells.size(); i++){
+          const cell *c = cells[i];
+          cell *copy = reinterpret_cast<cell *>(&bytes[i * sizeof(cell)]);
+          memcpy(static_cast<void *>(copy), c, sizeof(cell));
+          copy->flag_ &= ~(cell::T_MARK | cell::T_PRINT_BITS);
+          char *at = reinterpret_cast<char *>(REGION_ADDRESS + data_at
+                                              + data.size());
+          if(c->ispair()){
+            copy->object_.cons_.car_ =
+              snapshot_address(index, h.cells_at, c->car());
+            copy->object_.cons_.cdr_ =
+              snapshot_address(index, h.cells_at, c->cdr());
+          }else if(c->isstring() || c->issymbol() || c->issyntax()){
+            copy->object_.str_.str_ = at;
+            append_data(data, c->object_.str_.str_, c->object_.str_.len_ + 1);
+          }else if(c->isbignum()){
+            int size = c->limb_size();
+            copy->object_.big_.limbs_ = reinterpret_cast<unsigned int *>(at);
+            append_data(data, c->limbs(),
+                        (size < 0 ? -size : size) * sizeof(unsigned int));
+          }else if(c->iscontinuation() || c->isvector()){
+            copy->object_.vec_.data_ =
+              c->size() == 0 ? NULL : reinterpret_cast<cell **>(at);
+            for(size_t w = 0; w < c->size(); w++){
+              cell *word = snapshot_address(index, h.cells_at, c->data()[w]);
+              append_data(data, &word, sizeof(word));
+            }
+          }else if(c->isbytevector()){
+            copy->object_.bytes_.data_ =
+              c->size() == 0 ? NULL : reinterpret_cast<unsigned char *>(at);
+            append_data(data, c->bytes(), c->size());
+          }else if(c->istable()){
+            // the header and the entries in a row, see rebuild_table
+            hash_table t = *c->table();
+            t.used_ = t.count_;
+            copy->object_.table_ = reinterpret_cast<hash_table *>(at);
+            append_data(data, &t, sizeof(t));
+            cell **slot = c->table()->slots();
+            for(size_t i = 0; i < t.capacity(); i++, slot += 2){
+              if(slot[0] == NULL || slot[0] == hash_table::DELETED) continue;
+              for(int k = 0; k < 2; k++){
+                cell *word = snapshot_address(index, h.cells_at, slot[k]);
+                append_data(data, &word, sizeof(word));
+              }
+            }
+          }else if(c->isproc()){
+            if(c->object_.proc_ < table || c->object_.proc_ >= table + ntable)
+              throw std::logic_error("snapshot: can't save a registered procedure");
+          }else if(!c->isnumber() && !c->isopcode() && !c->isflonum()){
+            const char *what = c->isfuture() ? "future"
+              : c->ischannel() ? "channel" : "object";
+            throw std::logic_error(std::string("snapshot: can't save a ") + what);
+          }
+        }
+        h.size = data_at + data.size();
+        std::string header(reinterpret_cast<const char *>(&h), sizeof(h));
+        header.append(reinterpret_cast<const char *>(root_addrs.data()),
+                      root_addrs.size() * sizeof(uint64_t));
+        header.resize(h.cells_at, '\0');
+        FILE *fp = fopen(path, "wb");
+        if(fp == NULL)
+          throw std::logic_error(std::string("snapshot: can't write ") + path);
+        bool ok = fwrite(header.data(), 1, header.size(), fp) == header.size()
+          && fwrite(bytes.data(), 1, bytes.size(), fp) == bytes.size()
+          && fwrite(data.data(), 1, data.size(), fp) == data.size();
+        if(fclose(fp) != 0 || !ok)
+          throw std::logic_error(std::string("snapshot: can't write ") + path);
+      }
+
+      // Maps the heap snapshot at path as the immortal region and returns
+      // its roots.  Its symbols become the interned ones, so it has to be
+      // loaded before any symbol of the same name is made.  The hash
+      // tables in it go to tables, for the caller to rebuild.
+      std::vector<cell*> load_snapshot(const char *path,
+                                       const native_proc *table, size_t ntable,
+                                       std::vector<cell*> &tables){
+        if(region_begin_ != NULL)
+          throw std::logic_error("snapshot: one is loaded already");
+        int fd = open(path, O_RDONLY);
+        if(fd < 0)
+          throw std::logic_error(std::string("snapshot: can't open ") + path);
+        snapshot_header h;
+        struct stat st;
+        if(fstat(fd, &st) != 0 || pread(fd, &h, sizeof(h), 0) != sizeof(h)
+           || memcmp(h.magic, "PSHEAP\0\0", sizeof(h.magic)) != 0){
+          close(fd);
+          throw std::logic_error(std::string("snapshot: not a heap snapshot ") + path);
+        }
+        if(h.version != SNAPSHOT_VERSION || h.nbuiltins != ntable
+           || h.size != uint64_t(st.st_size)
+           || h.cells_at + h.ncells * sizeof(cell) > h.size
+           || sizeof(h) + h.nroots * sizeof(uint64_t) > h.cells_at){
+          close(fd);
+          throw std::logic_error("snapshot: made by another version");
+        }
+#ifdef MAP_FIXED_NOREPLACE
+        int fixed = MAP_FIXED_NOREPLACE;
+#else
+        int fixed = 0;
+#endif
+        void *map = mmap(reinterpret_cast<void *>(h.base), h.size,
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | fixed, fd, 0);
+        if(map == MAP_FAILED)
+          map = mmap(NULL, h.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(map == MAP_FAILED)
+          throw std::logic_error(std::string("snapshot: can't map ") + path);
+        char *base = static_cast<char *>(map);
+        ptrdiff_t delta = base - reinterpret_cast<char *>(h.base);
+        ptrdiff_t proc_delta = reinterpret_cast<const char *>(table)
+          - reinterpret_cast<const char *>(h.builtins);
+        cell *cells = reinterpret_cast<cell *>(base + h.cells_at);
+        std::vector<cell*> roots;
+        try{
+          // only the fields that differ are written; with the region at
+          // its base, that is the builtins alone
+          for(size_t i = 0; i < h.ncells; i++){
+            cell *c = cells + i;
+            if(c->ispair()){
+              relocate_cell(c->object_.cons_.car_, h, delta);
+              relocate_cell(c->object_.cons_.cdr_, h, delta);
+            }else if(c->isstring() || c->issymbol() || c->issyntax()){
+              relocate(c->object_.str_.str_, h, delta);
+              if(c->issymbol() && symbols_.count(c->str()) != 0)
+                throw std::logic_error(std::string("snapshot: symbol ")
+                                       + c->str() + " exists already");
+            }else if(c->isbignum()){
+              relocate(c->object_.big_.limbs_, h, delta);
+            }else if(c->iscontinuation() || c->isvector()){
+              if(c->size() == 0) continue;
+              relocate(c->object_.vec_.data_, h, delta);
+              for(size_t w = 0; w < c->size(); w++)
+                relocate_cell(c->data()[w], h, delta);
+            }else if(c->isbytevector()){
+              if(c->size() != 0) relocate(c->object_.bytes_.data_, h, delta);
+            }else if(c->istable()){
+              relocate(c->object_.table_, h, delta);
+              hash_table *t = c->table();
+              if(t->kind_ > hash_table::STRING || t->count_ > h.size
+                 || reinterpret_cast<char *>(t->slots() + 2 * t->count_)
+                    > base + h.size)
+                throw std::logic_error("snapshot: corrupt");
+              for(size_t w = 0; w < 2 * t->count_; w++)
+                relocate_cell(t->slots()[w], h, delta);
+              tables.push_back(c);
+            }else if(c->isproc()){
+              const native_proc *proc = reinterpret_cast<const native_proc *>(
+                reinterpret_cast<const char *>(c->object_.proc_) + proc_delta);
+              if(proc < table || proc >= table + ntable)
+                throw std::logic_error("snapshot: corrupt");
+              if(proc_delta != 0) c->object_.proc_ = proc;
+            }
+          }
+          for(uint32_t i = 0; i < h.nroots; i++){
+            cell *root;
+            memcpy(&root, base + sizeof(h) + i * sizeof(uint64_t), sizeof(root));
+            relocate_cell(root, h, delta);
+            roots.push_back(root);
+          }
+        }catch(...){
+          munmap(map, h.size);
+          throw;
+        }
+        for(size_t i = 0; i < h.ncells; i++){
+          if(cells[i].issymbol())
+            symbols_.insert(std::make_pair(std::string_view(cells[i].str()),
+                                           cells + i));
+        }
+        region_begin_ = base;
+        region_end_ = base + h.size;
+        return roots;
+      }
+
+      // no lock on the fast path: the free cells are the mutator's own
       cell *get_cell(){
-        cell *ret;
-        if((ret = search_cell()) != cell::NIL) return ret;
-        gc();
-        if((ret = search_cell()) != cell::NIL) return ret;
-        append_block();
-        ret = blocks_[block_siz_-1]->get_cell();
-        if(ret == cell::NIL) throw std::logic_error("Can't allocate memory");
+        mutator *m = current_;
+        cell *ret = m->free_cell_;
+        if(ret == cell::NIL) return refill(m);
+        m->free_cell_ = ret->next_freecell();
         return ret;
       }
 
+      // symbols are unique by name, so they compare with ==
+      cell *intern(const char *name){
+        {
+          std::lock_guard<std::mutex> hold(lock_);
+          std::unordered_map<std::string_view, cell*>::iterator it =
+            symbols_.find(name);
+          if(it != symbols_.end()) return it->second;
+        }
+        // allocating may stop for a collection, so not under the lock;
+        // another mutator may intern the same name meanwhile
+        cell *sym = get_cell()->init(cell::T_SYMBOL, name);
+        std::lock_guard<std::mutex> hold(lock_);
+        return symbols_.insert(std::make_pair(std::string_view(sym->str()),
+                                              sym)).first->second;
+      }
+
       cell *clone(cell *_cell){
-        if(_cell->ispair()){
+        if(_cell->issymbol()){
+          return _cell;
+        }else if(_cell->ispair()){
           return get_cell()->init(clone(_cell->car()),clone(_cell->cdr()));
         }else{
           return get_cell()->init(_cell);
         }
       }
 
-      void gc(){
-        jmp_buf registers;
-        setjmp(registers);
-        cell* end;
-        stack_end_ = &end;
-
+      // Returns the number of free cells after the collection.  Every
+      // mutator is stopped or outside, and lock_ is held.
+      size_t gc(){
+        for(size_t i = 0; i < mutators_.size(); i++){
+          mutator *m = mutators_[i];
+          // their free cells go back to the blocks with the sweep
+          allocated_ += retire_free_cells(m);
+          if(m->state_ != mutator::STOPPED) continue;
 #ifdef DEBUG
-        printf("stack top is %p, stack end is %p\n", stack_top_, stack_end_);
+          printf("stack top is %p, stack end is %p\n", m->stack_top_,
+                 m->stack_end_);
 #endif /* DEBUG */
-        for(int i = 0; i < block_siz_; i++){
-          blocks_[i]->mark_register(reinterpret_cast<cell **>(registers),
-                                    sizeof(registers) / sizeof(cell *));
-          blocks_[i]->mark_stack(stack_top_, stack_end_);
+          mark_words(reinterpret_cast<cell **>(m->registers_),
+                     reinterpret_cast<cell **>(m->registers_)
+                     + sizeof(m->registers_) / (sizeof(cell *)));
+          if(m->stack_top_ != NULL) mark_words(m->stack_top_, m->stack_end_);
+        }
+        for(size_t i = 0; i < roots_.size(); i++)
+          mark_cell(*roots_[i]);
+        std::unordered_map<std::string_view, cell*>::iterator sym;
+        for(sym = symbols_.begin(); sym != symbols_.end(); ++sym)
+          mark_cell(sym->second);
+        for(size_t i = 0; i < root_ranges_.size(); i++){
+          for(cell **p = *root_ranges_[i].first; p < *root_ranges_[i].second; p++)
+            mark_cell(*p);
+        }
+        std::unordered_set<cell*>::iterator rem;
+        for(rem = remembered_.begin(); rem != remembered_.end(); ++rem){
+          cell *c = *rem;
+          if(c->isvector()){
+            for(size_t i = 0; i < c->size(); i++) mark_cell(c->data()[i]);
+          }else if(c->istable()){
+            hash_table *t = c->table();
+            cell **slot = t->slots();
+            for(size_t i = 0; i < t->capacity(); i++, slot += 2){
+              if(slot[0] == NULL || slot[0] == hash_table::DELETED) continue;
+              mark_cell(slot[0]);
+              mark_cell(slot[1]);
+            }
+          }else{
+            mark_cell(c->car());
+            mark_cell(c->cdr());
+          }
         }
+        mark_ephemerons();
         // sweep
-        for(int i = 0; i < block_siz_; i++){
-          blocks_[i]->sweep();
+        size_t free_cells = 0;
+        for(size_t i = 0; i < blocks_.size(); i++){
+          large_bytes_ -= blocks_[i]->sweep();
+          free_cells += blocks_[i]->free_count_;
         }
+        large_limit_ = std::max(size_t(MIN_LARGE_LIMIT), 2 * large_bytes_);
+        cursor_ = 0;
+        return free_cells;
+      }
+    };
+
+    // keeps the cells in [begin, *end) alive while in scope
+    class scoped_root_range {
+      cell **begin_;
+      scoped_root_range(const scoped_root_range &);
+    public:
+      scoped_root_range(cell **begin, cell ***end) : begin_(begin) {
+        cell_manager::get_instance().add_root_range(&begin_, end);
+      }
+      ~scoped_root_range(){
+        cell_manager::get_instance().remove_root_range(&begin_);
+      }
+    };
+
+    // makes m the current mutator of this thread while in scope
+    class scoped_heap {
+      cell_manager::mutator *saved_;
+      scoped_heap(const scoped_heap &);
+    public:
+      explicit scoped_heap(cell_manager::mutator *m)
+        : saved_(cell_manager::current_) {
+        cell_manager::current_ = m;
+      }
+      ~scoped_heap(){
+        cell_manager::current_ = saved_;
       }
     };
 
-    cell cell::___NIL___;
-    cell cell::___T___;
-    cell cell::___F___;
-    cell* cell::NIL = &___NIL___;
-    cell* cell::T = &___T___;
-    cell* cell::F = &___F___;
-    void set_car(cell *c, cell *d){ c->car(d); }
-    void set_cdr(cell *c, cell *d){ c->cdr(d); }
+    const char *cell_manager::region_begin_ = NULL;
+    const char *cell_manager::region_end_ = NULL;
+    thread_local cell_manager::mutator *cell_manager::current_ = NULL;
+
+    // a mapped cell keeps what it owns in the snapshot
+    size_t cell::large_size() const {
+      if(cell_manager::isimmortal(this)) return 0;
+      if(isvector()) return object_.vec_.len_ * sizeof(cell *);
+      if(isbytevector()) return object_.bytes_.len_;
+      if(istable()) return hash_table::bytes(object_.table_->capacity());
+      return 0;
+    }
+
+    // (), #t and #f.  They go to the same fixed address in every process
+    // if it is free, so that a heap snapshot refers to them without
+    // relocation.
+    static cell *constant_cells(){
+      static cell fallback[3];
+      void *addr = reinterpret_cast<void *>(cell_manager::CONSTANTS_ADDRESS);
+#ifdef MAP_FIXED_NOREPLACE
+      int fixed = MAP_FIXED_NOREPLACE;
+#else
+      int fixed = 0;
+#endif
+      void *p = mmap(addr, sysconf(_SC_PAGESIZE), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | fixed, -1, 0);
+      if(p != addr){
+        if(p != MAP_FAILED) munmap(p, sysconf(_SC_PAGESIZE));
+        return fallback;
+      }
+      cell *cells = static_cast<cell *>(p);
+      for(int i = 0; i < 3; i++) new (cells + i) cell();
+      return cells;
+    }
+
+    cell* cell::NIL = constant_cells();
+    cell* cell::T = cell::NIL + 1;
+    cell* cell::F = cell::NIL + 2;
+    void set_car(cell *c, cell *d){
+      c->car(d);
+      cell_manager::write_barrier(c);
+    }
+    void set_cdr(cell *c, cell *d){
+      c->cdr(d);
+      cell_manager::write_barrier(c);
+    }
     cell* car(cell *c){ return c->car(); }
     cell* cdr(cell *c){ return c->cdr(); }
     cell* caar(cell *c){ return car(car(c)); }
@@ -440,6 +1624,20 @@ namespace PetitScheme {
     { return cell_manager::get_instance().get_cell()->init(a,b); }
     cell* list(cell *a)
     { return cons(a,cell::NIL); }
+
+    // a queue is a list and its last pair, which is stale once the list
+    // is ()
+    void enqueue(cell *&head, cell *&last, cell *x){
+      cell *pair = cons(x, cell::NIL);
+      if(head == cell::NIL) head = pair;
+      else set_cdr(last, pair);
+      last = pair;
+    }
+    cell* dequeue(cell *&head){
+      cell *x = car(head);
+      head = cdr(head);
+      return x;
+    }
     cell* list(cell *a, cell *b)
     { return cons(a,list(b)); }
     cell* list(cell *a, cell *b, cell *c)
@@ -449,29 +1647,52 @@ namespace PetitScheme {
     cell* list(cell *a, cell *b, cell *c, cell *d, cell *e)
     { return cons(a,list(b,c,d,e)); }
 
-    cell* mk_proc(cell* (*func)(cell *, cell *)){
-      return cell_manager::get_instance().get_cell()->init(func);
+    cell* mk_proc(const native_proc *proc){
+      return cell_manager::get_instance().get_cell()->init(proc);
     }
-    cell* mk_number(int arg){
+    cell* mk_stack_chunk(size_t capacity){
+      return cell_manager::get_instance().get_cell()
+        ->init(cell::T_CONTINUATION, capacity);
+    }
+    cell* mk_vector(size_t len, cell *fill){
+      cell_manager &heap = cell_manager::get_instance();
+      cell **data = static_cast<cell **>(heap.allocate_large(len * sizeof(cell *)));
+      std::fill(data, data + len, fill);
+      try {
+        return heap.get_cell()->init(data, len);
+      } catch(...) {
+        heap.free_large(data, len * sizeof(cell *));
+        throw;
+      }
+    }
+    cell* mk_bytevector(size_t len, unsigned char fill){
+      cell_manager &heap = cell_manager::get_instance();
+      unsigned char *data = static_cast<unsigned char *>(heap.allocate_large(len));
+      memset(data, fill, len);
+      try {
+        return heap.get_cell()->init(data, len);
+      } catch(...) {
+        heap.free_large(data, len);
+        throw;
+      }
+    }
+    cell* mk_number(long arg){
       return cell_manager::get_instance().get_cell()->init(cell::T_NUMBER, arg);
     }
+    cell* mk_flonum(double arg){
+      return cell_manager::get_instance().get_cell()->init(arg);
+    }
+    cell* mk_bignum(const unsigned int *limbs, int size){
+      return cell_manager::get_instance().get_cell()->init(limbs, size);
+    }
     cell* mk_opcode(int arg){
-      return cell_manager::get_instance().get_cell()->init(cell::T_OPCODE, arg);
+      return cell_manager::get_instance().get_cell()->init(cell::T_OPCODE, static_cast<long>(arg));
     }
     cell* mk_string(const char *arg){
       return cell_manager::get_instance().get_cell()->init(cell::T_STRING, arg);
     }
     cell* mk_symbol(const char *arg){
-      return cell_manager::get_instance().get_cell()->init(cell::T_SYMBOL, arg);
-    }
-    cell* mk_atom(const char *arg){
-      char *endptr;
-      int n = strtol(arg, &endptr, 0);
-      if(endptr != arg && *endptr == '\0'){
-        return mk_number(n);
-      }else{
-        return mk_symbol(arg);
-      }
+      return cell_manager::get_instance().intern(arg);
     }
     cell* nreverse(cell *c, bool isdot = false){
       cell *cur = c;
@@ -501,31 +1722,835 @@ namespace PetitScheme {
         return right;
       }
     }
+    // equal? for cells of the same type other than pairs and vectors
+    bool equal_atom(cell *left, cell *right){
+      if(left == right){
+        return true;
+      }else if(left->isunused() || left->iscontinuation() || left->istable()
+               || left->isfuture() || left->ischannel()){
+        // T, NIL and F, and objects with identity only
+        return false;
+      }else if(left->isproc()){
+        return left->proc() == right->proc();
+      }else if(left->isbytevector()){
+        return left->size() == right->size()
+          && memcmp(left->bytes(), right->bytes(), left->size()) == 0;
+      }else if(left->issymbol() || left->isstring() || left->issyntax()){
+        return left->length() == right->length()
+          && memcmp(left->str(), right->str(), left->length()) == 0;
+      }else if(left->isopcode() || left->isnumber()){
+        return left->ivalue() == right->ivalue();
+      }else if(left->isflonum()){
+        return left->fvalue() == right->fvalue();
+      }else if(left->isbignum()){
+        int size = left->limb_size();
+        return size == right->limb_size()
+          && memcmp(left->limbs(), right->limbs(),
+                    (size < 0 ? -size : size) * sizeof(unsigned int)) == 0;
+      }else{
+        throw std::logic_error("unknown type in equal comparision");
+      }
+    }
+
+    // Walks down cdrs in a loop and keeps the pairs of cars and vector
+    // elements still to compare on a stack of its own, so long and deep
+    // data don't overflow the C stack.  Shared substructure is skipped
+    // where both sides share it.  Cyclic data don't terminate.
     bool equal(cell *left, cell *right){
-      if(left->issametype(right)){
-        if(left->isunused()){
-          if(left == right) // T == T || NIL == NIL || F == F
-            return true;
-          else
-            return false;
-        }else if(left->ispair()){
-          return equal(car(left),car(right))
-            && equal(cdr(left),cdr(right));
-        }else if(left->isproc()){
-          return left->func() == right->func();
-        }else if(left->issymbol() || left->isstring() || left->issyntax()){
-          return strcmp(left->str(),right->str()) == 0;
-        }else if(left->isopcode() || left->isnumber()){
-          return left->ivalue() == right->ivalue();
+      std::vector<std::pair<cell *, cell *> > todo;
+      for(;;){
+        while(left != right){
+          if(!left->issametype(right)) return false;
+          if(left->ispair()){
+            cell *l = car(left), *r = car(right);
+            if(l->ispair() || l->isvector()) todo.push_back(std::make_pair(l, r));
+            else if(l != r && (!l->issametype(r) || !equal_atom(l, r))) return false;
+            left = cdr(left);
+            right = cdr(right);
+          }else if(left->isvector()){
+            if(left->size() != right->size()) return false;
+            for(size_t i = left->size(); i-- > 0;)
+              todo.push_back(std::make_pair(left->data()[i], right->data()[i]));
+            break;
+          }else{
+            if(!equal_atom(left, right)) return false;
+            break;
+          }
+        }
+        if(todo.empty()) return true;
+        left = todo.back().first;
+        right = todo.back().second;
+        todo.pop_back();
+      }
+    }
+
+    // a key no cell has
+    static char deleted_key;
+    cell *const hash_table::DELETED = reinterpret_cast<cell *>(&deleted_key);
+
+    // the finalizer of MurmurHash3, spreads addresses and small integers
+    inline uint64_t mix_hash(uint64_t x){
+      x ^= x >> 33;
+      x *= 0xff51afd7ed558ccdULL;
+      x ^= x >> 33;
+      x *= 0xc4ceb9fe1a85ec53ULL;
+      x ^= x >> 33;
+      return x;
+    }
+
+    // FNV-1a
+    uint64_t hash_bytes(const void *p, size_t len){
+      const unsigned char *b = static_cast<const unsigned char *>(p);
+      uint64_t h = 0xcbf29ce484222325ULL;
+      for(size_t i = 0; i < len; i++){
+        h ^= b[i];
+        h *= 0x100000001b3ULL;
+      }
+      return h;
+    }
+
+    // Cells are never moved by the collector, so a hash of the address
+    // stays valid as long as the cell lives.
+    uint64_t eq_hash(cell *c){
+      return mix_hash(reinterpret_cast<uintptr_t>(c));
+    }
+
+    // numbers by value, anything else by identity
+    bool eqv(cell *left, cell *right){
+      if(left == right) return true;
+      if(!left->issametype(right)) return false;
+      if(left->isnumber()) return left->fixnum() == right->fixnum();
+      if(left->isflonum()){
+        double l = left->fvalue(), r = right->fvalue();
+        return memcmp(&l, &r, sizeof(double)) == 0;
+      }
+      if(left->isbignum()) return equal(left, right);
+      return false;
+    }
+
+    uint64_t eqv_hash(cell *c){
+      if(c->isnumber()) return mix_hash(c->fixnum());
+      if(c->isflonum()){
+        double d = c->fvalue();
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        return mix_hash(bits);
+      }
+      if(c->isbignum()){
+        int size = c->limb_size();
+        return hash_bytes(c->limbs(), (size < 0 ? -size : size) * sizeof(unsigned int))
+          ^ (size < 0);
+      }
+      return eq_hash(c);
+    }
+
+    // Hashes the first EQUAL_HASH_LIMIT cells of c in a fixed order, so
+    // that long lists and cycles cost little and equal data hash alike.
+    const int EQUAL_HASH_LIMIT = 64;
+
+    uint64_t equal_hash(cell *c){
+      cell *todo[EQUAL_HASH_LIMIT];
+      int top = 0, budget = EQUAL_HASH_LIMIT;
+      uint64_t h = 0;
+      todo[top++] = c;
+      while(top > 0 && budget-- > 0){
+        c = todo[--top];
+        uint64_t x;
+        if(c->ispair()){
+          x = 1;
+          if(top < EQUAL_HASH_LIMIT) todo[top++] = c->cdr();
+          if(top < EQUAL_HASH_LIMIT) todo[top++] = c->car();
+        }else if(c->isvector()){
+          x = 2 + c->size();
+          for(size_t i = c->size(); i-- > 0 && top < EQUAL_HASH_LIMIT;)
+            todo[top++] = c->data()[i];
+        }else if(c->isstring() || c->issymbol() || c->issyntax()){
+          x = hash_bytes(c->str(), c->length());
+        }else if(c->isbytevector()){
+          x = hash_bytes(c->bytes(), c->size());
+        }else if(c->isflonum()){
+          // equal? has 0.0 and -0.0 the same
+          x = c->fvalue() == 0 ? 0 : eqv_hash(c);
+        }else if(c->isnumber() || c->isbignum()){
+          x = eqv_hash(c);
+        }else if(c->isopcode()){
+          x = mix_hash(c->ivalue());
+        }else if(c->isproc()){
+          x = mix_hash(reinterpret_cast<uintptr_t>(c->proc()));
         }else{
-          throw std::logic_error("unknown type in equal comparision");
+          x = eq_hash(c);
         }
+        h = mix_hash(h ^ x);
+      }
+      return h;
+    }
+
+    uint64_t table_hash(hash_table::KIND kind, cell *key){
+      switch(kind){
+      case hash_table::EQ: return eq_hash(key);
+      case hash_table::EQV: return eqv_hash(key);
+      case hash_table::EQUAL: return equal_hash(key);
+      case hash_table::STRING: return hash_bytes(key->str(), key->length());
+      }
+      return 0;
+    }
+
+    bool table_match(hash_table::KIND kind, cell *left, cell *right){
+      switch(kind){
+      case hash_table::EQ: return left == right;
+      case hash_table::EQV: return eqv(left, right);
+      case hash_table::EQUAL: return left == right || equal(left, right);
+      case hash_table::STRING:
+        return left->length() == right->length()
+          && memcmp(left->str(), right->str(), left->length()) == 0;
       }
       return false;
     }
+
+    // the slot of key in t, or else the slot it would go to
+    cell **table_slot(hash_table *t, cell *key){
+      cell **reuse = NULL;
+      for(size_t i = table_hash(t->kind_, key) & t->mask_;; i = (i + 1) & t->mask_){
+        cell **slot = t->slots() + 2 * i;
+        if(slot[0] == NULL) return reuse != NULL ? reuse : slot;
+        if(slot[0] == hash_table::DELETED){
+          if(reuse == NULL) reuse = slot;
+        }else if(table_match(t->kind_, slot[0], key)){
+          return slot;
+        }
+      }
+    }
+
+    hash_table *new_table(hash_table::KIND kind, size_t capacity){
+      hash_table *t = static_cast<hash_table *>(
+        cell_manager::get_instance().allocate_large(hash_table::bytes(capacity)));
+      t->kind_ = kind;
+      t->count_ = 0;
+      t->used_ = 0;
+      t->mask_ = capacity - 1;
+      std::fill(t->slots(), t->slots() + 2 * capacity, static_cast<cell *>(NULL));
+      return t;
+    }
+
+    cell* mk_table(hash_table::KIND kind){
+      hash_table *t = new_table(kind, 8);
+      try {
+        return cell_manager::get_instance().get_cell()->init(t);
+      } catch(...) {
+        cell_manager::get_instance().free_large(t, hash_table::bytes(8));
+        throw;
+      }
+    }
+
+    // a pending future, see struct future
+    cell* mk_future(cell *proc, cell *items, long count){
+      future *f = new future(proc, items, count, cell::NIL);
+      try {
+        return cell_manager::get_instance().get_cell()->init(f);
+      } catch(...) {
+        delete f;
+        throw;
+      }
+    }
+
+    // an empty channel of the VM owner
+    cell* mk_channel(size_t capacity, const void *owner){
+      channel *ch = new channel(capacity, owner, cell::NIL);
+      try {
+        return cell_manager::get_instance().get_cell()->init(ch);
+      } catch(...) {
+        delete ch;
+        throw;
+      }
+    }
+
+    // Keeps at most three quarters of the slots of the table of c in
+    // use after one more entry.  The table is rebuilt without its
+    // deleted slots, twice as big if at least half of them are entries.
+    void table_reserve(cell *c){
+      hash_table *t = c->table();
+      if((t->used_ + 1) * 4 <= t->capacity() * 3) return;
+      size_t capacity = t->capacity();
+      while((t->count_ + 1) * 2 > capacity) capacity *= 2;
+      hash_table *n = new_table(t->kind_, capacity);
+      cell **slot = t->slots();
+      for(size_t i = 0; i < t->capacity(); i++, slot += 2){
+        if(slot[0] == NULL || slot[0] == hash_table::DELETED) continue;
+        cell **to = table_slot(n, slot[0]);
+        to[0] = slot[0];
+        to[1] = slot[1];
+      }
+      n->count_ = n->used_ = t->count_;
+      c->table(n);
+      cell_manager::get_instance().free_large(t, hash_table::bytes(t->capacity()));
+    }
+
+    // A table mapped from a heap snapshot holds count_ entries in a row.
+    // Its keys may hash by address, so they go to a new table in the
+    // heap, which the remembered cell keeps alive.
+    void rebuild_table(cell *c){
+      hash_table *t = c->table();
+      size_t capacity = 8;
+      while(t->count_ * 2 > capacity) capacity *= 2;
+      hash_table *n = new_table(t->kind_, capacity);
+      cell **entry = t->slots();
+      for(size_t i = 0; i < t->count_; i++, entry += 2){
+        cell **to = table_slot(n, entry[0]);
+        to[0] = entry[0];
+        to[1] = entry[1];
+      }
+      n->count_ = n->used_ = t->count_;
+      c->table(n);
+      cell_manager::write_barrier(c);
+    }
+
+    // NULL if key is not in the table c
+    cell* table_ref(cell *c, cell *key){
+      cell **slot = table_slot(c->table(), key);
+      return slot[0] == NULL || slot[0] == hash_table::DELETED ? NULL : slot[1];
+    }
+
+    void table_set(cell *c, cell *key, cell *value){
+      table_reserve(c);
+      hash_table *t = c->table();
+      cell **slot = table_slot(t, key);
+      if(slot[0] == NULL || slot[0] == hash_table::DELETED){
+        if(slot[0] == NULL) t->used_++;
+        t->count_++;
+        slot[0] = key;
+      }
+      slot[1] = value;
+    }
+
+    void table_delete(cell *c, cell *key){
+      hash_table *t = c->table();
+      cell **slot = table_slot(t, key);
+      if(slot[0] == NULL || slot[0] == hash_table::DELETED) return;
+      slot[0] = hash_table::DELETED;
+      slot[1] = NULL;
+      t->count_--;
+    }
   }
 
   typedef Base::cell* obj;
+
+  // Numeric tower: fixnum (long) -> bignum -> flonum.  The fixnum only
+  // case of every operation is inline and uses the overflow builtins, so
+  // promotion costs nothing until it happens.  There are no rationals;
+  // an inexact division result becomes a flonum.
+  namespace Number {
+    using Base::cell;
+
+    typedef unsigned int limb;
+    typedef unsigned long long dlimb;
+    typedef std::vector<limb> digits;
+
+    // below this many limbs schoolbook multiplication is faster
+    const size_t KARATSUBA_THRESHOLD = 32;
+
+    // sign-magnitude exact integer used by the slow paths
+    struct integer {
+      digits mag;
+      bool neg;
+      integer() : neg(false) {}
+    };
+
+    void trim(digits &a){
+      while(!a.empty() && a.back() == 0) a.pop_back();
+    }
+
+    int cmp_mag(const digits &a, const digits &b){
+      if(a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+      for(size_t i = a.size(); i-- > 0;){
+        if(a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+      }
+      return 0;
+    }
+
+    digits add_mag(const digits &a, const digits &b){
+      const digits &l = a.size() >= b.size() ? a : b;
+      const digits &s = a.size() >= b.size() ? b : a;
+      digits r(l.size() + 1);
+      dlimb carry = 0;
+      for(size_t i = 0; i < l.size(); i++){
+        dlimb t = carry + l[i] + (i < s.size() ? s[i] : 0);
+        r[i] = static_cast<limb>(t);
+        carry = t >> 32;
+      }
+      r[l.size()] = static_cast<limb>(carry);
+      trim(r);
+      return r;
+    }
+
+    // requires a >= b
+    digits sub_mag(const digits &a, const digits &b){
+      digits r(a.size());
+      long long borrow = 0;
+      for(size_t i = 0; i < a.size(); i++){
+        long long t = static_cast<long long>(a[i])
+          - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = t < 0;
+        r[i] = static_cast<limb>(t);
+      }
+      trim(r);
+      return r;
+    }
+
+    // r += x << (32 * offset)
+    void add_at(digits &r, const digits &x, size_t offset){
+      if(r.size() < x.size() + offset + 1) r.resize(x.size() + offset + 1);
+      dlimb carry = 0;
+      size_t i = 0;
+      for(; i < x.size(); i++){
+        dlimb t = carry + r[i + offset] + x[i];
+        r[i + offset] = static_cast<limb>(t);
+        carry = t >> 32;
+      }
+      for(i += offset; carry != 0; i++){
+        if(i == r.size()) r.push_back(0);
+        dlimb t = carry + r[i];
+        r[i] = static_cast<limb>(t);
+        carry = t >> 32;
+      }
+    }
+
+    digits mul_school(const digits &a, const digits &b){
+      digits r(a.size() + b.size());
+      for(size_t i = 0; i < a.size(); i++){
+        dlimb carry = 0;
+        for(size_t j = 0; j < b.size(); j++){
+          dlimb t = static_cast<dlimb>(a[i]) * b[j] + r[i + j] + carry;
+          r[i + j] = static_cast<limb>(t);
+          carry = t >> 32;
+        }
+        r[i + b.size()] = static_cast<limb>(carry);
+      }
+      trim(r);
+      return r;
+    }
+
+    digits mul_mag(const digits &a, const digits &b){
+      if(a.empty() || b.empty()) return digits();
+      if(a.size() < KARATSUBA_THRESHOLD || b.size() < KARATSUBA_THRESHOLD)
+        return mul_school(a, b);
+      // a = a1 B^m + a0, b = b1 B^m + b0
+      size_t m = std::max(a.size(), b.size()) / 2;
+      digits a0(a.begin(), a.begin() + std::min(m, a.size()));
+      digits a1(a.begin() + std::min(m, a.size()), a.end());
+      digits b0(b.begin(), b.begin() + std::min(m, b.size()));
+      digits b1(b.begin() + std::min(m, b.size()), b.end());
+      trim(a0); trim(b0);
+      digits z0 = mul_mag(a0, b0);
+      digits z2 = mul_mag(a1, b1);
+      digits z1 = mul_mag(add_mag(a0, a1), add_mag(b0, b1));
+      z1 = sub_mag(sub_mag(z1, z0), z2);
+      digits r(z0);
+      add_at(r, z1, m);
+      add_at(r, z2, 2 * m);
+      trim(r);
+      return r;
+    }
+
+    // a = a * m + add
+    void mul_small(digits &a, limb m, limb add){
+      dlimb carry = add;
+      for(size_t i = 0; i < a.size(); i++){
+        dlimb t = static_cast<dlimb>(a[i]) * m + carry;
+        a[i] = static_cast<limb>(t);
+        carry = t >> 32;
+      }
+      if(carry != 0) a.push_back(static_cast<limb>(carry));
+    }
+
+    // a = a / d, returns a % d
+    limb divmod_small(digits &a, limb d){
+      dlimb rem = 0;
+      for(size_t i = a.size(); i-- > 0;){
+        dlimb t = (rem << 32) | a[i];
+        a[i] = static_cast<limb>(t / d);
+        rem = t % d;
+      }
+      trim(a);
+      return static_cast<limb>(rem);
+    }
+
+    // Knuth's algorithm D (TAOCP 4.3.1), following Hacker's Delight divmnu
+    void divmod_mag(const digits &u, const digits &v, digits &q, digits &r){
+      if(cmp_mag(u, v) < 0){
+        q.clear();
+        r = u;
+        return;
+      }
+      if(v.size() == 1){
+        q = u;
+        r.assign(1, divmod_small(q, v[0]));
+        trim(r);
+        return;
+      }
+      size_t n = v.size(), m = u.size() - n;
+      int s = __builtin_clz(v.back());
+      digits vn(n), un(u.size() + 1);
+      for(size_t i = n - 1; i > 0; i--)
+        vn[i] = (v[i] << s) | (s ? static_cast<limb>(static_cast<dlimb>(v[i-1]) >> (32 - s)) : 0);
+      vn[0] = v[0] << s;
+      un[u.size()] = s ? static_cast<limb>(static_cast<dlimb>(u.back()) >> (32 - s)) : 0;
+      for(size_t i = u.size() - 1; i > 0; i--)
+        un[i] = (u[i] << s) | (s ? static_cast<limb>(static_cast<dlimb>(u[i-1]) >> (32 - s)) : 0);
+      un[0] = u[0] << s;
+
+      const dlimb base = 1ULL << 32;
+      q.assign(m + 1, 0);
+      for(size_t j = m + 1; j-- > 0;){
+        dlimb num = (static_cast<dlimb>(un[j+n]) << 32) | un[j+n-1];
+        dlimb qhat = num / vn[n-1];
+        dlimb rhat = num % vn[n-1];
+        while(qhat >= base
+              || qhat * vn[n-2] > ((rhat << 32) | un[j+n-2])){
+          qhat--;
+          rhat += vn[n-1];
+          if(rhat >= base) break;
+        }
+        long long k = 0, t;
+        for(size_t i = 0; i < n; i++){
+          dlimb p = qhat * vn[i];
+          t = static_cast<long long>(un[i+j]) - k
+            - static_cast<long long>(p & 0xFFFFFFFFULL);
+          un[i+j] = static_cast<limb>(t);
+          k = static_cast<long long>(p >> 32) - (t >> 32);
+        }
+        t = static_cast<long long>(un[j+n]) - k;
+        un[j+n] = static_cast<limb>(t);
+        q[j] = static_cast<limb>(qhat);
+        if(t < 0){
+          q[j]--;
+          dlimb c = 0;
+          for(size_t i = 0; i < n; i++){
+            dlimb t2 = static_cast<dlimb>(un[i+j]) + vn[i] + c;
+            un[i+j] = static_cast<limb>(t2);
+            c = t2 >> 32;
+          }
+          un[j+n] += static_cast<limb>(c);
+        }
+      }
+      r.assign(n, 0);
+      for(size_t i = 0; i < n; i++)
+        r[i] = (un[i] >> s) | (s ? static_cast<limb>(static_cast<dlimb>(un[i+1]) << (32 - s)) : 0);
+      trim(q);
+      trim(r);
+    }
+
+    integer to_integer(long n){
+      integer r;
+      r.neg = n < 0;
+      unsigned long mag = r.neg ? 0UL - static_cast<unsigned long>(n) : n;
+      while(mag != 0){
+        r.mag.push_back(static_cast<limb>(mag));
+        mag >>= 32;
+      }
+      return r;
+    }
+
+    integer to_integer(cell *c){
+      if(c->isnumber()) return to_integer(c->fixnum());
+      integer r;
+      int size = c->limb_size();
+      r.neg = size < 0;
+      r.mag.assign(c->limbs(), c->limbs() + (size < 0 ? -size : size));
+      return r;
+    }
+
+    // normalises to a fixnum whenever the value fits
+    cell *mk_integer(const integer &n){
+      if(n.mag.size() <= 2){
+        unsigned long mag = 0;
+        for(size_t i = n.mag.size(); i-- > 0;)
+          mag = (mag << 32) | n.mag[i];
+        if(!n.neg && mag <= static_cast<unsigned long>(LONG_MAX))
+          return Base::mk_number(static_cast<long>(mag));
+        if(n.neg && mag <= static_cast<unsigned long>(LONG_MAX) + 1)
+          return Base::mk_number(static_cast<long>(0UL - mag));
+      }
+      int size = static_cast<int>(n.mag.size());
+      return Base::mk_bignum(n.mag.data(), n.neg ? -size : size);
+    }
+
+    integer add(const integer &a, const integer &b){
+      integer r;
+      if(a.neg == b.neg){
+        r.mag = add_mag(a.mag, b.mag);
+        r.neg = a.neg;
+      }else if(cmp_mag(a.mag, b.mag) >= 0){
+        r.mag = sub_mag(a.mag, b.mag);
+        r.neg = a.neg;
+      }else{
+        r.mag = sub_mag(b.mag, a.mag);
+        r.neg = b.neg;
+      }
+      if(r.mag.empty()) r.neg = false;
+      return r;
+    }
+
+    integer negate(integer a){
+      if(!a.mag.empty()) a.neg = !a.neg;
+      return a;
+    }
+
+    integer mul(const integer &a, const integer &b){
+      integer r;
+      r.mag = mul_mag(a.mag, b.mag);
+      r.neg = !r.mag.empty() && a.neg != b.neg;
+      return r;
+    }
+
+    // truncating division
+    void divmod(const integer &a, const integer &b, integer &q, integer &r){
+      if(b.mag.empty()) throw std::logic_error("Division by zero");
+      divmod_mag(a.mag, b.mag, q.mag, r.mag);
+      q.neg = !q.mag.empty() && a.neg != b.neg;
+      r.neg = !r.mag.empty() && a.neg;
+    }
+
+    int compare(const integer &a, const integer &b){
+      if(a.neg != b.neg) return a.neg ? -1 : 1;
+      int c = cmp_mag(a.mag, b.mag);
+      return a.neg ? -c : c;
+    }
+
+    std::string to_string(const integer &n){
+      if(n.mag.empty()) return "0";
+      digits mag(n.mag);
+      std::string ret;
+      while(!mag.empty()){
+        limb chunk = divmod_small(mag, 1000000000);
+        for(int i = 0; i < 9 && (chunk != 0 || !mag.empty()); i++){
+          ret += static_cast<char>('0' + chunk % 10);
+          chunk /= 10;
+        }
+      }
+      if(n.neg) ret += '-';
+      std::reverse(ret.begin(), ret.end());
+      return ret;
+    }
+
+    // decimal digits with an optional sign
+    bool parse(const char *str, integer &n){
+      const char *p = str;
+      n = integer();
+      if(*p == '+' || *p == '-') n.neg = *p++ == '-';
+      if(*p == '\0') return false;
+      for(; *p != '\0'; p++){
+        if(*p < '0' || *p > '9') return false;
+        mul_small(n.mag, 10, *p - '0');
+      }
+      trim(n.mag);
+      if(n.mag.empty()) n.neg = false;
+      return true;
+    }
+
+    double to_double(const integer &n){
+      double r = 0;
+      for(size_t i = n.mag.size(); i-- > 0;)
+        r = r * 4294967296.0 + n.mag[i];
+      return n.neg ? -r : r;
+    }
+
+    // d must be finite and integral
+    integer from_double(double d){
+      integer r;
+      r.neg = d < 0;
+      int exp;
+      double frac = std::frexp(std::fabs(d), &exp);
+      if(exp <= 0) return integer();
+      // d = m * 2^(exp - 53) with a 53 bit m
+      unsigned long long m = static_cast<unsigned long long>(std::ldexp(frac, 53));
+      int shift = exp - 53;
+      if(shift < 0) m >>= -shift;
+      r.mag.push_back(static_cast<limb>(m));
+      r.mag.push_back(static_cast<limb>(m >> 32));
+      if(shift > 0){
+        r.mag.insert(r.mag.begin(), shift / 32, 0);
+        mul_small(r.mag, 1U << (shift % 32), 0);
+      }
+      trim(r.mag);
+      if(r.mag.empty()) r.neg = false;
+      return r;
+    }
+
+    bool isnumeric(cell *c){
+      return c->isnumber() || c->isflonum() || c->isbignum();
+    }
+
+    cell *check(cell *c){
+      if(!isnumeric(c)) throw std::logic_error("Not a number");
+      return c;
+    }
+
+    double to_double(cell *c){
+      if(c->isnumber()) return static_cast<double>(c->fixnum());
+      if(c->isflonum()) return c->fvalue();
+      return to_double(to_integer(check(c)));
+    }
+
+    cell *add_slow(cell *a, cell *b){
+      if(check(a)->isflonum() || check(b)->isflonum())
+        return Base::mk_flonum(to_double(a) + to_double(b));
+      return mk_integer(add(to_integer(a), to_integer(b)));
+    }
+
+    cell *sub_slow(cell *a, cell *b){
+      if(check(a)->isflonum() || check(b)->isflonum())
+        return Base::mk_flonum(to_double(a) - to_double(b));
+      return mk_integer(add(to_integer(a), negate(to_integer(b))));
+    }
+
+    cell *mul_slow(cell *a, cell *b){
+      if(check(a)->isflonum() || check(b)->isflonum())
+        return Base::mk_flonum(to_double(a) * to_double(b));
+      return mk_integer(mul(to_integer(a), to_integer(b)));
+    }
+
+    cell *div_slow(cell *a, cell *b){
+      if(check(a)->isflonum() || check(b)->isflonum())
+        return Base::mk_flonum(to_double(a) / to_double(b));
+      integer q, r;
+      divmod(to_integer(a), to_integer(b), q, r);
+      if(r.mag.empty()) return mk_integer(q);
+      return Base::mk_flonum(to_double(a) / to_double(b));
+    }
+
+    // what compare returns when either is a NaN
+    const int UNORDERED = 2;
+
+    int compare_slow(cell *a, cell *b){
+      if(check(a)->isflonum() || check(b)->isflonum()){
+        double x = to_double(a), y = to_double(b);
+        if(x < y) return -1;
+        if(x > y) return 1;
+        return x == y ? 0 : UNORDERED;
+      }
+      return compare(to_integer(a), to_integer(b));
+    }
+
+    inline bool both_fixnum(cell *a, cell *b){
+      return a->isnumber() & b->isnumber();
+    }
+
+    inline cell *add(cell *a, cell *b){
+      long r;
+      if(both_fixnum(a, b)
+         && !__builtin_add_overflow(a->fixnum(), b->fixnum(), &r))
+        return Base::mk_number(r);
+      return add_slow(a, b);
+    }
+
+    inline cell *sub(cell *a, cell *b){
+      long r;
+      if(both_fixnum(a, b)
+         && !__builtin_sub_overflow(a->fixnum(), b->fixnum(), &r))
+        return Base::mk_number(r);
+      return sub_slow(a, b);
+    }
+
+    inline cell *mul(cell *a, cell *b){
+      long r;
+      if(both_fixnum(a, b)
+         && !__builtin_mul_overflow(a->fixnum(), b->fixnum(), &r))
+        return Base::mk_number(r);
+      return mul_slow(a, b);
+    }
+
+    inline cell *div(cell *a, cell *b){
+      if(both_fixnum(a, b)){
+        long x = a->fixnum(), y = b->fixnum();
+        if(y != 0 && !(y == -1 && x == LONG_MIN) && x % y == 0)
+          return Base::mk_number(x / y);
+      }
+      return div_slow(a, b);
+    }
+
+    inline int compare(cell *a, cell *b){
+      if(both_fixnum(a, b)){
+        long x = a->fixnum(), y = b->fixnum();
+        return (x > y) - (x < y);
+      }
+      return compare_slow(a, b);
+    }
+
+    enum DIV_OP { DIV_QUOTIENT, DIV_REMAINDER, DIV_MODULO };
+
+    cell *integer_divide(cell *a, cell *b, DIV_OP op){
+      if(both_fixnum(a, b)){
+        long x = a->fixnum(), y = b->fixnum();
+        if(y == 0) throw std::logic_error("Division by zero");
+        if(!(y == -1 && x == LONG_MIN)){
+          long r = x % y;
+          if(op == DIV_QUOTIENT) return Base::mk_number(x / y);
+          if(op == DIV_MODULO && r != 0 && ((r < 0) != (y < 0))) r += y;
+          return Base::mk_number(r);
+        }
+      }
+      if(check(a)->isflonum() || check(b)->isflonum()){
+        double x = to_double(a), y = to_double(b);
+        if(op == DIV_QUOTIENT) return Base::mk_flonum(std::trunc(x / y));
+        double r = std::fmod(x, y);
+        if(op == DIV_MODULO && r != 0 && ((r < 0) != (y < 0))) r += y;
+        return Base::mk_flonum(r);
+      }
+      integer q, r;
+      integer y = to_integer(b);
+      divmod(to_integer(a), y, q, r);
+      if(op == DIV_QUOTIENT) return mk_integer(q);
+      if(op == DIV_MODULO && !r.mag.empty() && r.neg != y.neg)
+        r = add(r, y);
+      return mk_integer(r);
+    }
+
+    cell *to_inexact(cell *c){
+      if(check(c)->isflonum()) return c;
+      return Base::mk_flonum(to_double(c));
+    }
+
+    cell *to_exact(cell *c){
+      if(!check(c)->isflonum()) return c;
+      double d = c->fvalue();
+      if(!std::isfinite(d) || d != std::floor(d))
+        throw std::logic_error("No exact representation");
+      return mk_integer(from_double(d));
+    }
+
+    // fixnum, bignum (decimal) or flonum literal; NULL if str is not a number
+    cell *parse_number(const char *str){
+      const char *p = str;
+      if(*p == '+' || *p == '-') p++;
+      if(*p == '.') p++;
+      if(*p < '0' || *p > '9') return NULL;  // symbols like + ... -> inf
+
+      char *endptr;
+      errno = 0;
+      long n = strtol(str, &endptr, 10);
+      if(*endptr == '\0'){
+        if(errno != ERANGE) return Base::mk_number(n);
+        integer big;
+        if(parse(str, big)) return mk_integer(big);
+        return NULL;
+      }
+      // strtod takes hex too
+      if(strpbrk(str, "xX") != NULL) return NULL;
+      double d = strtod(str, &endptr);
+      if(*endptr == '\0') return Base::mk_flonum(d);
+      return NULL;
+    }
+  }
+
+  namespace Base {
+    cell* mk_atom(const char *arg){
+      cell *num = Number::parse_number(arg);
+      if(num != NULL)
+        return num;
+      else
+        return mk_symbol(arg);
+    }
+  }
 }
 
 
@@ -566,15 +2591,15 @@ namespace PetitScheme
       }
       Token(TOKEN_TYPE type, const char * arg,
             size_t offset, size_t len) : type_(type) {
-        char *str = new char[len];
+        char *str = new char[len + 1];
         strncpy(str, arg + offset, len);
         str[len] = '\0';
         token_str_ = str;
       }
       Token(const Token &tok) : type_(tok.type_) {
         size_t len = strlen(tok.token_str_);
-        char *str = new char[len];
-        strncpy(str, tok.token_str_, len);
+        char *str = new char[len + 1];
+        strcpy(str, tok.token_str_);
         token_str_ = str;
       }
 
@@ -583,8 +2608,8 @@ namespace PetitScheme
         type_ = tok.type_;
         delete[] token_str_;
         size_t len = strlen(tok.token_str_);
-        char *str = new char[len];
-        strncpy(str, tok.token_str_, len);
+        char *str = new char[len + 1];
+        strcpy(str, tok.token_str_);
         token_str_ = str;
         return *this;
       }
@@ -594,9 +2619,74 @@ namespace PetitScheme
       }
     };
 
+    // Where the lists a Parser reads begin, kept beside the heap rather
+    // than in the cells, along with the instructions the compiler made
+    // from them.  A location packs the file, line and column in a word,
+    // 0 for none.  Entries go with their cells.  The VMs sharing the map
+    // may use it at once, so each use takes lock.
+    class source_map {
+      std::mutex &lock_;
+      std::vector<std::string> files_;
+      Base::cell_manager::weak_table table_;
+      source_map(const source_map &);
+
+    public:
+      explicit source_map(std::mutex &lock) : lock_(lock) {
+        Base::cell_manager::get_instance().add_weak_table(&table_);
+      }
+      ~source_map(){
+        Base::cell_manager::get_instance().remove_weak_table(&table_);
+      }
+
+      static uint64_t location(unsigned file, unsigned line, unsigned column){
+        return static_cast<uint64_t>(file) << 48
+          | static_cast<uint64_t>(line) << 16 | std::min(column, 0xffffu);
+      }
+
+      unsigned file(const std::string &name){
+        std::lock_guard<std::mutex> hold(lock_);
+        for(size_t i = 0; i < files_.size(); i++)
+          if(files_[i] == name) return i;
+        files_.push_back(name);
+        return files_.size() - 1;
+      }
+
+      // the first location given for c stays
+      void note(Base::cell *c, uint64_t loc){
+        if(loc == 0) return;
+        std::lock_guard<std::mutex> hold(lock_);
+        table_.emplace(c, loc);
+      }
+
+      // c is now where loc is, or nowhere if loc is 0
+      void move(Base::cell *c, uint64_t loc){
+        std::lock_guard<std::mutex> hold(lock_);
+        if(loc != 0) table_[c] = loc;
+        else table_.erase(c);
+      }
+
+      uint64_t find(Base::cell *c) const {
+        std::lock_guard<std::mutex> hold(lock_);
+        Base::cell_manager::weak_table::const_iterator it = table_.find(c);
+        return it == table_.end() ? 0 : it->second;
+      }
+
+      // file:line:column
+      std::string describe(uint64_t loc) const {
+        std::lock_guard<std::mutex> hold(lock_);
+        return files_[loc >> 48] + ":"
+          + std::to_string((loc >> 16) & 0xffffffff) + ":"
+          + std::to_string(loc & 0xffff);
+      }
+    };
+
+
     class Tokenizer {
       size_t index_, size_;
       const char *current_;
+      // the start of the last token, and how far lines are counted
+      size_t start_, counted_;
+      unsigned line_, line_start_;
 
       bool isdelim(char c, const char *delim){
         size_t len = strlen(delim);
@@ -617,24 +2707,55 @@ namespace PetitScheme
       }
 
     public:
-      Tokenizer(const char *str, size_t size)
-        : index_(0), size_(size), current_(str) {}
+      Tokenizer(const char *str, size_t size, unsigned line = 1)
+        : index_(0), size_(size), current_(str), start_(0), counted_(0),
+          line_(line), line_start_(0) {}
 
-      Token readstrexp(){
-        size_t offset = index_;
+      // true if the next character, right after the last token, is c
+      bool follows(char c) const {
+        return index_ < size_ && current_[index_] == c;
+      }
+
+      // line and column of the last token, both from 1
+      void position(unsigned &line, unsigned &column){
+        for(; counted_ < start_; counted_++){
+          if(current_[counted_] == '\n'){
+            line_++;
+            line_start_ = counted_ + 1;
+          }
+        }
+        line = line_;
+        column = start_ - line_start_ + 1;
+      }
 
-        while(index_ < size_
-              && current_[index_] != '"'
-              && current_[index_-1] != '\\') index_++ ;
-        int pos = index_ != size_ ? index_ : -1;
-        if(pos == -1)
+      Token readstrexp(){
+        std::string str;
+        while(index_ < size_ && current_[index_] != '"'){
+          char c = current_[index_++];
+          if(c == '\\' && index_ < size_){
+            c = current_[index_++];
+            switch(c){
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case 'a': c = '\a'; break;
+            default: break; // \\ and \" stand for themselves
+            }
+          }
+          str += c;
+        }
+        if(index_ >= size_)
           return Token(TOK_FAIL, '\0');
+        index_++; // closing quote
 
-        return Token(TOK_STR, current_, offset, index_ - offset);
+        return Token(TOK_STR, str.c_str(), 0, str.size());
       }
 
       Token next(){
         skipspace();
+        start_ = index_;
+        if(index_ >= size_)
+          return Token(TOK_EOF, '\0');
 
         size_t offset;
         switch (current_[index_++]){
@@ -674,30 +2795,80 @@ namespace PetitScheme
 
     class Parser {
       Tokenizer tokenizer;
+      source_map *sources_;
+      unsigned file_;
+      // inside a quoted datum, whose lists are not code
+      int quoted_;
+      // sentinels returned by parse_atom for ')' and '.'
+      Base::cell rparen_, rdot_;
       Base::cell *rparen, *rdot;
 
       //いつか再帰をなくす予定
       Base::cell *parse_list(){
         obj c, code = Base::cell::NIL;
+        int quoted = quoted_;
         while((c = parse_atom()) != rparen){
+          if(c == NULL)
+            throw std::logic_error("Can't parse sexpression!");
           if(c == rdot){ //DOT LIST
             c = parse_atom();
             if(c == rparen || parse_atom() != rparen)
               throw std::logic_error("Can't parse sexpression!");
 
             code = cons(c, code);
+            quoted_ = quoted;
             return nreverse(code, true);
           }
+          // (quote datum) as 'datum
+          if(code == Base::cell::NIL && c->issymbol()
+             && strcmp(c->str(), "quote") == 0)
+            quoted_++;
           code = cons(c, code);
         }
+        quoted_ = quoted;
         return nreverse(code);
       }
 
+      // #(...) and #u8(...), after the '#' token; their elements are
+      // data like those of a quoted list
+      Base::cell *parse_vector(bool bytes){
+        tokenizer.next(); // '('
+        quoted_++;
+        obj elems = parse_list();
+        quoted_--;
+        size_t len = 0;
+        obj p = elems;
+        for(; p->ispair(); p = cdr(p)) len++;
+        if(p != Base::cell::NIL)
+          throw std::logic_error("Can't parse sexpression!");
+        obj v = bytes ? Base::mk_bytevector(len, 0)
+                      : Base::mk_vector(len, Base::cell::NIL);
+        for(size_t i = 0; i < len; i++, elems = cdr(elems)){
+          obj e = car(elems);
+          if(!bytes){
+            v->data()[i] = e;
+          }else if(e->isnumber() && e->fixnum() >= 0 && e->fixnum() <= 255){
+            v->bytes()[i] = static_cast<unsigned char>(e->fixnum());
+          }else{
+            throw std::logic_error("Can't parse bytevector literal!");
+          }
+        }
+        return v;
+      }
+
       Base::cell *parse_atom(){
         Token tok = tokenizer.next();
 
         switch(tok.type()){
         case TOK_LPAREN:
+          if(sources_ != NULL && quoted_ == 0){
+            unsigned line, column;
+            tokenizer.position(line, column);
+            obj lst = parse_list();
+            if(lst->ispair())
+              sources_->note(lst, source_map::location(file_, line, column));
+            return lst;
+          }
           return parse_list();
         case TOK_RPAREN:
           return rparen;
@@ -707,10 +2878,17 @@ namespace PetitScheme
           tok = tokenizer.readstrexp();
           if(tok.type() == TOK_STR)
             return Base::mk_string(tok.str());
+          throw std::logic_error("Can't parse string literal!");
         case TOK_COMMENT:
           return parse_atom();
-        case TOK_QUOTE:
-          return list(Base::mk_symbol("quote"), parse_atom());
+        case TOK_EOF:
+          return NULL;
+        case TOK_QUOTE:{
+          quoted_++;
+          obj datum = parse_atom();
+          quoted_--;
+          return list(Base::mk_symbol("quote"), datum);
+        }
         case TOK_DOT:
           return rdot;
         case TOK_BQUOTE:
@@ -724,6 +2902,10 @@ namespace PetitScheme
             return Base::cell::T;
           else if(strcmp(tok.str(),"#f") == 0)
             return Base::cell::F;
+          else if(strcmp(tok.str(),"#") == 0 && tokenizer.follows('('))
+            return parse_vector(false);
+          else if(strcmp(tok.str(),"#u8") == 0 && tokenizer.follows('('))
+            return parse_vector(true);
           else
             return Base::mk_symbol(tok.str());
         default:
@@ -731,7 +2913,16 @@ namespace PetitScheme
         }
       }
     public:
-      Parser(const char* str, size_t size) : tokenizer(str, size) {}
+      Parser(const char* str, size_t size)
+        : tokenizer(str, size), sources_(NULL), file_(0), quoted_(0),
+          rparen(&rparen_), rdot(&rdot_) {}
+      // notes where each list begins in sources, the text starting at
+      // line of file
+      Parser(const char* str, size_t size, source_map *sources,
+             unsigned file, unsigned line)
+        : tokenizer(str, size, line), sources_(sources), file_(file),
+          quoted_(0), rparen(&rparen_), rdot(&rdot_) {}
+      // returns NULL when the input is exhausted
       Base::cell *parse() {
         return parse_atom();
       };
@@ -745,14 +2936,30 @@ namespace PetitScheme {
     class SexpIO {
       std::istream *is;
       std::ostream *os;
-      bool failed, eof;
+      bool failed, eof, interactive;
+      // lines read, and the one the last read began with
+      unsigned lines, first;
+
+      // batch mode output buffer; flushed at exit or by (flush-output)
+      static char outbuf[1 << 16];
 
     public:
-      SexpIO(){
-        is = &std::cin;
+      static bool isatty_stdin(){ return isatty(fileno(stdin)) != 0; }
+
+      SexpIO(bool interactive_ = true, std::istream *in = &std::cin){
+        is = in;
+        lines = 0;
+        first = 1;
         os = &std::cout;
         failed = false;
         eof = false;
+        interactive = interactive_;
+        if(!interactive){
+          // must be done before the first output operation
+          std::ios::sync_with_stdio(false);
+          std::cin.tie(NULL);
+          std::cout.rdbuf()->pubsetbuf(outbuf, sizeof(outbuf));
+        }
       }
 
       std::string read() {
@@ -760,8 +2967,10 @@ namespace PetitScheme {
         std::string current, line;
         current.clear();
         int paren = 0;
-        *os << "petitsch>> ";
+        if(interactive) *os << "petitsch>> ";
+        first = lines + 1;
         while(std::getline(*is, line)){
+          lines++;
           paren += std::count(line.begin(), line.end(), '(');
           paren -= std::count(line.begin(), line.end(), ')');
           current += line;
@@ -777,7 +2986,11 @@ namespace PetitScheme {
 
       bool isfail() { return failed; }
       bool iseof() { return eof; }
+      bool isinteractive() { return interactive; }
+      unsigned line() { return first; }
     };
+
+    char SexpIO::outbuf[1 << 16];
   }
 }
 
@@ -804,615 +3017,3956 @@ namespace PetitScheme {
       "ARGUMENT",
       "APPLY",
       "RETURN",
-      "DEFINE"
+      "DEFINE",
+      "PUSH",
+      "ADD2",
+      "SUB2",
+      "NUMEQ",
+      "CAR1",
+      "CDR1",
+      "CONS2",
+      "NULLP",
+      "EQ",
+      "APPEND2",
+      "CONTI1",
+      "NUATE1",
+      "EXIT1",
+      "ENTER",
+      "LEAVE",
+      "JUMP",
+      "VREF2",
+      "VSET3"
     };
 
-    void _printsexp(obj code){
-      if(code->isopcode()){
-        cout << OP_CODE_STR[code->ivalue()];
-      }else if(code->isproc()){
-        cout << "#" << reinterpret_cast<long>(code->func());
-      }else if(code->issymbol()){
-        cout << code->str();
-      }else if(code->ispair()){
-        cout << '(';
-        while(1){
-          if(!code->ispair()){
-            cout << ". ";
-            _printsexp(code);
-          }else{
-            _printsexp(car(code));
-          }
-          code = cdr(code);
-          if(code != cell::NIL)
-            cout << ' ';
-          else
-            break;
-        }
-        cout << ')';
-      }else{
-        if(code->isnumber())
-          cout << code->ivalue();
-        else if(code->isstring())
-          cout << code->str();
-        else if(code == cell::NIL)
-          cout << "()";
+    // Writes s-expressions into a reusable byte buffer without recursion.
+    // Shared structure is found with a DFS that colours pairs and vectors
+    // with the T_PRINT_* bits; only those that close a cycle get a #n=
+    // label, the same as R7RS write.
+    class Printer {
+      struct frame {
+        obj cell_;
+        size_t state_;
+        bool vector_;
+        frame(obj c, size_t st, bool vec = false)
+          : cell_(c), state_(st), vector_(vec) {}
+      };
+
+      static bool compound(obj c){ return c->ispair() || c->isvector(); }
+
+      std::string buf_;
+      std::vector<frame> stack_;
+      std::unordered_map<obj, long> labels_;
+      long next_label_;
+
+      void put(const char *str){ buf_.append(str); }
+      void put(const char *str, size_t len){ buf_.append(str, len); }
+      void put(char c){ buf_.push_back(c); }
+
+      void put_integer(long n, int base = 10){
+        char tmp[32];
+        std::to_chars_result res = std::to_chars(tmp, tmp + sizeof(tmp), n, base);
+        put(tmp, res.ptr - tmp);
       }
-    }
 
-    void printsexp(obj code){
-      _printsexp(code);
-      cout << endl;
-    }
+      // shortest round-trip form, always recognisable as inexact
+      void put_flonum(double d){
+        if(std::isnan(d)){
+          put("+nan.0");
+          return;
+        }
+        if(std::isinf(d)){
+          put(d < 0 ? "-inf.0" : "+inf.0");
+          return;
+        }
+        char tmp[64];
+        std::to_chars_result res = std::to_chars(tmp, tmp + sizeof(tmp), d);
+        put(tmp, res.ptr - tmp);
+        if(std::find_if(tmp, res.ptr, not_digit) == res.ptr) put(".0");
+      }
+
+      static bool not_digit(char c){ return c != '-' && (c < '0' || c > '9'); }
+
+      void put_string(obj str, bool write){
+        if(!write){
+          put(str->str());
+          return;
+        }
+        put('"');
+        for(const char *p = str->str(); *p != '\0'; p++){
+          switch(*p){
+          case '"': put("\\\""); break;
+          case '\\': put("\\\\"); break;
+          case '\n': put("\\n"); break;
+          case '\t': put("\\t"); break;
+          case '\r': put("\\r"); break;
+          case '\a': put("\\a"); break;
+          default: put(*p); break;
+          }
+        }
+        put('"');
+      }
+
+      void put_atom(obj code, bool write){
+        if(code->isopcode()){
+          put(OP_CODE_STR[code->ivalue()]);
+        }else if(code->isproc()){
+          put("#<procedure ");
+          put(code->proc()->name);
+          put('>');
+        }else if(code->issymbol()){
+          put(code->str());
+        }else if(code->isnumber()){
+          put_integer(code->ivalue());
+        }else if(code->isflonum()){
+          put_flonum(code->fvalue());
+        }else if(code->isbignum()){
+          put(Number::to_string(Number::to_integer(code)).c_str());
+        }else if(code->isstring()){
+          put_string(code, write);
+        }else if(code->isbytevector()){
+          put("#u8(");
+          for(size_t i = 0; i < code->size(); i++){
+            if(i > 0) put(' ');
+            put_integer(code->bytes()[i]);
+          }
+          put(')');
+        }else if(code->iscontinuation()){
+          put("#<continuation>");
+        }else if(code->istable()){
+          put("#<hash-table>");
+        }else if(code->isfuture()){
+          put("#<future>");
+        }else if(code->ischannel()){
+          put("#<channel>");
+        }else if(code == cell::NIL){
+          put("()");
+        }else if(code == cell::T){
+          put("#t");
+        }else if(code == cell::F){
+          put("#f");
+        }
+      }
+
+      // pass 1: label every pair and vector reachable from itself;
+      // state_ is the next field, car and cdr or the elements
+      void find_cycles(obj root){
+        root->setflag(cell::T_PRINT_ACTIVE);
+        stack_.push_back(frame(root, 0));
+        while(!stack_.empty()){
+          frame &top = stack_.back();
+          obj c = top.cell_;
+          obj child;
+          if(top.state_ < (c->isvector() ? c->size() : 2)){
+            if(c->isvector()) child = c->data()[top.state_];
+            else child = top.state_ == 0 ? car(c) : cdr(c);
+            top.state_++;
+          }else{
+            c->clrflag(cell::T_PRINT_ACTIVE);
+            c->setflag(cell::T_PRINT_DONE);
+            stack_.pop_back();
+            continue;
+          }
+          if(!compound(child)) continue;
+          if(child->hasflag(cell::T_PRINT_ACTIVE)){
+            if(!child->hasflag(cell::T_PRINT_LABEL)){
+              child->setflag(cell::T_PRINT_LABEL);
+              labels_[child] = -1;
+            }
+          }else if(!child->hasflag(cell::T_PRINT_DONE)){
+            child->setflag(cell::T_PRINT_ACTIVE);
+            stack_.push_back(frame(child, 0));
+          }
+        }
+      }
+
+      // pass 3: clear every bit left by find_cycles and print_pairs
+      void clear_bits(obj root){
+        stack_.push_back(frame(root, 0));
+        while(!stack_.empty()){
+          obj c = stack_.back().cell_;
+          stack_.pop_back();
+          while(compound(c) && c->hasflag(cell::T_PRINT_BITS)){
+            c->clrflag(cell::T_PRINT_BITS);
+            if(c->isvector()){
+              for(size_t i = 0; i < c->size(); i++)
+                if(compound(c->data()[i])) stack_.push_back(frame(c->data()[i], 0));
+              break;
+            }
+            if(compound(car(c))) stack_.push_back(frame(car(c), 0));
+            c = cdr(c);
+          }
+        }
+        labels_.clear();
+      }
+
+      // returns false if code was a back reference and nothing more is
+      // to be printed for it
+      bool put_label(obj code){
+        if(!code->hasflag(cell::T_PRINT_LABEL)) return true;
+        long &label = labels_[code];
+        if(label >= 0){
+          put('#'); put_integer(label); put('#');
+          return false;
+        }
+        label = next_label_++;
+        put('#'); put_integer(label); put('=');
+        return true;
+      }
+
+      // opens a list or vector unless it is a back reference
+      void open(obj c){
+        if(!put_label(c)) return;
+        if(c->isvector()){
+          put("#(");
+          stack_.push_back(frame(c, 0, true));
+        }else{
+          put('(');
+          stack_.push_back(frame(c, 1));
+        }
+      }
+
+      // pass 2: for a list state_ is 1 while the first element is still
+      // to be printed, 0 afterwards; for a vector the next index
+      void print_pairs(obj root, bool write){
+        next_label_ = 0;
+        open(root);
+        while(!stack_.empty()){
+          frame &top = stack_.back();
+          obj elem;
+          if(top.vector_){
+            obj v = top.cell_;
+            if(top.state_ == v->size()){
+              put(')');
+              stack_.pop_back();
+              continue;
+            }
+            if(top.state_ > 0) put(' ');
+            elem = v->data()[top.state_++];
+          }else{
+            obj rest = top.cell_;
+            if(rest == cell::NIL){
+              put(')');
+              stack_.pop_back();
+              continue;
+            }
+            bool first = top.state_ == 1;
+            if(!first) put(' ');
+            top.state_ = 0;
+            if(!rest->ispair() || (!first && rest->hasflag(cell::T_PRINT_LABEL))){
+              // improper tail, or a tail shared with an enclosing list
+              put(". ");
+              elem = rest;
+              top.cell_ = cell::NIL;
+            }else{
+              elem = car(rest);
+              top.cell_ = cdr(rest);
+            }
+          }
+          if(compound(elem)) open(elem);
+          else put_atom(elem, write);
+        }
+      }
+
+    public:
+      void print(obj code, bool write){
+        if(!compound(code)){
+          put_atom(code, write);
+          return;
+        }
+        find_cycles(code);
+        print_pairs(code, write);
+        clear_bits(code);
+      }
+
+      void newline(){ put('\n'); }
+
+      void flush(std::ostream &os){
+        os.write(buf_.data(), buf_.size());
+        buf_.clear();
+      }
 
-    obj OP_ADD(obj arg, obj env){
-      int i = 0;
-      obj c = arg;
-      while(c != cell::NIL){
-        i += car(c)->ivalue();
-        c = cdr(c);
+      // what was printed, taken out of the buffer
+      std::string take(){
+        std::string ret;
+        ret.swap(buf_);
+        return ret;
       }
+    };
+
+    // one per thread, as each thread may run an interpreter of its own
+    thread_local Printer printer;
+
+    // no std::endl: flushing is left to the stream (line buffered on a
+    // tty, block buffered in batch mode)
+    void printsexp(obj code, bool write = true){
+      printer.print(code, write);
+      printer.newline();
+      printer.flush(cout);
+    }
+
+    obj OP_ADD(const obj *argv, int argc){
+      obj i = mk_number(0);
+      for(int n = 0; n < argc; n++)
+        i = Number::add(i, argv[n]);
 
-      return mk_number(i);
+      return i;
     }
 
-    obj OP_SUB(obj arg, obj env){
-      if(arg == cell::NIL)
+    obj OP_SUB(const obj *argv, int argc){
+      if(argc == 0)
         return mk_number(0);
 
-      int i = car(arg)->ivalue();
-      if(cdr(arg) == cell::NIL)
-        return mk_number(-i);
+      obj i = argv[0];
+      if(argc == 1)
+        return Number::sub(mk_number(0), i);
 
-      obj c = cdr(arg);
-      while(c != cell::NIL){
-        i -= car(c)->ivalue();
-        c = cdr(c);
-      }
+      for(int n = 1; n < argc; n++)
+        i = Number::sub(i, argv[n]);
 
-      return mk_number(i);
+      return i;
     }
 
-    obj OP_MULTIPLY(obj arg, obj env){
-      int i = 1;
-      obj c = arg;
-      while(c != cell::NIL){
-        i *= car(c)->ivalue();
-        c = cdr(c);
-      }
+    obj OP_MULTIPLY(const obj *argv, int argc){
+      obj i = mk_number(1);
+      for(int n = 0; n < argc; n++)
+        i = Number::mul(i, argv[n]);
 
-      return mk_number(i);
+      return i;
     }
 
-    obj OP_DIVIDE(obj arg, obj env){
-      if(arg == cell::NIL)
+    obj OP_DIVIDE(const obj *argv, int argc){
+      if(argc == 0)
         return mk_number(1);
 
-      int i = car(arg)->ivalue();
-      if(cdr(arg) == cell::NIL)
-        return mk_number(1/i);
+      obj i = argv[0];
+      if(argc == 1)
+        return Number::div(mk_number(1), i);
 
-      obj c = cdr(arg);
-      while(c != cell::NIL){
-        i /= car(c)->ivalue();
-        c = cdr(c);
-      }
+      for(int n = 1; n < argc; n++)
+        i = Number::div(i, argv[n]);
+
+      return i;
+    }
+
+    obj OP_QUOTIENT(const obj *argv, int argc){
+      return Number::integer_divide(argv[0], argv[1], Number::DIV_QUOTIENT);
+    }
+
+    obj OP_REMAINDER(const obj *argv, int argc){
+      return Number::integer_divide(argv[0], argv[1], Number::DIV_REMAINDER);
+    }
+
+    obj OP_MODULO(const obj *argv, int argc){
+      return Number::integer_divide(argv[0], argv[1], Number::DIV_MODULO);
+    }
+
+    obj OP_EXACT_TO_INEXACT(const obj *argv, int argc){
+      return Number::to_inexact(argv[0]);
+    }
+
+    obj OP_INEXACT_TO_EXACT(const obj *argv, int argc){
+      return Number::to_exact(argv[0]);
+    }
+
+    obj OP_CAR(const obj *argv, int argc){
+      return car(argv[0]);
+    }
+
+    obj OP_CDR(const obj *argv, int argc){
+      return cdr(argv[0]);
+    }
+
+    obj OP_CONS(const obj *argv, int argc){
+      return cons(argv[0], argv[1]);
+    }
 
-      return mk_number(i);
+    obj OP_IS_NULL(const obj *argv, int argc){
+      return argv[0] == cell::NIL ? cell::T : cell::F;
     }
 
-    obj OP_CAR(obj arg, obj env){
-      return car(car(arg));
+    obj OP_IS_EQ(const obj *argv, int argc){
+      return argv[0] == argv[1] ? cell::T : cell::F;
     }
 
-    obj OP_CDR(obj arg, obj env){
-      return cdr(car(arg));
+    obj OP_IS_EQUAL(const obj *argv, int argc){
+      return equal(argv[0], argv[1]) ? cell::T : cell::F;
     }
 
-    obj OP_LIST(obj arg, obj env){
-      return arg;
+    // a non-negative fixnum, the same for data that are equal?
+    obj OP_EQUAL_HASH(const obj *argv, int argc){
+      return mk_number(static_cast<long>(equal_hash(argv[0]) >> 2));
     }
 
-    obj OP_LIST_ASTA_ASTA(obj arg, obj env){
-      printsexp(arg);
+    obj OP_LIST(const obj *argv, int argc){
       obj ret = cell::NIL;
-      while(arg != cell::NIL){
-        ret = append(ret, car(arg));
-        arg = cdr(arg);
-      }
+      while(argc > 0)
+        ret = cons(argv[--argc], ret);
       return ret;
     }
 
-    obj OP_BEGIN(obj arg, obj env){
-      while(cdr(arg) != cell::NIL)
-        arg = cdr(arg);
-      return car(arg);
+    obj OP_BEGIN(const obj *argv, int argc){
+      return argc == 0 ? cell::NIL : argv[argc - 1];
     }
 
-    obj OP_DISPLAY(obj arg, obj env){
-      printsexp(car(arg));
+    obj OP_DISPLAY(const obj *argv, int argc){
+      printsexp(argv[0], false);
       return cell::NIL;
     }
 
-    obj OP_EQUAL(obj arg, obj env){
-      if(car(arg)->ivalue() == cadr(arg)->ivalue()){
-        return cell::T;
-      }else{
-        return cell::F;
-      }
+    obj OP_WRITE(const obj *argv, int argc){
+      printsexp(argv[0]);
+      return cell::NIL;
     }
 
-    class VM {
-      enum OP_CODE {
-        OP_HALT = 1,
-        OP_REFER = 2,
-        OP_CONSTANT = 3,
-        OP_CLOSE = 4,
-        OP_TEST = 5,
-        OP_ASSIGN = 6,
-        OP_CONTI = 7,
-        OP_NUATE = 8,
-        OP_FRAME = 9,
-        OP_ARGUMENT = 10,
-        OP_APPLY = 11,
-        OP_RETURN = 12,
-        OP_DEFINE = 13
-      };
+    obj OP_FLUSH_OUTPUT(const obj *argv, int argc){
+      cout.flush();
+      return cell::NIL;
+    }
 
-      void define(obj var, obj val, obj *genv){
-        *genv = cons(cons(list(var), list(val)), *genv);
+    // true if every adjacent pair of arguments compares as wanted
+    obj compare_chain(const obj *argv, int argc, bool lt, bool eq, bool gt){
+      for(int n = 1; n < argc; n++){
+        int c = Number::compare(argv[n - 1], argv[n]);
+        if(c == Number::UNORDERED || !(c < 0 ? lt : (c == 0 ? eq : gt)))
+          return cell::F;
       }
+      return cell::T;
+    }
 
-      void define(const char *sym, obj val, obj *genv){
-        define(mk_symbol(sym), val, genv);
-      }
+    obj OP_EQUAL(const obj *argv, int argc){
+      return compare_chain(argv, argc, false, true, false);
+    }
 
-      void define(const char *sym, int num, obj *genv){
-        define(mk_symbol(sym), mk_number(num), genv);
-      }
+    obj OP_LESS(const obj *argv, int argc){
+      return compare_chain(argv, argc, true, false, false);
+    }
 
-      void define(const char *sym, const char *str,obj* genv){
-        define(mk_symbol(sym), mk_string(str), genv);
-      }
+    obj OP_GREATER(const obj *argv, int argc){
+      return compare_chain(argv, argc, false, false, true);
+    }
 
-      void define(const char *sym, cell::funcp func, obj* genv){
-        define(mk_symbol(sym), mk_proc(func), genv);
-      }
+    obj OP_LESS_EQUAL(const obj *argv, int argc){
+      return compare_chain(argv, argc, true, true, false);
+    }
 
-      obj extend(obj env, obj vars, obj vals){
-        return cons(cons(vars, vals), env);
-      }
-      obj call_frame(obj code, obj env, obj rib, obj stack){
-        return list(code, env, rib, stack);
-      }
+    obj OP_GREATER_EQUAL(const obj *argv, int argc){
+      return compare_chain(argv, argc, false, true, true);
+    }
 
-      obj closure(obj body, obj env, obj vars){
-        return list(body, env, vars);
-      }
+    // k as an index into [0, len], or [0, len) unless end
+    size_t checked_index(obj k, size_t len, const char *who, bool end = false){
+      if(!k->isnumber() || k->fixnum() < 0
+         || static_cast<size_t>(k->fixnum()) > len
+         || (!end && static_cast<size_t>(k->fixnum()) == len))
+        throw std::logic_error(std::string(who) + ": index out of range");
+      return k->fixnum();
+    }
 
-      obj _lookup(obj var, obj env){
-        obj e = env;
-        while(e != cell::NIL){
-          obj vars = caar(e);
-          obj vals = cdar(e);
-          while(vars != cell::NIL){
-            if(strcmp(car(vars)->str(), var->str()) == 0)
-              return vals;
-            vars = cdr(vars);
-            vals = cdr(vals);
-          }
-          e = cdr(e);
-        }
-        return cell::NIL;
-      }
+    obj checked_vector(obj v, const char *who){
+      if(!v->isvector())
+        throw std::logic_error(std::string(who) + ": not a vector");
+      return v;
+    }
 
-      obj lookup(obj var, obj env, obj *genv){
-        obj found = _lookup(var, env);
-        if(found != cell::NIL)
-          return found;
-        return _lookup(var, *genv);
-      }
+    obj checked_bytevector(obj v, const char *who){
+      if(!v->isbytevector())
+        throw std::logic_error(std::string(who) + ": not a bytevector");
+      return v;
+    }
 
-      obj assoc_lookup(obj lst, obj key_obj){
-        const char *key = key_obj->str();
-        while(lst != cell::NIL){
-          if(strcmp(caar(lst)->str(),key) == 0){
-            return cdar(lst);
-          }
-          lst = cdr(lst);
-        }
-        return cell::NIL;
-      }
+    unsigned char checked_byte(obj b, const char *who){
+      if(!b->isnumber() || b->fixnum() < 0 || b->fixnum() > 255)
+        throw std::logic_error(std::string(who) + ": not a byte");
+      return static_cast<unsigned char>(b->fixnum());
+    }
 
-      bool reserved_lookup(obj reserved, obj key_obj){
-        const char *key = key_obj->str();
-        while(reserved != cell::NIL){
-          if(strcmp(car(reserved)->str(),key) == 0)
-            return true;
-          reserved = cdr(reserved);
-        }
-        return false;
-      }
+    // argv[from], argv[from + 1]: optional start and end into len
+    void checked_range(const obj *argv, int argc, int from, size_t len,
+                       const char *who, size_t &start, size_t &end){
+      start = argc > from ? checked_index(argv[from], len, who, true) : 0;
+      end = argc > from + 1 ? checked_index(argv[from + 1], len, who, true) : len;
+      if(start > end)
+        throw std::logic_error(std::string(who) + ": index out of range");
+    }
 
-      obj pattern_match(obj templ, obj real, obj reserved){
-        obj res = cell::NIL;
-        while(templ != cell::NIL){
-#ifdef DEBUG
-          cout << "templ: "; printsexp(templ);
-          cout << "real: "; printsexp(real);
-#endif
-          if(real == cell::NIL){
-            return NULL;
-          }else if(strcmp(cadr(templ)->str(), "...") == 0){
-            obj templ_orig = templ, real_orig = real;
-            while(real != cell::NIL){
-              obj ret = NULL;
-              if(car(templ)->ispair()){
-                ret = pattern_match(car(templ),car(real),reserved);
-              }else{
-                ret = pattern_match(list(car(templ)),list(car(real)),reserved);
-              }
-              if(ret == NULL) return NULL;
-              real = cdr(real);
-            }
-            while(cdr(templ) != cell::NIL){
-              templ = cdr(templ);
-              if(strcmp(car(templ)->str(), "...") != 0)
-                return NULL;
-            }
-            return cons(cons(templ_orig,real_orig),res);
-          }else if(car(templ)->ispair()){
-            if(!car(real)->ispair()){
-              return NULL;
-            }
-            obj ret = pattern_match(car(templ), car(real), reserved);
-            if(ret == NULL) return NULL;
-            res = append(ret,res);
-          }else{
-            if(strcmp(car(templ)->str(), "_") == 0) goto skip;
-            if(reserved_lookup(reserved,car(templ))){
-              if(strcmp(car(templ)->str(),car(real)->str()) == 0){
-                goto skip;
-              }else{
-                return NULL;
-              }
-            }
-            if(car(templ) != cell::NIL && car(real) != cell::NIL){
-              res = cons(cons(car(templ),car(real)),res);
-            }else{
-              return NULL;
-            }
-          }
-        skip:
-          if(!cdr(templ)->ispair() && cdr(templ) != cell::NIL){ //for dot list
-            obj ret = pattern_match(cdr(templ),cdr(real),reserved);
-            if(ret == NULL) return NULL;
-            res = append(ret,res);
-            templ = cdr(templ);
-            real = cdr(templ);
-          }
-          templ = cdr(templ);
-          real = cdr(real);
-        }
-        if(real != cell::NIL) return NULL;
-        return res;
-      }
+    obj OP_VECTOR(const obj *argv, int argc){
+      obj v = mk_vector(argc, cell::NIL);
+      std::copy(argv, argv + argc, v->data());
+      return v;
+    }
 
-      obj bind_lookup(obj bind, obj *key_objp){
-        if((*key_objp)->ispair()){
-          while(bind != cell::NIL){
-            obj templ = caar(bind);
-            obj key = *key_objp;
-#ifdef DEBUG
-            cout << "templ_bind: "; printsexp(templ);
-            cout << "key: "; printsexp(key);
-#endif
-            if(!caar(bind)->ispair()) goto skip;
-            if(!equal(car(templ),car(key))) goto skip;
-            while(cdr(templ) != cell::NIL){
-              templ = cdr(templ); key = cdr(key);
-              // 同数かチェック
-              if(key == cell::NIL) goto skip;
-              if(strcmp(car(key)->str(),"...")  != 0) goto skip;
-            }
-            *key_objp = cdr(key);
-            return cdar(bind);
-          skip:
-            bind = cdr(bind);
-          }
-          return NULL;
-        }else{
-          const char *key = (*key_objp)->str();
-          while(bind != cell::NIL){
-            if(caar(bind)->ispair())
-              goto skip2;
-            if(strcmp(caar(bind)->str(),key) == 0){
-              return cdar(bind);
-            }
-          skip2:
-            bind = cdr(bind);
-          }
-          return NULL;
-        }
-      }
+    obj OP_MAKE_VECTOR(const obj *argv, int argc){
+      size_t len = checked_index(argv[0], SIZE_MAX / sizeof(obj), "make-vector", true);
+      return mk_vector(len, argc > 1 ? argv[1] : cell::NIL);
+    }
 
-      obj macro_expand(obj bind, obj templ){
-#ifdef DEBUG
-        cout << "templ: "; printsexp(templ);
-#endif
-        if(templ->ispair()){
-          if(strcmp(cadr(templ)->str(),"...") == 0){
-            obj val = bind_lookup(bind,&templ);
-            if(val != NULL){
-              return append(val,macro_expand(bind,templ));
-            }
-          }
-          return cons(macro_expand(bind,car(templ)),
-                      macro_expand(bind,cdr(templ)));
-        }else{
-          obj val = bind_lookup(bind,&templ);
-          if(val != NULL){
-#ifdef DEBUG
-            cout << "binded: key: " << templ->str();
-            cout << "val: "; printsexp(val);
-#endif
-            return val;
-          }else{
-            return templ;
-          }
-        }
-      }
+    obj OP_IS_VECTOR(const obj *argv, int argc){
+      return argv[0]->isvector() ? cell::T : cell::F;
+    }
 
-      obj quasiquote(obj quoted){
-        if(quoted->ispair()){
-          obj ret = cell::NIL;
-          while(quoted != cell::NIL){
-            if(car(quoted)->ispair()){
-              if(strcmp(caar(quoted)->str(),"unquote") == 0){
-                ret = cons(list(mk_symbol("list"),cadar(quoted)),ret);
-              }else if(strcmp(caar(quoted)->str(), "unquote-splicing") == 0){
-                ret = cons(cadar(quoted),ret);
-              }else{
-                ret = cons(list(mk_symbol("list"),quasiquote(car(quoted))),ret);
-              }
-            }else{
-              ret = cons(list(mk_symbol("list"),quasiquote(car(quoted))),ret);
-            }
-            quoted = cdr(quoted);
-          }
-          return cons(mk_symbol("list**"),nreverse(ret));
-        }else{
-          return list(mk_symbol("quote"), quoted);
-        }
-      }
+    obj OP_VECTOR_LENGTH(const obj *argv, int argc){
+      return mk_number(checked_vector(argv[0], "vector-length")->size());
+    }
 
-      //いつか再帰をなくす予定
-      obj compile(obj code, obj next, obj *syntax){
-        if(code->issymbol()){
-          return list(mk_opcode(OP_REFER), code, next);
-        }else if(code->ispair()){
-          const char *opcode = car(code)->str();
-          obj matched_syntax;
-          if(strcmp(opcode, "quote") == 0){
-            return list(mk_opcode(OP_CONSTANT), cadr(code), next);
-          }else if(strcmp(opcode, "quasiquote") == 0){
-            //printsexp(quasiquote(cadr(code)));
-            return compile(quasiquote(cadr(code)), next, syntax);
-          }else if(strcmp(opcode, "lambda") == 0){
-            obj body = list(mk_opcode(OP_RETURN));
-            obj body_exps = cddr(code);
-            body_exps = nreverse(body_exps);
-            while(body_exps != cell::NIL){
-              body = compile(car(body_exps),body, syntax);
-              body_exps = cdr(body_exps);
-            }
-            return list(mk_opcode(OP_CLOSE), cadr(code),
-                        body, next);
-          }else if(strcmp(opcode, "if") == 0){
-            return compile(cadr(code),
-                           list(mk_opcode(OP_TEST),
-                                compile(caddr(code), next, syntax),
-                                compile(cadddr(code), next, syntax)), syntax);
-          }else if(strcmp(opcode, "set!") == 0){
-            return compile(caddr(code),
-                           list(mk_opcode(OP_ASSIGN), cadr(code), next),
-                           syntax);
-          }else if(strcmp(opcode, "define") == 0){
-            if(cadr(code)->ispair()){
-              return compile(cons(mk_symbol("lambda"),
-                                  cons(cdadr(code), cddr(code))),
-                             list(mk_opcode(OP_DEFINE), caadr(code), next),
-                             syntax);
-            }else{
-              return compile(caddr(code),
-                             list(mk_opcode(OP_DEFINE), cadr(code), next),
-                             syntax);
-            }
-          }else if(strcmp(opcode, "call/cc") == 0){
-            obj c = list(mk_opcode(OP_CONTI),
-                         list(mk_opcode(OP_ARGUMENT),
-                              compile(cadr(code), list(mk_opcode(OP_APPLY)),
-                                      syntax)));
-            if(car(next)->ivalue() == OP_RETURN)
-              return c;
-            else
-              return list(mk_opcode(OP_FRAME), next, c);
-          }else if(strcmp(opcode, "define-syntax") == 0){
-            obj name = cadr(code);
-            obj transformer = caddr(code);
-            *syntax = cons(cons(name,transformer),*syntax);
-            return next;
-          }else if((matched_syntax = assoc_lookup(*syntax, car(code)))
-                   != cell::NIL){
-            //printsexp(matched_syntax);
-            if(strcmp(car(matched_syntax)->str(),"syntax-rules") == 0){
-              obj reserved = cadr(matched_syntax);
-              obj patterns = cddr(matched_syntax);
-              obj bind = NULL;
-              while(patterns != cell::NIL){
-                bind = pattern_match(caar(patterns),code,
-                                     cons(car(code),reserved));
-                if(bind != NULL) break;
-                patterns = cdr(patterns);
-              }
-              if(bind == NULL) throw logic_error("not match macro");
-#ifdef DEBUG
-              cout << "binded: "; printsexp(bind);
-#endif
-              obj expanded = macro_expand(bind, cadar(patterns));
-#ifdef DEBUG
-              cout << "expanded: "; printsexp(expanded);
-#endif
-              return compile(expanded, next, syntax);
-            }else{
-              throw logic_error("not implemented other macro syntax rule");
-            }
-          }else{
-            obj c = compile(car(code), list(mk_opcode(OP_APPLY)),syntax);
-            obj args = cdr(code);
-            args = nreverse(args);
-            while(args != cell::NIL) {
-              c = compile(car(args), list(mk_opcode(OP_ARGUMENT), c),syntax);
-              args = cdr(args);
+    obj OP_VECTOR_REF(const obj *argv, int argc){
+      obj v = checked_vector(argv[0], "vector-ref");
+      return v->data()[checked_index(argv[1], v->size(), "vector-ref")];
+    }
+
+    obj OP_VECTOR_SET(const obj *argv, int argc){
+      obj v = checked_vector(argv[0], "vector-set!");
+      v->data()[checked_index(argv[1], v->size(), "vector-set!")] = argv[2];
+      cell_manager::write_barrier(v);
+      return cell::NIL;
+    }
+
+    obj OP_VECTOR_FILL(const obj *argv, int argc){
+      obj v = checked_vector(argv[0], "vector-fill!");
+      size_t start, end;
+      checked_range(argv, argc, 2, v->size(), "vector-fill!", start, end);
+      std::fill(v->data() + start, v->data() + end, argv[1]);
+      cell_manager::write_barrier(v);
+      return cell::NIL;
+    }
+
+    // (vector-copy! to at from [start [end]]), overlapping ranges too
+    obj OP_VECTOR_COPY(const obj *argv, int argc){
+      obj to = checked_vector(argv[0], "vector-copy!");
+      size_t at = checked_index(argv[1], to->size(), "vector-copy!", true);
+      obj from = checked_vector(argv[2], "vector-copy!");
+      size_t start, end;
+      checked_range(argv, argc, 3, from->size(), "vector-copy!", start, end);
+      if(end - start > to->size() - at)
+        throw std::logic_error("vector-copy!: index out of range");
+      memmove(to->data() + at, from->data() + start, (end - start) * sizeof(obj));
+      cell_manager::write_barrier(to);
+      return cell::NIL;
+    }
+
+    obj OP_VECTOR_TO_LIST(const obj *argv, int argc){
+      obj v = checked_vector(argv[0], "vector->list");
+      obj ret = cell::NIL;
+      for(size_t i = v->size(); i-- > 0;)
+        ret = cons(v->data()[i], ret);
+      return ret;
+    }
+
+    obj OP_LIST_TO_VECTOR(const obj *argv, int argc){
+      size_t len = 0;
+      obj p = argv[0];
+      for(; p->ispair(); p = cdr(p)) len++;
+      if(p != cell::NIL)
+        throw std::logic_error("list->vector: not a list");
+      obj v = mk_vector(len, cell::NIL);
+      p = argv[0];
+      for(size_t i = 0; i < len; i++, p = cdr(p))
+        v->data()[i] = car(p);
+      return v;
+    }
+
+    obj OP_BYTEVECTOR(const obj *argv, int argc){
+      obj v = mk_bytevector(argc, 0);
+      for(int i = 0; i < argc; i++)
+        v->bytes()[i] = checked_byte(argv[i], "bytevector");
+      return v;
+    }
+
+    obj OP_MAKE_BYTEVECTOR(const obj *argv, int argc){
+      size_t len = checked_index(argv[0], SIZE_MAX, "make-bytevector", true);
+      unsigned char fill = argc > 1 ? checked_byte(argv[1], "make-bytevector") : 0;
+      return mk_bytevector(len, fill);
+    }
+
+    obj OP_IS_BYTEVECTOR(const obj *argv, int argc){
+      return argv[0]->isbytevector() ? cell::T : cell::F;
+    }
+
+    obj OP_BYTEVECTOR_LENGTH(const obj *argv, int argc){
+      return mk_number(checked_bytevector(argv[0], "bytevector-length")->size());
+    }
+
+    obj OP_BYTEVECTOR_U8_REF(const obj *argv, int argc){
+      obj v = checked_bytevector(argv[0], "bytevector-u8-ref");
+      return mk_number(v->bytes()[checked_index(argv[1], v->size(),
+                                                "bytevector-u8-ref")]);
+    }
+
+    obj OP_BYTEVECTOR_U8_SET(const obj *argv, int argc){
+      obj v = checked_bytevector(argv[0], "bytevector-u8-set!");
+      v->bytes()[checked_index(argv[1], v->size(), "bytevector-u8-set!")]
+        = checked_byte(argv[2], "bytevector-u8-set!");
+      return cell::NIL;
+    }
+
+    obj OP_BYTEVECTOR_COPY(const obj *argv, int argc){
+      obj to = checked_bytevector(argv[0], "bytevector-copy!");
+      size_t at = checked_index(argv[1], to->size(), "bytevector-copy!", true);
+      obj from = checked_bytevector(argv[2], "bytevector-copy!");
+      size_t start, end;
+      checked_range(argv, argc, 3, from->size(), "bytevector-copy!", start, end);
+      if(end - start > to->size() - at)
+        throw std::logic_error("bytevector-copy!: index out of range");
+      memmove(to->bytes() + at, from->bytes() + start, end - start);
+      return cell::NIL;
+    }
+
+    // calls proc from a builtin, in a run of the VM nested in the one
+    // that called the builtin
+    obj call_procedure(obj proc, obj args);
+
+    obj checked_table(obj t, const char *who){
+      if(!t->istable())
+        throw std::logic_error(std::string(who) + ": not a hash table");
+      return t;
+    }
+
+    obj checked_key(obj t, obj key, const char *who){
+      if(checked_table(t, who)->table()->kind_ == hash_table::STRING
+         && !key->isstring())
+        throw std::logic_error(std::string(who) + ": not a string");
+      return key;
+    }
+
+    // (make-hash-table ['eq | 'eqv | 'equal | 'string]), equal by default;
+    // the eq? and equal? builtins stand for their kinds, as in SRFI-69
+    obj OP_MAKE_HASH_TABLE(const obj *argv, int argc){
+      if(argc == 0) return mk_table(hash_table::EQUAL);
+      if(argv[0]->isproc() && argv[0]->proc()->func == OP_IS_EQ)
+        return mk_table(hash_table::EQ);
+      if(argv[0]->isproc() && argv[0]->proc()->func == OP_IS_EQUAL)
+        return mk_table(hash_table::EQUAL);
+      static const char *const kinds[] = { "eq", "eqv", "equal", "string" };
+      for(int i = 0; i < 4; i++)
+        if(argv[0]->issymbol() && strcmp(argv[0]->str(), kinds[i]) == 0)
+          return mk_table(static_cast<hash_table::KIND>(i));
+      throw std::logic_error("make-hash-table: unknown kind of table");
+    }
+
+    obj OP_IS_HASH_TABLE(const obj *argv, int argc){
+      return argv[0]->istable() ? cell::T : cell::F;
+    }
+
+    // (hash-table-ref table key [thunk]), thunk called if key is missing
+    obj OP_HASH_TABLE_REF(const obj *argv, int argc){
+      obj val = table_ref(argv[0], checked_key(argv[0], argv[1], "hash-table-ref"));
+      if(val != NULL) return val;
+      if(argc > 2) return call_procedure(argv[2], cell::NIL);
+      throw std::logic_error("hash-table-ref: no such key");
+    }
+
+    obj OP_HASH_TABLE_REF_DEFAULT(const obj *argv, int argc){
+      obj val = table_ref(argv[0], checked_key(argv[0], argv[1],
+                                               "hash-table-ref/default"));
+      return val != NULL ? val : argv[2];
+    }
+
+    obj OP_HASH_TABLE_SET(const obj *argv, int argc){
+      table_set(argv[0], checked_key(argv[0], argv[1], "hash-table-set!"), argv[2]);
+      return cell::NIL;
+    }
+
+    obj OP_HASH_TABLE_DELETE(const obj *argv, int argc){
+      table_delete(argv[0], checked_key(argv[0], argv[1], "hash-table-delete!"));
+      return cell::NIL;
+    }
+
+    obj OP_HASH_TABLE_EXISTS(const obj *argv, int argc){
+      obj key = checked_key(argv[0], argv[1], "hash-table-exists?");
+      return table_ref(argv[0], key) != NULL ? cell::T : cell::F;
+    }
+
+    // (hash-table-update! table key proc [thunk]); proc may change the
+    // table, so the new value is stored by another lookup
+    obj OP_HASH_TABLE_UPDATE(const obj *argv, int argc){
+      obj key = checked_key(argv[0], argv[1], "hash-table-update!");
+      obj val = table_ref(argv[0], key);
+      if(val == NULL){
+        if(argc < 4) throw std::logic_error("hash-table-update!: no such key");
+        val = call_procedure(argv[3], cell::NIL);
+      }
+      table_set(argv[0], key, call_procedure(argv[2], list(val)));
+      return cell::NIL;
+    }
+
+    obj OP_HASH_TABLE_UPDATE_DEFAULT(const obj *argv, int argc){
+      obj key = checked_key(argv[0], argv[1], "hash-table-update!/default");
+      obj val = table_ref(argv[0], key);
+      table_set(argv[0], key,
+                call_procedure(argv[2], list(val != NULL ? val : argv[3])));
+      return cell::NIL;
+    }
+
+    obj OP_HASH_TABLE_SIZE(const obj *argv, int argc){
+      return mk_number(checked_table(argv[0], "hash-table-size")->table()->count_);
+    }
+
+    // the entries as a list of what make returns for each, in slot order
+    template <class F>
+    obj table_entries(obj c, const char *who, F make){
+      obj ret = cell::NIL;
+      hash_table *t = checked_table(c, who)->table();
+      for(size_t i = 0; i < t->capacity(); i++){
+        // make may collect, which leaves the slots as they are
+        cell **slot = t->slots() + 2 * i;
+        if(slot[0] != NULL && slot[0] != hash_table::DELETED)
+          ret = cons(make(slot[0], slot[1]), ret);
+      }
+      return ret;
+    }
+
+    obj OP_HASH_TABLE_KEYS(const obj *argv, int argc){
+      return table_entries(argv[0], "hash-table-keys",
+                           [](obj k, obj v){ return k; });
+    }
+
+    obj OP_HASH_TABLE_VALUES(const obj *argv, int argc){
+      return table_entries(argv[0], "hash-table-values",
+                           [](obj k, obj v){ return v; });
+    }
+
+    obj OP_HASH_TABLE_TO_ALIST(const obj *argv, int argc){
+      return table_entries(argv[0], "hash-table->alist",
+                           [](obj k, obj v){ return cons(k, v); });
+    }
+
+    // (hash-table-walk table proc) calls (proc key value) for the
+    // entries there were when it started
+    obj OP_HASH_TABLE_WALK(const obj *argv, int argc){
+      obj entries = table_entries(argv[0], "hash-table-walk",
+                                  [](obj k, obj v){ return cons(k, v); });
+      for(; entries != cell::NIL; entries = cdr(entries))
+        call_procedure(argv[1], list(caar(entries), cdar(entries)));
+      return cell::NIL;
+    }
+
+    // (hash-table-fold table kons knil), (kons key value acc) per entry
+    obj OP_HASH_TABLE_FOLD(const obj *argv, int argc){
+      obj entries = table_entries(argv[0], "hash-table-fold",
+                                  [](obj k, obj v){ return cons(k, v); });
+      obj acc = argv[2];
+      for(; entries != cell::NIL; entries = cdr(entries))
+        acc = call_procedure(argv[1], list(caar(entries), cdar(entries), acc));
+      return acc;
+    }
+
+    // the value of a future, after running it here if no worker has
+    // started it yet; anything else is its own value
+    obj touch_future(obj f);
+    // a pending future queued for the workers of the running VM
+    obj spawn_future(obj proc, obj items, long count);
+    // (proc item) per item of lst, in chunks run as futures
+    obj parallel_map(obj proc, obj lst);
+
+    // (future thunk)
+    obj OP_FUTURE(const obj *argv, int argc){
+      return spawn_future(argv[0], cell::NIL, -1);
+    }
+
+    obj OP_TOUCH(const obj *argv, int argc){
+      return touch_future(argv[0]);
+    }
+
+    obj OP_IS_FUTURE(const obj *argv, int argc){
+      return argv[0]->isfuture() ? cell::T : cell::F;
+    }
+
+    obj OP_PARALLEL_MAP(const obj *argv, int argc){
+      return parallel_map(argv[0], argv[1]);
+    }
+
+    // green threads of the running VM, see VM::block; the builtins that
+    // may wait are given where they are on its stack, argv
+    obj spawn_thread(obj thunk);
+    obj yield_thread(const obj *argv);
+    obj make_channel(size_t capacity);
+    obj channel_put(const obj *argv);
+    obj channel_get(const obj *argv);
+
+    // (spawn thunk)
+    obj OP_SPAWN(const obj *argv, int argc){
+      return spawn_thread(argv[0]);
+    }
+
+    obj OP_YIELD(const obj *argv, int argc){
+      return yield_thread(argv);
+    }
+
+    // (make-channel [capacity]), 0 by default: each put waits for a get
+    obj OP_MAKE_CHANNEL(const obj *argv, int argc){
+      if(argc > 0 && (!argv[0]->isnumber() || argv[0]->fixnum() < 0))
+        throw std::logic_error("make-channel: bad capacity");
+      return make_channel(argc > 0 ? argv[0]->fixnum() : 0);
+    }
+
+    obj OP_IS_CHANNEL(const obj *argv, int argc){
+      return argv[0]->ischannel() ? cell::T : cell::F;
+    }
+
+    // (channel-put channel value)
+    obj OP_CHANNEL_PUT(const obj *argv, int argc){
+      return channel_put(argv);
+    }
+
+    obj OP_CHANNEL_GET(const obj *argv, int argc){
+      return channel_get(argv);
+    }
+
+    // max_args -1: variadic
+    const native_proc builtins[] = {
+      { "+", 0, -1, OP_ADD },
+      { "-", 0, -1, OP_SUB },
+      { "*", 0, -1, OP_MULTIPLY },
+      { "/", 0, -1, OP_DIVIDE },
+      { "=", 1, -1, OP_EQUAL },
+      { "<", 1, -1, OP_LESS },
+      { ">", 1, -1, OP_GREATER },
+      { "<=", 1, -1, OP_LESS_EQUAL },
+      { ">=", 1, -1, OP_GREATER_EQUAL },
+      { "quotient", 2, 2, OP_QUOTIENT },
+      { "remainder", 2, 2, OP_REMAINDER },
+      { "modulo", 2, 2, OP_MODULO },
+      { "exact->inexact", 1, 1, OP_EXACT_TO_INEXACT },
+      { "inexact->exact", 1, 1, OP_INEXACT_TO_EXACT },
+      { "list", 0, -1, OP_LIST },
+      { "car", 1, 1, OP_CAR },
+      { "cdr", 1, 1, OP_CDR },
+      { "cons", 2, 2, OP_CONS },
+      { "null?", 1, 1, OP_IS_NULL },
+      { "eq?", 2, 2, OP_IS_EQ },
+      { "equal?", 2, 2, OP_IS_EQUAL },
+      { "equal-hash", 1, 1, OP_EQUAL_HASH },
+      { "begin", 0, -1, OP_BEGIN },
+      { "display", 1, 1, OP_DISPLAY },
+      { "write", 1, 1, OP_WRITE },
+      { "flush-output", 0, 0, OP_FLUSH_OUTPUT },
+      { "vector", 0, -1, OP_VECTOR },
+      { "make-vector", 1, 2, OP_MAKE_VECTOR },
+      { "vector?", 1, 1, OP_IS_VECTOR },
+      { "vector-length", 1, 1, OP_VECTOR_LENGTH },
+      { "vector-ref", 2, 2, OP_VECTOR_REF },
+      { "vector-set!", 3, 3, OP_VECTOR_SET },
+      { "vector-fill!", 2, 4, OP_VECTOR_FILL },
+      { "vector-copy!", 3, 5, OP_VECTOR_COPY },
+      { "vector->list", 1, 1, OP_VECTOR_TO_LIST },
+      { "list->vector", 1, 1, OP_LIST_TO_VECTOR },
+      { "bytevector", 0, -1, OP_BYTEVECTOR },
+      { "make-bytevector", 1, 2, OP_MAKE_BYTEVECTOR },
+      { "bytevector?", 1, 1, OP_IS_BYTEVECTOR },
+      { "bytevector-length", 1, 1, OP_BYTEVECTOR_LENGTH },
+      { "bytevector-u8-ref", 2, 2, OP_BYTEVECTOR_U8_REF },
+      { "bytevector-u8-set!", 3, 3, OP_BYTEVECTOR_U8_SET },
+      { "bytevector-copy!", 3, 5, OP_BYTEVECTOR_COPY },
+      { "make-hash-table", 0, 1, OP_MAKE_HASH_TABLE },
+      { "hash-table?", 1, 1, OP_IS_HASH_TABLE },
+      { "hash-table-ref", 2, 3, OP_HASH_TABLE_REF },
+      { "hash-table-ref/default", 3, 3, OP_HASH_TABLE_REF_DEFAULT },
+      { "hash-table-set!", 3, 3, OP_HASH_TABLE_SET },
+      { "hash-table-delete!", 2, 2, OP_HASH_TABLE_DELETE },
+      { "hash-table-exists?", 2, 2, OP_HASH_TABLE_EXISTS },
+      { "hash-table-update!", 3, 4, OP_HASH_TABLE_UPDATE },
+      { "hash-table-update!/default", 4, 4, OP_HASH_TABLE_UPDATE_DEFAULT },
+      { "hash-table-size", 1, 1, OP_HASH_TABLE_SIZE },
+      { "hash-table-keys", 1, 1, OP_HASH_TABLE_KEYS },
+      { "hash-table-values", 1, 1, OP_HASH_TABLE_VALUES },
+      { "hash-table->alist", 1, 1, OP_HASH_TABLE_TO_ALIST },
+      { "hash-table-walk", 2, 2, OP_HASH_TABLE_WALK },
+      { "hash-table-fold", 3, 3, OP_HASH_TABLE_FOLD },
+      { "future", 1, 1, OP_FUTURE },
+      { "touch", 1, 1, OP_TOUCH },
+      { "future?", 1, 1, OP_IS_FUTURE },
+      { "parallel-map", 2, 2, OP_PARALLEL_MAP },
+      { "spawn", 1, 1, OP_SPAWN },
+      { "yield", 0, 0, OP_YIELD },
+      { "make-channel", 0, 1, OP_MAKE_CHANNEL },
+      { "channel?", 1, 1, OP_IS_CHANNEL },
+      { "channel-put", 2, 2, OP_CHANNEL_PUT },
+      { "channel-get", 1, 1, OP_CHANNEL_GET },
+      { NULL, 0, 0, NULL }
+    };
+
+    // the builtin called name, or NULL
+    const native_proc *builtin(const char *name){
+      for(const native_proc *proc = builtins; proc->name != NULL; proc++)
+        if(strcmp(proc->name, name) == 0) return proc;
+      return NULL;
+    }
+
+    // syntax-rules transformers, compiled once by define-syntax.
+    //
+    // Each clause becomes (nslots matcher template): pattern variables
+    // are numbered, the matcher fills a vector of slots in one walk of
+    // the form and the template is a plan that reads the slots back.
+    // Variables under an ellipsis hold the list of their matches.  Both
+    // plans are made of cells, so the collector traces them like any
+    // other datum.  Node layouts:
+    //
+    //   (P_VAR slot) (P_WILD) (P_LITERAL sym) (P_CONST datum)
+    //   (P_LIST before ellipsis after tail ellipsis-slots)
+    //   (T_CONST datum) (T_VAR slot) (T_LIST elements tail)
+    //
+    // ellipsis is #f when the list pattern has none, tail () when the
+    // list must be proper.  A template element is (node depth drivers...)
+    // with one list of driving slots per ellipsis following node.
+    class SyntaxRules {
+      enum NODE {
+        P_VAR, P_WILD, P_LITERAL, P_CONST, P_LIST,
+        T_CONST, T_VAR, T_LIST
+      };
+
+      struct variable {
+        obj name;
+        int depth;
+      };
+
+      obj ellipsis_;
+      obj underscore_;
+      obj literals_;
+      std::vector<variable> vars_;
+
+      static obj node(NODE type, obj arg){
+        return list(mk_number(type), arg);
+      }
+
+      static NODE type(obj node){
+        return static_cast<NODE>(car(node)->fixnum());
+      }
+
+      static bool memq(obj x, obj lst){
+        for(; lst->ispair(); lst = cdr(lst))
+          if(car(lst) == x) return true;
+        return false;
+      }
+
+      int find_var(obj sym) const {
+        for(size_t i = 0; i < vars_.size(); i++)
+          if(vars_[i].name == sym) return i;
+        return -1;
+      }
+
+      obj compile_pattern(obj pat, int depth){
+        if(pat->issymbol()){
+          if(pat == ellipsis_)
+            throw std::logic_error("syntax-rules: misplaced ellipsis");
+          if(pat == underscore_) return list(mk_number(P_WILD));
+          if(memq(pat, literals_)) return node(P_LITERAL, pat);
+          if(find_var(pat) >= 0)
+            throw std::logic_error(string("syntax-rules: duplicate pattern "
+                                          "variable ") + pat->str());
+          variable var = { pat, depth };
+          vars_.push_back(var);
+          return node(P_VAR, mk_number(vars_.size() - 1));
+        }
+        if(!pat->ispair()) return node(P_CONST, pat);
+        obj before = cell::NIL, after = cell::NIL, ellipsis = cell::F;
+        obj ellipsis_slots = cell::NIL;
+        obj p = pat;
+        for(; p->ispair(); p = cdr(p)){
+          if(cdr(p)->ispair() && cadr(p) == ellipsis_){
+            if(ellipsis != cell::F)
+              throw std::logic_error("syntax-rules: more than one ellipsis");
+            size_t first = vars_.size();
+            ellipsis = compile_pattern(car(p), depth + 1);
+            for(size_t i = vars_.size(); i > first; i--)
+              ellipsis_slots = cons(mk_number(i - 1), ellipsis_slots);
+            p = cdr(p);
+          }else if(ellipsis == cell::F){
+            before = cons(compile_pattern(car(p), depth), before);
+          }else{
+            after = cons(compile_pattern(car(p), depth), after);
+          }
+        }
+        obj tail = p == cell::NIL ? cell::NIL : compile_pattern(p, depth);
+        return cons(mk_number(P_LIST),
+                    list(nreverse(before), ellipsis, nreverse(after),
+                         tail, ellipsis_slots));
+      }
+
+      // used collects the slots referenced from tmpl
+      obj compile_template(obj tmpl, int depth, std::vector<int> &used){
+        if(tmpl->issymbol()){
+          int slot = find_var(tmpl);
+          if(slot < 0) return node(T_CONST, tmpl);
+          if(vars_[slot].depth > depth)
+            throw std::logic_error(string("syntax-rules: missing ellipsis "
+                                          "after ") + tmpl->str());
+          used.push_back(slot);
+          return node(T_VAR, mk_number(slot));
+        }
+        if(!tmpl->ispair()) return node(T_CONST, tmpl);
+        // (... template) escapes the ellipsis
+        if(car(tmpl) == ellipsis_ && cdr(tmpl)->ispair())
+          return node(T_CONST, cadr(tmpl));
+        size_t first_used = used.size();
+        obj elements = cell::NIL;
+        obj p = tmpl;
+        for(; p->ispair(); p = cdr(p)){
+          obj elem = car(p);
+          int nellipsis = 0;
+          while(cdr(p)->ispair() && cadr(p) == ellipsis_){
+            nellipsis++;
+            p = cdr(p);
+          }
+          std::vector<int> elem_used;
+          obj sub = compile_template(elem, depth + nellipsis, elem_used);
+          // the slots an ellipsis iterates over are those bound deeper
+          // than the level it is at
+          obj drivers = cell::NIL;
+          for(int level = nellipsis; level > 0; level--){
+            obj slots = cell::NIL;
+            for(size_t i = 0; i < elem_used.size(); i++){
+              if(vars_[elem_used[i]].depth >= depth + level
+                 && !memq_slot(elem_used[i], slots))
+                slots = cons(mk_number(elem_used[i]), slots);
+            }
+            if(slots == cell::NIL)
+              throw std::logic_error("syntax-rules: no pattern variable "
+                                     "before ellipsis");
+            drivers = cons(slots, drivers);
+          }
+          used.insert(used.end(), elem_used.begin(), elem_used.end());
+          elements = cons(cons(sub, cons(mk_number(nellipsis), drivers)),
+                          elements);
+        }
+        obj tail = p == cell::NIL ? cell::NIL
+          : compile_template(p, depth, used);
+        // constant parts are shared with the definition
+        if(used.size() == first_used) return node(T_CONST, tmpl);
+        return list(mk_number(T_LIST), nreverse(elements), tail);
+      }
+
+      static bool memq_slot(int slot, obj slots){
+        for(; slots != cell::NIL; slots = cdr(slots))
+          if(car(slots)->fixnum() == slot) return true;
+        return false;
+      }
+
+      static bool match(obj pat, obj form, std::vector<obj> &slots){
+        switch(type(pat)){
+        case P_VAR:
+          slots[cadr(pat)->fixnum()] = form;
+          return true;
+        case P_WILD:
+          return true;
+        case P_LITERAL:
+          return form == cadr(pat);
+        case P_CONST:
+          return equal(form, cadr(pat));
+        case P_LIST:
+          return match_list(cdr(pat), form, slots);
+        default:
+          throw std::logic_error("syntax-rules: broken matcher");
+        }
+      }
+
+      static bool match_list(obj pat, obj form, std::vector<obj> &slots){
+        obj before = car(pat), ellipsis = cadr(pat), after = caddr(pat);
+        obj tail = cadddr(pat);
+        for(; before != cell::NIL; before = cdr(before), form = cdr(form)){
+          if(!form->ispair() || !match(car(before), car(form), slots))
+            return false;
+        }
+        if(ellipsis == cell::F)
+          return tail == cell::NIL ? form == cell::NIL
+            : match(tail, form, slots);
+        long nforms = 0, nafter = 0;
+        obj end = form;
+        for(; end->ispair(); end = cdr(end)) nforms++;
+        for(obj a = after; a != cell::NIL; a = cdr(a)) nafter++;
+        if(nforms < nafter || (tail == cell::NIL && end != cell::NIL))
+          return false;
+        long nrepeat = nforms - nafter;
+        if(nafter == 0 && tail == cell::NIL && type(ellipsis) == P_VAR){
+          // (x ...) at the end binds x to the rest of the form itself
+          slots[cadr(ellipsis)->fixnum()] = form;
+          form = cell::NIL;
+        }else{
+          form = match_ellipsis(ellipsis, car(cddddr(pat)), form, nrepeat,
+                                slots);
+          if(form == NULL) return false;
+        }
+        for(; after != cell::NIL; after = cdr(after), form = cdr(form)){
+          if(!match(car(after), car(form), slots)) return false;
+        }
+        return tail == cell::NIL || match(tail, form, slots);
+      }
+
+      // matches n elements of form against pat, collecting the values of
+      // its slots into lists; returns the rest of form or NULL
+      static obj match_ellipsis(obj pat, obj slot_list, obj form, long n,
+                                std::vector<obj> &slots){
+        std::vector<int> ids;
+        for(; slot_list != cell::NIL; slot_list = cdr(slot_list))
+          ids.push_back(car(slot_list)->fixnum());
+        std::vector<obj> heads(ids.size(), cell::NIL);
+        std::vector<obj> tails(ids.size(), cell::NIL);
+        obj *heads_end = heads.data() + heads.size();
+        scoped_root_range guard(heads.data(), &heads_end);
+        for(; n > 0; n--, form = cdr(form)){
+          if(!match(pat, car(form), slots)) return NULL;
+          for(size_t i = 0; i < ids.size(); i++){
+            obj cell_ = list(slots[ids[i]]);
+            if(heads[i] == cell::NIL) heads[i] = cell_;
+            else set_cdr(tails[i], cell_);
+            tails[i] = cell_;
+          }
+        }
+        for(size_t i = 0; i < ids.size(); i++) slots[ids[i]] = heads[i];
+        return form;
+      }
+
+      static obj expand(obj tmpl, std::vector<obj> &slots){
+        switch(type(tmpl)){
+        case T_CONST:
+          return cadr(tmpl);
+        case T_VAR:
+          return slots[cadr(tmpl)->fixnum()];
+        case T_LIST:{
+          obj head = cell::NIL, last = cell::NIL;
+          for(obj e = cadr(tmpl); e != cell::NIL; e = cdr(e)){
+            obj elem = car(e);
+            if(cadr(elem)->fixnum() == 0)
+              append_expansion(head, last, expand(car(elem), slots));
+            else
+              expand_ellipsis(car(elem), cddr(elem), slots, head, last);
+          }
+          obj tail = caddr(tmpl) == cell::NIL ? cell::NIL
+            : expand(caddr(tmpl), slots);
+          if(head == cell::NIL) return tail;
+          set_cdr(last, tail);
+          return head;
+        }
+        default:
+          throw std::logic_error("syntax-rules: broken template");
+        }
+      }
+
+      static void append_expansion(obj &head, obj &last, obj x){
+        obj c = list(x);
+        if(head == cell::NIL) head = c;
+        else set_cdr(last, c);
+        last = c;
+      }
+
+      // steps the driving slots of this level through their lists
+      static void expand_ellipsis(obj tmpl, obj drivers,
+                                  std::vector<obj> &slots,
+                                  obj &head, obj &last){
+        std::vector<int> ids;
+        for(obj d = car(drivers); d != cell::NIL; d = cdr(d))
+          ids.push_back(car(d)->fixnum());
+        std::vector<obj> saved(ids.size());
+        long n = -1;
+        for(size_t i = 0; i < ids.size(); i++){
+          saved[i] = slots[ids[i]];
+          long len = 0;
+          for(obj x = saved[i]; x->ispair(); x = cdr(x)) len++;
+          if(n >= 0 && len != n)
+            throw std::logic_error("syntax-rules: pattern variables under "
+                                   "one ellipsis matched different lengths");
+          n = len;
+        }
+        obj *saved_end = saved.data() + saved.size();
+        scoped_root_range guard(saved.data(), &saved_end);
+        std::vector<obj> rest(saved);
+        for(long k = 0; k < n; k++){
+          for(size_t i = 0; i < ids.size(); i++){
+            slots[ids[i]] = car(rest[i]);
+            rest[i] = cdr(rest[i]);
+          }
+          if(cdr(drivers) == cell::NIL)
+            append_expansion(head, last, expand(tmpl, slots));
+          else
+            expand_ellipsis(tmpl, cdr(drivers), slots, head, last);
+        }
+        for(size_t i = 0; i < ids.size(); i++) slots[ids[i]] = saved[i];
+      }
+
+    public:
+      // (syntax-rules (literal ...) (pattern template) ...)
+      // => ((nslots matcher template) ...)
+      static obj compile(obj spec){
+        if(!spec->ispair() || !car(spec)->issymbol()
+           || strcmp(car(spec)->str(), "syntax-rules") != 0)
+          throw logic_error("not implemented other macro syntax rule");
+        SyntaxRules sr;
+        sr.ellipsis_ = mk_symbol("...");
+        sr.underscore_ = mk_symbol("_");
+        sr.literals_ = cadr(spec);
+        obj clauses = cell::NIL;
+        for(obj c = cddr(spec); c != cell::NIL; c = cdr(c)){
+          sr.vars_.clear();
+          // the keyword position of the pattern is ignored
+          obj matcher = sr.compile_pattern(cdr(caar(c)), 0);
+          std::vector<int> used;
+          obj tmpl = sr.compile_template(cadar(c), 0, used);
+          clauses = cons(list(mk_number(sr.vars_.size()), matcher, tmpl),
+                         clauses);
+        }
+        return nreverse(clauses);
+      }
+
+      static obj expand_form(obj rules, obj form){
+        for(; rules != cell::NIL; rules = cdr(rules)){
+          obj clause = car(rules);
+          std::vector<obj> slots(caar(rules)->fixnum(), cell::NIL);
+          obj *slots_end = slots.data() + slots.size();
+          scoped_root_range guard(slots.data(), &slots_end);
+          if(match(cadr(clause), cdr(form), slots))
+            return expand(caddr(clause), slots);
+        }
+        throw logic_error("not match macro");
+      }
+    };
+
+    // A saved cell graph.  The file is a header, the indices of the
+    // roots, one fixed size record per cell and a data area for names,
+    // limbs and the words of stack chunks.  Cells refer to each other by
+    // index, 0 to 2 being (), #t and #f, so loading is a single pass
+    // over the mapped file that allocates the cells and links them.
+    // Builtins are saved by name and symbols are interned again.
+    class Image {
+      struct header {
+        char magic[8];
+        uint32_t version;
+        uint32_t nroots;
+        uint32_t ncells;
+        uint32_t pad;
+        uint64_t data_size;
+      };
+
+      struct record {
+        uint32_t type;
+        uint32_t a;   // car, a length or the limb count
+        uint64_t b;   // cdr, a value or an offset into the data area
+      };
+
+      static const char MAGIC[8];
+      // bump when the opcodes or the layout of compiled code change
+      static const uint32_t VERSION = 2;
+      static const uint32_t FIRST_INDEX = 3;
+
+      static uint32_t special_index(obj c){
+        if(c == cell::NIL) return 0;
+        if(c == cell::T) return 1;
+        if(c == cell::F) return 2;
+        return UINT32_MAX;
+      }
+
+      static void append(std::string &data, const void *p, size_t len){
+        data.append(static_cast<const char *>(p), len);
+        // keep the limbs and words that follow aligned
+        while(data.size() % sizeof(uint32_t) != 0) data.push_back('\0');
+      }
+
+      static const native_proc *find_builtin(const char *name){
+        const native_proc *proc = builtin(name);
+        if(proc == NULL)
+          throw std::logic_error(string("image: unknown builtin ") + name);
+        return proc;
+      }
+
+    public:
+      static void save(const char *path, const std::vector<obj> &roots){
+        // number the cells reachable from the roots
+        std::unordered_map<obj, uint32_t> index;
+        std::vector<obj> cells, work(roots.begin(), roots.end());
+        while(!work.empty()){
+          obj c = work.back();
+          work.pop_back();
+          if(special_index(c) != UINT32_MAX || index.count(c) != 0) continue;
+          index[c] = FIRST_INDEX + cells.size();
+          cells.push_back(c);
+          if(c->ispair()){
+            work.push_back(c->cdr());
+            work.push_back(c->car());
+          }else if(c->iscontinuation() || c->isvector()){
+            work.insert(work.end(), c->data(), c->data() + c->size());
+          }else if(c->istable()){
+            hash_table *t = c->table();
+            for(size_t i = 0; i < 2 * t->capacity(); i += 2){
+              if(t->slots()[i] == NULL || t->slots()[i] == hash_table::DELETED)
+                continue;
+              work.push_back(t->slots()[i]);
+              work.push_back(t->slots()[i + 1]);
+            }
+          }
+        }
+        std::vector<uint32_t> root_index;
+        for(size_t i = 0; i < roots.size(); i++){
+          uint32_t n = special_index(roots[i]);
+          root_index.push_back(n != UINT32_MAX ? n : index[roots[i]]);
+        }
+        std::vector<record> records(cells.size());
+        std::string data;
+        for(size_t i = 0; i < cells.size(); i++){
+          obj c = cells[i];
+          record &r = records[i];
+          r.a = 0;
+          r.b = 0;
+          if(c->ispair()){
+            r.type = cell::T_PAIR;
+            uint32_t car = special_index(c->car());
+            uint32_t cdr = special_index(c->cdr());
+            r.a = car != UINT32_MAX ? car : index[c->car()];
+            r.b = cdr != UINT32_MAX ? cdr : index[c->cdr()];
+          }else if(c->isnumber() || c->isopcode()){
+            r.type = c->isnumber() ? cell::T_NUMBER : cell::T_OPCODE;
+            r.b = static_cast<uint64_t>(c->ivalue());
+          }else if(c->isflonum()){
+            r.type = cell::T_FLONUM;
+            double d = c->fvalue();
+            memcpy(&r.b, &d, sizeof(d));
+          }else if(c->issymbol() || c->isstring() || c->isproc()){
+            // builtins are found again by name, not so registered ones
+            if(c->isproc() && c->proc()->func == NULL)
+              throw std::logic_error("image: can't save a registered procedure");
+            r.type = c->issymbol() ? cell::T_SYMBOL
+              : c->isstring() ? cell::T_STRING : cell::T_PROC;
+            const char *str = c->isproc() ? c->proc()->name : c->str();
+            r.a = strlen(str);
+            r.b = data.size();
+            append(data, str, r.a + 1);
+          }else if(c->isbignum()){
+            r.type = cell::T_BIGNUM;
+            int size = c->limb_size();
+            r.a = static_cast<uint32_t>(size);
+            r.b = data.size();
+            append(data, c->limbs(),
+                   (size < 0 ? -size : size) * sizeof(unsigned int));
+          }else if(c->istable()){
+            // the kind, then a key and a value per entry
+            hash_table *t = c->table();
+            r.type = cell::T_TABLE;
+            r.a = t->count_;
+            r.b = data.size();
+            uint32_t kind = t->kind_;
+            append(data, &kind, sizeof(kind));
+            for(size_t i = 0; i < 2 * t->capacity(); i += 2){
+              if(t->slots()[i] == NULL || t->slots()[i] == hash_table::DELETED)
+                continue;
+              for(int j = 0; j < 2; j++){
+                uint32_t n = special_index(t->slots()[i + j]);
+                if(n == UINT32_MAX) n = index[t->slots()[i + j]];
+                append(data, &n, sizeof(n));
+              }
+            }
+          }else if(c->isbytevector()){
+            r.type = cell::T_BYTEVECTOR;
+            r.a = c->size();
+            r.b = data.size();
+            append(data, c->bytes(), c->size());
+          }else if(c->iscontinuation() || c->isvector()){
+            r.type = c->isvector() ? cell::T_VECTOR : cell::T_CONTINUATION;
+            r.a = c->size();
+            r.b = data.size();
+            for(size_t w = 0; w < c->size(); w++){
+              uint32_t n = special_index(c->data()[w]);
+              if(n == UINT32_MAX) n = index[c->data()[w]];
+              append(data, &n, sizeof(n));
+            }
+          }else{
+            throw std::logic_error("image: can't save this object");
+          }
+        }
+        header h;
+        memcpy(h.magic, MAGIC, sizeof(h.magic));
+        h.version = VERSION;
+        h.nroots = root_index.size();
+        h.ncells = cells.size();
+        h.pad = 0;
+        h.data_size = data.size();
+        FILE *fp = fopen(path, "wb");
+        if(fp == NULL)
+          throw std::logic_error(string("image: can't write ") + path);
+        bool ok = fwrite(&h, sizeof(h), 1, fp) == 1
+          && fwrite(root_index.data(), sizeof(uint32_t), root_index.size(), fp)
+             == root_index.size()
+          && fwrite(records.data(), sizeof(record), records.size(), fp)
+             == records.size()
+          && fwrite(data.data(), 1, data.size(), fp) == data.size();
+        if(fclose(fp) != 0 || !ok)
+          throw std::logic_error(string("image: can't write ") + path);
+      }
+
+      // the roots saved in the image at path
+      static std::vector<obj> load(const char *path){
+        int fd = open(path, O_RDONLY);
+        if(fd < 0) throw std::logic_error(string("image: can't open ") + path);
+        struct stat st;
+        void *map = MAP_FAILED;
+        if(fstat(fd, &st) == 0 && st.st_size > 0)
+          map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(map == MAP_FAILED)
+          throw std::logic_error(string("image: can't map ") + path);
+        std::vector<obj> roots;
+        try{
+          roots = decode(static_cast<const char *>(map), st.st_size);
+        }catch(...){
+          munmap(map, st.st_size);
+          throw;
+        }
+        munmap(map, st.st_size);
+        return roots;
+      }
+
+    private:
+      // whether len bytes at offset are in the data area, without
+      // adding the two, which a corrupt offset makes wrap around
+      static bool in_data(const header &h, uint64_t offset, size_t len){
+        return offset <= h.data_size && len <= h.data_size - offset;
+      }
+
+      static std::vector<obj> decode(const char *p, size_t size){
+        header h;
+        if(size < sizeof(h))
+          throw std::logic_error("image: truncated");
+        memcpy(&h, p, sizeof(h));
+        if(memcmp(h.magic, MAGIC, sizeof(h.magic)) != 0)
+          throw std::logic_error("image: not an image file");
+        if(h.version != VERSION)
+          throw std::logic_error("image: made by another version");
+        size_t roots_at = sizeof(h);
+        size_t records_at = roots_at + h.nroots * sizeof(uint32_t);
+        size_t data_at = records_at + size_t(h.ncells) * sizeof(record);
+        if(data_at > size || h.data_size != size - data_at)
+          throw std::logic_error("image: truncated");
+        const char *data = p + data_at;
+        size_t count = FIRST_INDEX + h.ncells;
+        std::vector<obj> cells(count, cell::NIL);
+        cells[1] = cell::T;
+        cells[2] = cell::F;
+        obj *cells_end = cells.data() + cells.size();
+        scoped_root_range guard(cells.data(), &cells_end);
+        // every cell first, then the links between them
+        std::vector<record> records(h.ncells);
+        memcpy(records.data(), p + records_at, h.ncells * sizeof(record));
+        for(size_t i = 0; i < records.size(); i++){
+          const record &r = records[i];
+          obj &c = cells[FIRST_INDEX + i];
+          bool bad = r.type == cell::T_PAIR ? r.a >= count || r.b >= count
+            : r.type == cell::T_SYMBOL || r.type == cell::T_STRING
+              || r.type == cell::T_PROC
+            ? !in_data(h, r.b, size_t(r.a) + 1) || data[r.b + r.a] != '\0'
+            : r.type == cell::T_BIGNUM
+            ? !in_data(h, r.b, size_t(std::abs(int64_t(int32_t(r.a))))
+                       * sizeof(unsigned int))
+            : r.type == cell::T_CONTINUATION || r.type == cell::T_VECTOR
+            ? !in_data(h, r.b, size_t(r.a) * sizeof(uint32_t))
+            : r.type == cell::T_BYTEVECTOR
+            ? !in_data(h, r.b, size_t(r.a))
+            : r.type == cell::T_TABLE
+            ? !in_data(h, r.b, (2 * size_t(r.a) + 1) * sizeof(uint32_t))
+            : false;
+          if(bad) throw std::logic_error("image: corrupt");
+          long value = static_cast<long>(r.b);
+          double d;
+          switch(r.type){
+          case cell::T_PAIR:
+            c = cons(cell::NIL, cell::NIL);
+            break;
+          case cell::T_NUMBER:
+            c = mk_number(value);
+            break;
+          case cell::T_OPCODE:
+            c = mk_opcode(value);
+            break;
+          case cell::T_FLONUM:
+            memcpy(&d, &r.b, sizeof(d));
+            c = mk_flonum(d);
+            break;
+          case cell::T_SYMBOL:
+            c = mk_symbol(data + r.b);
+            break;
+          case cell::T_STRING:
+            c = mk_string(data + r.b);
+            break;
+          case cell::T_PROC:
+            c = mk_proc(find_builtin(data + r.b));
+            break;
+          case cell::T_BIGNUM:{
+            int n = int32_t(r.a);
+            std::vector<unsigned int> limbs(n < 0 ? -n : n);
+            memcpy(limbs.data(), data + r.b, limbs.size() * sizeof(unsigned int));
+            c = mk_bignum(limbs.data(), n);
+            break;
+          }
+          case cell::T_CONTINUATION:
+            c = mk_stack_chunk(r.a > 0 ? r.a : 1);
+            break;
+          case cell::T_VECTOR:
+            c = mk_vector(r.a, cell::NIL);
+            break;
+          case cell::T_BYTEVECTOR:
+            c = mk_bytevector(r.a, 0);
+            memcpy(c->bytes(), data + r.b, r.a);
+            break;
+          case cell::T_TABLE:{
+            uint32_t kind;
+            memcpy(&kind, data + r.b, sizeof(kind));
+            if(kind > hash_table::STRING) throw std::logic_error("image: corrupt");
+            c = mk_table(static_cast<hash_table::KIND>(kind));
+            break;
+          }
+          default:
+            throw std::logic_error("image: corrupt");
+          }
+        }
+        for(size_t i = 0; i < records.size(); i++){
+          const record &r = records[i];
+          obj c = cells[FIRST_INDEX + i];
+          if(r.type == cell::T_PAIR){
+            set_car(c, cells[r.a]);
+            set_cdr(c, cells[r.b]);
+          }else if(r.type == cell::T_CONTINUATION || r.type == cell::T_VECTOR){
+            for(uint32_t w = 0; w < r.a; w++){
+              uint32_t n;
+              memcpy(&n, data + r.b + w * sizeof(n), sizeof(n));
+              if(n >= count) throw std::logic_error("image: corrupt");
+              c->data()[w] = cells[n];
+            }
+            c->freeze(r.a);
+          }
+        }
+        // tables last, as their keys hash by what they are linked to
+        for(size_t i = 0; i < records.size(); i++){
+          const record &r = records[i];
+          if(r.type != cell::T_TABLE) continue;
+          for(uint32_t e = 0; e < r.a; e++){
+            uint32_t kv[2];
+            memcpy(kv, data + r.b + (1 + 2 * e) * sizeof(uint32_t), sizeof(kv));
+            if(kv[0] >= count || kv[1] >= count)
+              throw std::logic_error("image: corrupt");
+            table_set(cells[FIRST_INDEX + i], cells[kv[0]], cells[kv[1]]);
+          }
+        }
+        std::vector<obj> roots;
+        for(uint32_t i = 0; i < h.nroots; i++){
+          uint32_t n;
+          memcpy(&n, p + roots_at + i * sizeof(n), sizeof(n));
+          if(n >= count) throw std::logic_error("image: corrupt");
+          roots.push_back(cells[n]);
+        }
+        return roots;
+      }
+    };
+
+    const char Image::MAGIC[8] = { 'P', 'S', 'I', 'M', 'A', 'G', 'E', '\0' };
+
+    // an error with the place in the source it happened at
+    class located_error : public std::logic_error {
+    public:
+      explicit located_error(const std::string &what) : std::logic_error(what) {}
+    };
+
+    class worker_pool;
+
+    class VM {
+      enum OP_CODE {
+        OP_HALT = 1,
+        OP_REFER = 2,
+        OP_CONSTANT = 3,
+        OP_CLOSE = 4,
+        OP_TEST = 5,
+        OP_ASSIGN = 6,
+        OP_CONTI = 7,
+        OP_NUATE = 8,
+        OP_FRAME = 9,
+        OP_ARGUMENT = 10,
+        OP_APPLY = 11,
+        OP_RETURN = 12,
+        OP_DEFINE = 13,
+        // inline primitives, operands in acc and on top of the stack
+        OP_PUSH = 14,
+        OP_ADD2 = 15,
+        OP_SUB2 = 16,
+        OP_NUMEQ = 17,
+        OP_CAR1 = 18,
+        OP_CDR1 = 19,
+        OP_CONS2 = 20,
+        OP_NULLP = 21,
+        OP_EQ = 22,
+        // acc = a copy of the list on top of the stack ending in acc
+        OP_APPEND2 = 23,
+        // escape-only continuations
+        OP_CONTI1 = 24,
+        OP_NUATE1 = 25,
+        OP_EXIT1 = 26,
+        // binds the arguments on the stack without a closure
+        OP_ENTER = 27,
+        // let bodies and loops: drop frames of env, rebind and jump back
+        OP_LEAVE = 28,
+        OP_JUMP = 29,
+        // acc = v[k], v[k] = acc with v and k on the stack
+        OP_VREF2 = 30,
+        OP_VSET3 = 31
+      };
+
+      // builtins the compiler may replace by an inline opcode
+      struct primitive {
+        const char *name;
+        cell::funcp func;
+        int argc;
+        OP_CODE opcode;
+      };
+      static const primitive primitives[];
+      static const char *const opcode_names[];
+      // the VM running on this thread, the innermost if nested
+      static thread_local VM *current_;
+
+      // --profile, in a build with PROFILE defined: executions of each
+      // opcode, the cycles from it to the next instruction, so time in
+      // builtins counts to APPLY, and how often each opcode follows
+      // another
+      struct profile {
+        static const int NOPS = OP_VSET3 + 1;
+        unsigned long count_[NOPS];
+        unsigned long long cycles_[NOPS];
+        unsigned long pairs_[NOPS][NOPS];
+        int last_;
+        unsigned long long since_;
+
+        profile() : last_(0), since_(0) {
+          memset(count_, 0, sizeof(count_));
+          memset(cycles_, 0, sizeof(cycles_));
+          memset(pairs_, 0, sizeof(pairs_));
+        }
+
+        static unsigned long long now(){
+#if defined(__x86_64__) || defined(__i386__)
+          return __builtin_ia32_rdtsc();
+#else
+          return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+        }
+
+        // a run from the top level, not one a builtin called back
+        void start(){ last_ = 0; }
+
+        void step(int op){
+          unsigned long long t = now();
+          if(last_ != 0){
+            cycles_[last_] += t - since_;
+            pairs_[last_][op]++;
+          }
+          count_[op]++;
+          last_ = op;
+          since_ = t;
+        }
+
+        void print(std::ostream &os) const {
+          unsigned long total = 0;
+          unsigned long long total_cycles = 0;
+          std::vector<int> ops;
+          for(int op = 1; op < NOPS; op++){
+            total += count_[op];
+            total_cycles += cycles_[op];
+            if(count_[op] != 0) ops.push_back(op);
+          }
+          if(total == 0) return;
+          std::sort(ops.begin(), ops.end(), [this](int a, int b){
+              return cycles_[a] > cycles_[b];
+            });
+          char buf[128];
+          snprintf(buf, sizeof(buf), "%-10s %14s %6s %16s %6s %9s\n",
+                   "opcode", "count", "%", "cycles", "%", "cycles/op");
+          os << buf;
+          for(size_t i = 0; i < ops.size(); i++){
+            int op = ops[i];
+            snprintf(buf, sizeof(buf), "%-10s %14lu %6.2f %16llu %6.2f %9.1f\n",
+                     opcode_names[op], count_[op], 100.0 * count_[op] / total,
+                     cycles_[op],
+                     total_cycles ? 100.0 * cycles_[op] / total_cycles : 0.0,
+                     static_cast<double>(cycles_[op]) / count_[op]);
+            os << buf;
+          }
+
+          std::vector<std::pair<int, int> > pairs;
+          for(int a = 1; a < NOPS; a++)
+            for(int b = 1; b < NOPS; b++)
+              if(pairs_[a][b] != 0) pairs.push_back(std::make_pair(a, b));
+          std::sort(pairs.begin(), pairs.end(),
+                    [this](const std::pair<int, int> &x,
+                           const std::pair<int, int> &y){
+              return pairs_[x.first][x.second] > pairs_[y.first][y.second];
+            });
+          if(pairs.size() > 20) pairs.resize(20);
+          snprintf(buf, sizeof(buf), "\n%-21s %14s %6s\n", "pair", "count", "%");
+          os << buf;
+          for(size_t i = 0; i < pairs.size(); i++){
+            int a = pairs[i].first, b = pairs[i].second;
+            std::string name = std::string(opcode_names[a]) + " " + opcode_names[b];
+            snprintf(buf, sizeof(buf), "%-21s %14lu %6.2f\n", name.c_str(),
+                     pairs_[a][b], 100.0 * pairs_[a][b] / total);
+            os << buf;
+          }
+        }
+      };
+
+      // --sample: each SIGPROF tick asks for a sample at the next APPLY
+      // or JUMP, the procedure running then and those its frames on the
+      // stack return to.  Samples are counted per stack and written as
+      // folded stacks, "main;loop;f 12", for flamegraph tools.  Tail
+      // calls leave no frame, and the stack ends at a builtin that calls
+      // back into the VM.
+      struct sampler {
+        static volatile std::sig_atomic_t due_;
+        static const size_t MAX_DEPTH = 256;
+        // instruction -> name of the procedure it is part of
+        cell_manager::ephemeron_map owner_;
+        std::unordered_map<std::string, unsigned long> stacks_;
+        struct sigaction old_action_;
+        const source_map &sources_;
+
+        static void tick(int){ due_ = 1; }
+
+        sampler(long interval_us, const source_map &sources)
+          : sources_(sources) {
+          cell_manager::get_instance().add_ephemerons(&owner_);
+          struct sigaction sa;
+          memset(&sa, 0, sizeof(sa));
+          sa.sa_handler = tick;
+          sa.sa_flags = SA_RESTART;
+          sigemptyset(&sa.sa_mask);
+          sigaction(SIGPROF, &sa, &old_action_);
+          struct itimerval it;
+          it.it_interval.tv_sec = interval_us / 1000000;
+          it.it_interval.tv_usec = interval_us % 1000000;
+          it.it_value = it.it_interval;
+          setitimer(ITIMER_PROF, &it, NULL);
+        }
+
+        ~sampler(){
+          struct itimerval it;
+          memset(&it, 0, sizeof(it));
+          setitimer(ITIMER_PROF, &it, NULL);
+          sigaction(SIGPROF, &old_action_, NULL);
+          due_ = 0;
+          cell_manager::get_instance().remove_ephemerons(&owner_);
+        }
+
+        // A lambda is named after the variable it is defined as or
+        // assigned to first, else after the procedure it is in, and
+        // followed by where it is.
+        obj lambda_name(obj close, obj name){
+          obj next = cadddr(close);
+          std::string s;
+          if(next->ispair() && (car(next)->ivalue() == OP_DEFINE
+                                || car(next)->ivalue() == OP_ASSIGN))
+            s = cadr(next)->str();
+          else
+            s = std::string(name->str()) + "/lambda";
+          uint64_t loc = sources_.find(close);
+          if(loc != 0) s += " (" + sources_.describe(loc) + ")";
+          return mk_symbol(s.c_str());
+        }
+
+        // the instructions of code, owned by name, and of the lambdas in it
+        void index(obj code, obj name){
+          std::vector<std::pair<obj, obj> > todo;
+          todo.push_back(std::make_pair(code, name));
+          while(!todo.empty()){
+            obj c = todo.back().first;
+            obj n = todo.back().second;
+            todo.pop_back();
+            if(!c->ispair() || owner_.count(c) != 0) continue;
+            owner_[c] = n;
+            switch(car(c)->ivalue()){
+            case OP_CLOSE:
+              todo.push_back(std::make_pair(cadddr(c), n));
+              todo.push_back(std::make_pair(caddr(c), lambda_name(c, n)));
+              break;
+            case OP_TEST:
+            case OP_FRAME:
+              todo.push_back(std::make_pair(cadr(c), n));
+              todo.push_back(std::make_pair(caddr(c), n));
+              break;
+            case OP_REFER: case OP_CONSTANT: case OP_ASSIGN: case OP_DEFINE:
+            case OP_LEAVE:
+              todo.push_back(std::make_pair(caddr(c), n));
+              break;
+            case OP_CONTI: case OP_ARGUMENT: case OP_PUSH: case OP_ADD2:
+            case OP_SUB2: case OP_NUMEQ: case OP_CAR1: case OP_CDR1:
+            case OP_CONS2: case OP_NULLP: case OP_EQ: case OP_APPEND2:
+            case OP_CONTI1: case OP_VREF2: case OP_VSET3:
+              todo.push_back(std::make_pair(cadr(c), n));
+              break;
+            case OP_ENTER:
+              todo.push_back(std::make_pair(cadddr(c), n));
+              break;
+            case OP_JUMP:
+              todo.push_back(std::make_pair(car(cddddr(c)), n));
+              break;
+            default:
+              break;
+            }
+          }
+        }
+
+        const char *name_of(obj code){
+          if(car(code)->ivalue() == OP_EXIT1) code = caddr(code);
+          cell_manager::ephemeron_map::iterator it = owner_.find(code);
+          return it == owner_.end() ? "?" : it->second->str();
+        }
+
+        // names innermost first
+        void add(const std::vector<const char *> &names, bool truncated){
+          std::string folded = truncated ? "..." : "";
+          for(size_t i = names.size(); i > 0; i--){
+            if(!folded.empty()) folded += ';';
+            folded += names[i - 1];
+          }
+          stacks_[folded]++;
+        }
+
+        void write(const char *path) const {
+          FILE *fp = fopen(path, "w");
+          if(fp == NULL)
+            throw std::logic_error(std::string("sample: can't write ") + path);
+          std::unordered_map<std::string, unsigned long>::const_iterator it;
+          for(it = stacks_.begin(); it != stacks_.end(); ++it)
+            fprintf(fp, "%s %lu\n", it->first.c_str(), it->second);
+          if(fclose(fp) != 0)
+            throw std::logic_error(std::string("sample: can't write ") + path);
+        }
+      };
+
+      // The stack is a chain of segments.  The live one is [stack_base_,
+      // sp_) in the chunk stack_chunk_; the frames below it are the
+      // continuation link_, a list of frozen pieces
+      // (chunk start+length depth . parent), where depth counts the
+      // words of the piece and all below it.  call/cc only freezes the
+      // live segment, and a reinstated continuation is copied back
+      // UNDERFLOW_WORDS at a time as the stack pops below its base.
+      static const size_t SEGMENT_SIZE = 1 << 16;
+      static const size_t NESTED_SEGMENT_SIZE = 1 << 10;
+      static const size_t UNDERFLOW_WORDS = 64;
+      static const size_t MAX_STACK_WORDS = 1 << 24;
+
+      static const size_t INLINE_SIZE = 16;
+
+    public:
+      // The globals, macros and inlining candidates, shared by the VMs
+      // of contexts on one heap.  An update links a new head in front or
+      // unlinks a pair, a single store made under lock_, so lookups take
+      // no lock.
+      struct globals {
+        obj genv_;
+        obj syntax_;
+        // name -> lambda of top level procedures small enough to inline
+        obj inlines_;
+        std::mutex lock_;
+        // where the forms read by the repl and eval came from, and the
+        // instructions that may fail or make a closure; it takes lock_
+        source_map sources_;
+
+        // a list head read without the lock, and a new one written after
+        // the pairs it leads to
+        static obj head(obj &list){
+          return __atomic_load_n(&list, __ATOMIC_ACQUIRE);
+        }
+        static void publish(obj &list, obj entry){
+          __atomic_store_n(&list, entry, __ATOMIC_RELEASE);
+        }
+
+        globals()
+          : genv_(cell::NIL), syntax_(cell::NIL), inlines_(cell::NIL),
+            sources_(lock_) {
+          cell_manager &cm = cell_manager::get_instance();
+          cm.add_root(&genv_);
+          cm.add_root(&syntax_);
+          cm.add_root(&inlines_);
+        }
+        ~globals(){
+          cell_manager &cm = cell_manager::get_instance();
+          cm.remove_root(&genv_);
+          cm.remove_root(&syntax_);
+          cm.remove_root(&inlines_);
+        }
+      };
+
+    private:
+      std::shared_ptr<globals> globals_;
+      obj &genv_;
+      obj &syntax_;
+      obj &inlines_;
+      unsigned optimizations_;
+      // variables assigned in the form being optimized
+      std::vector<obj> assigned_;
+      // named lets and do loops being compiled, innermost first
+      obj loops_;
+      // an equal table of call-site form -> (transformer form . expansion)
+      obj expansions_;
+      unsigned long expand_hits_;
+      unsigned long expand_misses_;
+      std::chrono::steady_clock::duration expand_time_;
+      // instructions run
+      unsigned long instructions_;
+      // limits on an evaluation, 0 for none, see set_limits
+      unsigned long max_instructions_;
+      size_t max_cells_;
+      std::chrono::milliseconds max_time_;
+      // what the evaluation in progress has left, if it has limits, and
+      // the part of its instructions drawn here; the instructions between
+      // looks at the clock
+      std::shared_ptr<limits> limits_;
+      unsigned long fuel_;
+      unsigned long slice_;
+      std::chrono::steady_clock::time_point deadline_;
+      // the cancel_ of the future a worker is running
+      const std::atomic<bool> *cancel_;
+      // the futures made by the evaluation or future in progress, if it
+      // has limits, which are settled before it ends
+      obj spawned_;
+      std::unique_ptr<profile> profile_;
+      std::unique_ptr<sampler> sampler_;
+      // the sources_ of globals_
+      source_map &sources_;
+      // the innermost form being compiled that has a location
+      uint64_t where_;
+      // operand stack
+      obj stack_chunk_;
+      obj link_;
+      obj *stack_base_;
+      obj *stack_limit_;
+      obj *sp_;
+      // runs in progress, more than one while a builtin calls back
+      int depth_;
+      // the workers futures run on, started by the first future of the
+      // VM that owns them; the VMs of the workers share them
+      worker_pool *pool_;
+      bool own_pool_;
+      static unsigned workers_;
+      // Green threads, switched in the run of depth 1.  Each is a record
+      // (k . value): one put aside has its frames in k, a continuation
+      // as link_ holds, and goes on with value; k is #t while it runs
+      // and #f once it has ended.  A new one's k applies the thunk in
+      // value.  The main thread is the evaluation itself, and #t until
+      // it first needs a record.
+      obj ready_;           // the records to run, oldest first
+      obj ready_last_;
+      obj running_;
+      obj main_;            // () once the main thread has ended
+      obj main_value_;
+      obj thread_end_;      // the code a thread's thunk returns to
+      obj thread_start_;    // k of a new thread
+      obj evaluation_end_;  // k returning the main value to a HALT
+      // instructions left to the running thread before it is switched
+      // out, unlimited while no other one is ready
+      unsigned long quantum_;
+
+      VM(const VM &vm);
+      void stop_pool();
+
+      void push(obj c){
+        if(sp_ == stack_limit_) grow();
+        *sp_++ = c;
+      }
+
+      obj pop(){
+        if(sp_ == stack_base_) refill(1);
+        return *--sp_;
+      }
+
+      // start and length share a fixnum, start in the high half
+      static obj piece_chunk(obj piece){ return car(piece); }
+      static size_t piece_start(obj piece){ return cadr(piece)->fixnum() >> 32; }
+      static size_t piece_length(obj piece){
+        return cadr(piece)->fixnum() & 0xffffffff;
+      }
+      static size_t piece_depth(obj piece){
+        return piece == cell::NIL ? 0 : caddr(piece)->fixnum();
+      }
+      static obj piece_parent(obj piece){ return cdddr(piece); }
+
+      static obj make_piece(obj chunk, size_t start, size_t len, obj parent){
+        return cons(chunk,
+                    cons(mk_number(static_cast<long>(start << 32 | len)),
+                         cons(mk_number(len + piece_depth(parent)), parent)));
+      }
+
+      // moves the live segment into link_, leaving it empty
+      void freeze(){
+        size_t used = sp_ - stack_base_;
+        if(used == 0) return;
+        size_t start = stack_base_ - stack_chunk_->data();
+        link_ = make_piece(stack_chunk_, start, used, link_);
+        stack_chunk_->freeze(start + used);
+        stack_base_ = sp_;
+      }
+
+      void new_segment(size_t capacity){
+        obj chunk = mk_stack_chunk(capacity);
+        stack_chunk_ = chunk;
+        stack_base_ = sp_ = chunk->data();
+        stack_limit_ = stack_base_ + capacity;
+      }
+
+      void grow(){
+        freeze();
+        if(piece_depth(link_) > MAX_STACK_WORDS)
+          throw std::logic_error("Stack overflow");
+        new_segment(SEGMENT_SIZE);
+      }
+
+      // pulls words of link_ into the live segment until it holds n
+      void refill(size_t n){
+        while(static_cast<size_t>(sp_ - stack_base_) < n){
+          if(link_ == cell::NIL) throw std::logic_error("Stack underflow");
+          size_t have = sp_ - stack_base_;
+          obj piece = link_;
+          size_t len = piece_length(piece);
+          size_t take = std::min(len, std::max(n - have, size_t(UNDERFLOW_WORDS)));
+          if(sp_ + take > stack_limit_){
+            obj *old = stack_base_;
+            new_segment(std::max(size_t(SEGMENT_SIZE), 2 * (have + take)));
+            memcpy(stack_base_, old, have * sizeof(obj));
+            sp_ = stack_base_ + have;
+          }
+          obj chunk = piece_chunk(piece);
+          size_t start = piece_start(piece);
+          obj rest = take == len ? piece_parent(piece)
+            : make_piece(chunk, start, len - take, piece_parent(piece));
+          memmove(stack_base_ + take, stack_base_, have * sizeof(obj));
+          memcpy(stack_base_, chunk->data() + start + len - take,
+                 take * sizeof(obj));
+          sp_ += take;
+          link_ = rest;
+        }
+      }
+
+      size_t stack_depth() const {
+        return piece_depth(link_) + (sp_ - stack_base_);
+      }
+
+      // A call/1cc frame returns through (EXIT1 k ret), and k is
+      // (live depth marker): the frame ends depth words from the bottom
+      // of the stack and its return code is marker.  Positions from the
+      // bottom survive freezing and refilling, so if that frame is still
+      // part of the current continuation the stack is cut just above it.
+      bool escape_to(obj k){
+        size_t top = cadr(k)->fixnum();
+        obj marker = caddr(k);
+        size_t below = piece_depth(link_);
+        if(top >= below + 2){
+          obj *p = stack_base_ + (top - below);
+          if(p > sp_ || p[-2] != marker) return false;
+          sp_ = p;
+          return true;
+        }
+        for(obj piece = link_; piece != cell::NIL;
+            piece = piece_parent(piece)){
+          size_t base = piece_depth(piece_parent(piece));
+          if(top - 2 < base) continue;
+          obj chunk = piece_chunk(piece);
+          size_t start = piece_start(piece);
+          if(chunk->data()[start + top - 2 - base] != marker) return false;
+          // the frame was frozen whole and frozen words never change,
+          // so the piece can be cut at top even if it was split below it
+          link_ = make_piece(chunk, start, top - base, piece_parent(piece));
+          sp_ = stack_base_;
+          return true;
+        }
+        return false;
+      }
+
+      std::vector<obj *> thread_roots(){
+        return std::vector<obj *>{ &ready_, &ready_last_, &running_, &main_,
+                                   &main_value_, &thread_end_, &thread_start_,
+                                   &evaluation_end_ };
+      }
+
+      // a continuation of n words from words, bottom first, over parent
+      static obj copy_frames(const obj *words, size_t n, obj parent){
+        obj chunk = mk_stack_chunk(n);
+        memcpy(chunk->data(), words, n * sizeof(obj));
+        chunk->freeze(n);
+        return make_piece(chunk, 0, n, parent);
+      }
+
+      // the bottom of the free part of the current chunk
+      obj *free_base() const {
+        return stack_chunk_->data() + stack_chunk_->size();
+      }
+
+      // Puts the running thread aside, to go on with value.  Its live
+      // words are copied out, so that the segment is used again and a
+      // waiting thread keeps only the words of its own frames.
+      void park(obj value){
+        obj k = link_;
+        if(sp_ > stack_base_)
+          k = copy_frames(stack_base_, sp_ - stack_base_, link_);
+        obj t = record();
+        set_car(t, k);
+        set_cdr(t, value);
+      }
+
+      obj record(){
+        if(running_ == cell::T) main_ = running_ = cons(cell::T, cell::NIL);
+        return running_;
+      }
+
+      bool spawned_running() const {
+        return running_->ispair() && running_ != main_;
+      }
+
+      void make_ready(obj t){
+        enqueue(ready_, ready_last_, t);
+        if(quantum_ > THREAD_SLICE) quantum_ = THREAD_SLICE;
+      }
+
+      // Makes the first ready thread the running one: the live segment
+      // starts at base, empty, over its frames, and the value it goes on
+      // with is returned.  With none ready the evaluation ends, if its
+      // main thread has.
+      obj next_thread(obj *base){
+        sp_ = stack_base_ = base;
+        while(ready_ != cell::NIL){
+          obj t = dequeue(ready_);
+          if(car(t) == cell::F) continue;
+          obj value = cdr(t);
+          link_ = car(t);
+          set_car(t, cell::T);
+          set_cdr(t, cell::NIL);
+          running_ = t;
+          quantum_ = ready_ == cell::NIL ? ULONG_MAX : THREAD_SLICE;
+          return value;
+        }
+        quantum_ = ULONG_MAX;
+        if(main_ != cell::NIL)
+          throw std::logic_error("deadlock: every thread is waiting");
+        obj value = main_value_;
+        link_ = evaluation_end_;
+        running_ = main_value_ = cell::NIL;
+        return value;
+      }
+
+      // At a HALT: the running thread has ended with value
+      obj end_thread(bool main, obj value){
+        if(main){
+          main_value_ = value;
+          main_ = cell::NIL;
+        }
+        if(running_ != cell::T) set_car(running_, cell::F);
+        return next_thread(free_base());
+      }
+
+      // At a call or a jump, once the quantum is used up: the running
+      // thread goes after the ready ones, to go on with the instruction
+      // it was at.  Only the run of depth 1 switches.
+      bool preempt(obj &acc, obj &env, obj &code){
+        if(depth_ != 1 || ready_ == cell::NIL){
+          quantum_ = ready_ == cell::NIL ? ULONG_MAX : THREAD_SLICE;
+          return false;
+        }
+        push_frame(code, env);
+        park(acc);
+        make_ready(running_);
+        acc = next_thread(free_base());
+        env = pop();
+        code = pop();
+        return true;
+      }
+
+      void define(obj var, obj val, obj *genv){
+        obj frame = cons(cons(list(var), list(val)), cell::NIL);
+        std::lock_guard<std::mutex> hold(globals_->lock_);
+        set_cdr(frame, *genv);
+        globals::publish(*genv, frame);
+      }
+
+      void define(const char *sym, obj val, obj *genv){
+        define(mk_symbol(sym), val, genv);
+      }
+
+      void define(const char *sym, int num, obj *genv){
+        define(mk_symbol(sym), mk_number(num), genv);
+      }
+
+      void define(const char *sym, const char *str,obj* genv){
+        define(mk_symbol(sym), mk_string(str), genv);
+      }
+
+      void define(const char *sym, const native_proc *proc, obj* genv){
+        define(mk_symbol(sym), mk_proc(proc), genv);
+      }
+
+      // vars are the parameters of a lambda: a list, a dotted list or a
+      // single symbol
+      bool isbound(obj sym, obj scope){
+        for(; scope != cell::NIL; scope = cdr(scope)){
+          obj vars = car(scope);
+          for(; vars->ispair(); vars = cdr(vars)){
+            if(car(vars) == sym) return true;
+          }
+          if(vars == sym) return true;
+        }
+        return false;
+      }
+
+      // The primitive called by code, if it may be inlined: the operator
+      // is neither lexically shadowed nor globally redefined at this
+      // point, and the argument count fits.  Redefinitions after the
+      // call site was compiled are not seen, as in most compilers.
+      const primitive *inline_primitive(obj code, obj scope){
+        obj op = car(code);
+        if(!op->issymbol()) return NULL;
+        int argc = 0;
+        for(obj args = cdr(code); args->ispair(); args = cdr(args)) argc++;
+        for(const primitive *prim = primitives; prim->name != NULL; prim++){
+          if(prim->argc != argc || strcmp(prim->name, op->str()) != 0)
+            continue;
+          if(isbound(op, scope)) return NULL;
+          obj val = car(_lookup(op, globals::head(genv_)));
+          if(!val->isproc() || val->func() != prim->func) return NULL;
+          return prim;
+        }
+        return NULL;
+      }
+
+      obj extend(obj env, obj vars, obj vals){
+        return cons(cons(vars, vals), env);
+      }
+      // a call frame is the return code and env, pushed in that order
+      void push_frame(obj code, obj env){
+        push(code);
+        push(env);
+      }
+
+      obj closure(obj body, obj env, obj vars){
+        return list(body, env, vars);
+      }
+
+      obj _lookup(obj var, obj env){
+        obj e = env;
+        while(e != cell::NIL){
+          obj vars = caar(e);
+          obj vals = cdar(e);
+          while(vars != cell::NIL){
+            if(vars->issymbol()){
+              // rest parameter: its list is the last element of vals
+              if(vars == var)
+                return vals;
+              break;
+            }
+            if(car(vars) == var)
+              return vals;
+            vars = cdr(vars);
+            vals = cdr(vals);
+          }
+          e = cdr(e);
+        }
+        return cell::NIL;
+      }
+
+      obj lookup(obj var, obj env, obj *genv){
+        obj found = _lookup(var, env);
+        if(found != cell::NIL)
+          return found;
+        return _lookup(var, globals::head(*genv));
+      }
+
+      obj assoc_lookup(obj lst, obj key){
+        while(lst != cell::NIL){
+          if(caar(lst) == key){
+            return cdar(lst);
+          }
+          lst = cdr(lst);
+        }
+        return cell::NIL;
+      }
+
+      // Expansions are cached per call-site form along with the
+      // transformer that made them, so a form compiled again, or one
+      // equal to it (a file loaded again, a form eval builds in a
+      // loop), is expanded once; rebinding the keyword with
+      // define-syntax invalidates the entry.  An equal form gets the
+      // expansion of the first, whose lists take its locations.  The
+      // table starts over once it holds EXPANSIONS_MAX forms.
+      static const size_t EXPANSIONS_MAX = 1 << 14;
+
+      obj expand_macro(obj rules, obj form){
+        obj entry = table_ref(expansions_, form);
+        if(entry != NULL && car(entry) == rules){
+          expand_hits_++;
+          if(cadr(entry) != form) move_locations(cadr(entry), form);
+          return cddr(entry);
+        }
+        expand_misses_++;
+        std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+        obj expanded = SyntaxRules::expand_form(rules, form);
+        expand_time_ += std::chrono::steady_clock::now() - start;
+        if(expansions_->table()->count_ >= EXPANSIONS_MAX)
+          expansions_ = mk_table(hash_table::EQUAL);
+        table_set(expansions_, form, cons(rules, cons(form, expanded)));
+        return expanded;
+      }
+
+      // the lists of to, equal to from, are where those of from are
+      void move_locations(obj to, obj from){
+        if(to == from) return;
+        uint64_t loc = sources_.find(from);
+        if(loc != 0 || sources_.find(to) != 0) sources_.move(to, loc);
+        for(; to->ispair(); to = cdr(to), from = cdr(from))
+          if(car(to)->ispair()) move_locations(car(to), car(from));
+      }
+
+      // the keyword of (quasiquote x), (unquote x) or (unquote-splicing x)
+      static const char *qq_form(obj tmpl){
+        if(!tmpl->ispair() || !car(tmpl)->issymbol()
+           || !cdr(tmpl)->ispair() || cddr(tmpl) != cell::NIL)
+          return NULL;
+        const char *name = car(tmpl)->str();
+        if(strcmp(name, "quasiquote") == 0 || strcmp(name, "unquote") == 0
+           || strcmp(name, "unquote-splicing") == 0)
+          return name;
+        return NULL;
+      }
+
+      // true if tmpl has no unquote at nesting level depth
+      static bool qq_constant(obj tmpl, int depth){
+        for(; tmpl->ispair(); tmpl = cdr(tmpl)){
+          const char *kw = qq_form(tmpl);
+          if(kw != NULL){
+            if(strcmp(kw, "quasiquote") == 0)
+              return qq_constant(cadr(tmpl), depth + 1);
+            return depth > 1 && qq_constant(cadr(tmpl), depth - 1);
+          }
+          if(!qq_constant(car(tmpl), depth)) return false;
+        }
+        if(tmpl->isvector()){
+          for(size_t i = 0; i < tmpl->size(); i++)
+            if(!qq_constant(tmpl->data()[i], depth)) return false;
+        }
+        return true;
+      }
+
+      // the builtin, whatever list->vector is bound to
+      static const native_proc *list_to_vector(){
+        // initialized once, whichever mutator compiles first
+        static const native_proc *const proc = builtin("list->vector");
+        return proc;
+      }
+
+      // Quasiquote is compiled to list construction in place: constant
+      // parts of the template become CONSTANT operands shared by every
+      // evaluation, and a list is built by pushing its elements and
+      // consing them onto its tail with CONS2, or APPEND2 for ,@
+      obj quasiquote(obj tmpl, int depth, obj scope, obj next, obj *syntax){
+        if(qq_constant(tmpl, depth))
+          return list(mk_opcode(OP_CONSTANT), tmpl, next);
+        if(tmpl->isvector()){
+          // #(e ...) is (list->vector `(e ...))
+          obj elems = cell::NIL;
+          for(size_t i = tmpl->size(); i-- > 0;)
+            elems = cons(tmpl->data()[i], elems);
+          obj c = list(mk_opcode(OP_CONSTANT), mk_proc(list_to_vector()),
+                       noted(list(mk_opcode(OP_APPLY), mk_number(1))));
+          c = quasiquote(elems, depth, scope, list(mk_opcode(OP_ARGUMENT), c),
+                         syntax);
+          if(car(next)->ivalue() == OP_RETURN)
+            return c;
+          return list(mk_opcode(OP_FRAME), next, c);
+        }
+        const char *kw = qq_form(tmpl);
+        if(kw != NULL){
+          if(depth == 1 && strcmp(kw, "unquote") == 0)
+            return compile(cadr(tmpl), scope, next, syntax);
+          if(depth == 1 && strcmp(kw, "unquote-splicing") == 0)
+            throw std::logic_error("unquote-splicing: not in a list");
+          // a nested level: (kw x) with x one level in or out
+          int inner = strcmp(kw, "quasiquote") == 0 ? depth + 1 : depth - 1;
+          obj c = list(mk_opcode(OP_CONS2), list(mk_opcode(OP_CONS2), next));
+          c = list(mk_opcode(OP_PUSH),
+                   list(mk_opcode(OP_CONSTANT), cell::NIL, c));
+          c = list(mk_opcode(OP_PUSH),
+                   quasiquote(cadr(tmpl), inner, scope, c, syntax));
+          return list(mk_opcode(OP_CONSTANT), car(tmpl), c);
+        }
+        // (e0 e1 ... . tail) where tail may be an unquote form
+        std::vector<obj> spine;
+        obj tail = tmpl;
+        do{
+          spine.push_back(tail);
+          tail = cdr(tail);
+        }while(tail->ispair() && qq_form(tail) == NULL);
+        // the longest constant suffix is a single constant
+        size_t n = spine.size();
+        if(qq_constant(tail, depth)){
+          while(n > 0 && qq_constant(car(spine[n - 1]), depth)) n--;
+          tail = n < spine.size() ? spine[n] : tail;
+        }
+        obj c = next;
+        for(size_t i = 0; i < n; i++){
+          const char *ekw = qq_form(car(spine[i]));
+          bool splice = depth == 1 && ekw != NULL
+            && strcmp(ekw, "unquote-splicing") == 0;
+          c = list(mk_opcode(splice ? OP_APPEND2 : OP_CONS2), c);
+        }
+        c = quasiquote(tail, depth, scope, c, syntax);
+        for(size_t i = n; i > 0; i--){
+          obj elem = car(spine[i - 1]);
+          const char *ekw = qq_form(elem);
+          c = list(mk_opcode(OP_PUSH), c);
+          if(depth == 1 && ekw != NULL
+             && strcmp(ekw, "unquote-splicing") == 0)
+            c = compile(cadr(elem), scope, c, syntax);
+          else
+            c = quasiquote(elem, depth, scope, c, syntax);
+        }
+        return c;
+      }
+
+      // Source-to-source passes run on each top level form before
+      // compile.  Macros are expanded first so the passes see through
+      // them; forms they don't know are left to compile as they are.
+
+      static bool isform(obj x, const char *name){
+        return x->ispair() && car(x)->issymbol()
+          && strcmp(car(x)->str(), name) == 0;
+      }
+
+      // a self-evaluating datum or (quote datum)
+      static bool isconstant(obj x){
+        if(x->ispair()) return isform(x, "quote") && cdr(x)->ispair();
+        return !x->issymbol();
+      }
+
+      static obj constant_value(obj x){
+        return x->ispair() ? cadr(x) : x;
+      }
+
+      static obj constant_form(obj value){
+        if(value->ispair() || value->issymbol())
+          return list(mk_symbol("quote"), value);
+        return value;
+      }
+
+      obj optimize_list(obj lst, obj scope){
+        // the optimized forms are new cells the stack doesn't hold
+        size_t n = 0;
+        for(obj l = lst; l->ispair(); l = cdr(l)) n++;
+        std::vector<obj> items(n, cell::NIL);
+        obj *items_end = items.data() + items.size();
+        scoped_root_range guard(items.data(), &items_end);
+        for(size_t i = 0; lst->ispair(); lst = cdr(lst), i++)
+          items[i] = optimize(car(lst), scope);
+        obj ret = lst;
+        for(size_t i = items.size(); i > 0; i--)
+          ret = cons(items[i - 1], ret);
+        return ret;
+      }
+
+      // a call of a pure builtin on constants becomes its value; errors
+      // such as (/ 1 0) are left for run time
+      obj fold(obj fn, obj args){
+        static const char *const pure[] = {
+          "+", "-", "*", "/", "quotient", "remainder", "modulo",
+          "=", "<", ">", "<=", ">=", "exact->inexact", "inexact->exact",
+          "car", "cdr", "null?", "eq?", NULL
+        };
+        const char *const *name = pure;
+        while(*name != NULL && strcmp(*name, fn->str()) != 0) name++;
+        if(*name == NULL) return NULL;
+        obj val = car(_lookup(fn, globals::head(genv_)));
+        if(!val->isproc() || val->proc()->func == NULL
+           || strcmp(val->proc()->name, *name) != 0)
+          return NULL;
+        std::vector<obj> argv;
+        for(; args->ispair(); args = cdr(args)){
+          if(!isconstant(car(args))) return NULL;
+          argv.push_back(constant_value(car(args)));
+        }
+        try{
+          check_arity(val->proc(), argv.size());
+          return constant_form(val->proc()->call(argv.data(), argv.size()));
+        }catch(std::exception &e){
+          return NULL;
+        }
+      }
+
+      static bool occurs(obj sym, obj x){
+        for(; x->ispair(); x = cdr(x)){
+          if(isform(x, "quote")) return false;
+          if(occurs(sym, car(x))) return true;
+        }
+        return x == sym;
+      }
+
+      static size_t form_size(obj x, size_t limit){
+        size_t n = 0;
+        for(; x->ispair() && n <= limit; x = cdr(x))
+          n += 1 + form_size(car(x), limit - n);
+        return n;
+      }
+
+      // true if a free variable of x other than vars is lexically bound
+      // in scope, where it would mean something else
+      bool captures(obj x, obj vars, obj scope){
+        if(x->issymbol())
+          return !occurs(x, vars) && isbound(x, scope);
+        for(; x->ispair(); x = cdr(x)){
+          if(isform(x, "quote")) return false;
+          if(captures(car(x), vars, scope)) return true;
+        }
+        return false;
+      }
+
+      void forget_inline(obj name){
+        std::lock_guard<std::mutex> hold(globals_->lock_);
+        obj prev = cell::NIL;
+        for(obj p = inlines_; p != cell::NIL; prev = p, p = cdr(p)){
+          if(caar(p) == name){
+            if(prev == cell::NIL) globals::publish(inlines_, cdr(p));
+            else set_cdr(prev, cdr(p));
+            return;
+          }
+        }
+      }
+
+      // (define name (lambda (var ...) expr)) at top level makes name a
+      // candidate for inlining if expr is small, doesn't refer to name
+      // and defines nothing
+      void note_definition(obj name, obj val){
+        forget_inline(name);
+        if(!isform(val, "lambda") || !cddr(val)->ispair()
+           || cdddr(val) != cell::NIL)
+          return;
+        obj vars = cadr(val);
+        for(; vars->ispair(); vars = cdr(vars))
+          if(!car(vars)->issymbol()) return;
+        obj body = caddr(val);
+        if(vars != cell::NIL || occurs(name, body)
+           || form_size(body, INLINE_SIZE) > INLINE_SIZE
+           || occurs(mk_symbol("define"), body)
+           || occurs(mk_symbol("set!"), body))
+          return;
+        obj entry = cons(cons(name, val), cell::NIL);
+        std::lock_guard<std::mutex> hold(globals_->lock_);
+        set_cdr(entry, inlines_);
+        globals::publish(inlines_, entry);
+      }
+
+      // The definition of fn to inline at this call, or NULL.  The
+      // inlined code checks that fn still holds the closure it has now,
+      // (eq? fn 'closure), and calls it otherwise.
+      obj inline_candidate(obj fn, obj args, obj scope, obj *guard){
+        obj lambda = assoc_lookup(globals::head(inlines_), fn);
+        if(lambda == cell::NIL) return NULL;
+        obj vars = cadr(lambda);
+        for(; vars->ispair() && args->ispair(); vars = cdr(vars))
+          args = cdr(args);
+        if(vars != cell::NIL || args != cell::NIL) return NULL;
+        obj eq = mk_symbol("eq?");
+        obj closure = car(_lookup(fn, globals::head(genv_)));
+        obj eq_proc = car(_lookup(eq, globals::head(genv_)));
+        if(!closure->ispair() || !eq_proc->isproc()
+           || eq_proc->func() != OP_IS_EQ || isbound(eq, scope)
+           || occurs(eq, cadr(lambda)) || occurs(fn, cadr(lambda))
+           || captures(caddr(lambda), cadr(lambda), scope))
+          return NULL;
+        *guard = list(eq, fn, list(mk_symbol("quote"), closure));
+        return lambda;
+      }
+
+      // every set! target in x
+      static void collect_assigned(obj x, std::vector<obj> &assigned){
+        for(; x->ispair(); x = cdr(x)){
+          if(isform(x, "quote")) return;
+          if(isform(x, "set!") && cdr(x)->ispair())
+            assigned.push_back(cadr(x));
+          collect_assigned(car(x), assigned);
+        }
+      }
+
+      // An argument can replace its variable in the inlined body if
+      // reading it later gives the same value: a constant, or a local
+      // variable that nothing in the form assigns to.
+      bool substitutable(obj arg, obj scope){
+        if(isconstant(arg)) return true;
+        return arg->issymbol() && isbound(arg, scope)
+          && std::find(assigned_.begin(), assigned_.end(), arg)
+             == assigned_.end();
+      }
+
+      static obj substitute(obj x, obj vars, obj args){
+        if(x->issymbol()){
+          for(; vars->ispair(); vars = cdr(vars), args = cdr(args))
+            if(car(vars) == x) return car(args);
+          return x;
+        }
+        if(!x->ispair() || isform(x, "quote")) return x;
+        return cons(substitute(car(x), vars, args),
+                    substitute(cdr(x), vars, args));
+      }
+
+      // let, let*, letrec and do with each part optimized in the scope it
+      // is evaluated in; malformed ones are left for compile to report
+      obj optimize_binding(obj x, obj scope){
+        obj op = car(x), rest = cdr(x), name = NULL;
+        const char *kind = op->str();
+        if(strcmp(kind, "let") == 0 && rest->ispair() && car(rest)->issymbol()){
+          name = car(rest);
+          rest = cdr(rest);
+        }
+        if(!rest->ispair()) return x;
+        std::vector<obj> bindings;
+        obj vars = cell::NIL;
+        for(obj b = car(rest); b->ispair(); b = cdr(b)){
+          if(!car(b)->ispair() || !caar(b)->issymbol() || !cdar(b)->ispair())
+            return x;
+          bindings.push_back(car(b));
+          vars = cons(caar(b), vars);
+        }
+        bool sequential = strcmp(kind, "let*") == 0;
+        bool recursive = strncmp(kind, "letrec", 6) == 0;
+        obj inner = cons(vars, name != NULL ? cons(list(name), scope) : scope);
+        obj init_scope = recursive ? inner : scope;
+        obj optimized = cell::NIL;
+        for(size_t i = 0; i < bindings.size(); i++){
+          obj b = bindings[i];
+          obj v = optimize(cadr(b), init_scope);
+          optimized = cons(cons(car(b), cons(v, optimize_list(cddr(b), inner))),
+                           optimized);
+          if(sequential) init_scope = cons(list(car(b)), init_scope);
+        }
+        optimized = nreverse(optimized);
+        obj body = cdr(rest);
+        if(strcmp(kind, "do") == 0 && body->ispair())
+          body = cons(optimize_list(car(body), inner),
+                      optimize_list(cdr(body), inner));
+        else
+          body = optimize_list(body, sequential ? init_scope : inner);
+        body = cons(optimized, body);
+        return cons(op, name != NULL ? cons(name, body) : body);
+      }
+
+      // a form rewritten keeps the location of the one it came from
+      obj optimize(obj x, obj scope){
+        obj y = optimize_form(x, scope);
+        if(y != x && y->ispair()) sources_.note(y, sources_.find(x));
+        return y;
+      }
+
+      obj optimize_form(obj x, obj scope){
+        if(!x->ispair()) return x;
+        obj op = car(x);
+        if(op->issymbol()){
+          const char *name = op->str();
+          obj rules;
+          if(strcmp(name, "quote") == 0 || strcmp(name, "quasiquote") == 0
+             || strcmp(name, "define-syntax") == 0){
+            return x;
+          }else if(strcmp(name, "lambda") == 0){
+            return cons(op, cons(cadr(x), optimize_list(cddr(x),
+                                                        cons(cadr(x), scope))));
+          }else if(strcmp(name, "let") == 0 || strcmp(name, "let*") == 0
+                   || strcmp(name, "letrec") == 0
+                   || strcmp(name, "letrec*") == 0
+                   || strcmp(name, "do") == 0){
+            return optimize_binding(x, scope);
+          }else if(strcmp(name, "if") == 0){
+            obj test = optimize(cadr(x), scope);
+            // only #t selects the consequent, as in OP_TEST
+            if((optimizations_ & OPT_IF) && isconstant(test))
+              return optimize(constant_value(test) == cell::T
+                              ? caddr(x) : cadddr(x), scope);
+            return cons(op, cons(test, optimize_list(cddr(x), scope)));
+          }else if(strcmp(name, "define") == 0){
+            obj var = cadr(x), val;
+            if(var->ispair()){
+              val = optimize(cons(mk_symbol("lambda"),
+                                  cons(cdr(var), cddr(x))), scope);
+              var = car(var);
+            }else{
+              val = optimize(caddr(x), scope);
+            }
+            if(scope == cell::NIL) forget_inline(var);
+            return list(op, var, val);
+          }else if(strcmp(name, "set!") == 0){
+            if(!isbound(cadr(x), scope)) forget_inline(cadr(x));
+            return list(op, cadr(x), optimize(caddr(x), scope));
+          }else if(strcmp(name, "call/cc") == 0
+                   || strcmp(name, "call/1cc") == 0){
+            return list(op, optimize(cadr(x), scope));
+          }else if((rules = assoc_lookup(globals::head(syntax_), op)) != cell::NIL){
+            return optimize(expand_macro(rules, x), scope);
+          }
+        }
+        obj args = optimize_list(cdr(x), scope);
+        obj fn = optimize(op, scope);
+        if(fn->issymbol() && !isbound(fn, scope)){
+          obj folded, lambda, guard;
+          if((optimizations_ & OPT_FOLD) && (folded = fold(fn, args)) != NULL)
+            return folded;
+          if((optimizations_ & OPT_INLINE)
+             && (lambda = inline_candidate(fn, args, scope, &guard)) != NULL){
+            obj vars = cadr(lambda), body = caddr(lambda);
+            // the body is already expanded; templates and binding forms
+            // are left to the call
+            static const char *const binders[] = {
+              "lambda", "let", "let*", "letrec", "letrec*", "do",
+              "quasiquote", "define-syntax", NULL
+            };
+            bool simple = true;
+            for(const char *const *b = binders; simple && *b != NULL; b++)
+              simple = !occurs(mk_symbol(*b), body);
+            for(obj a = args; simple && a->ispair(); a = cdr(a))
+              simple = substitutable(car(a), scope);
+            // (if guard body[vars := args] (fn arg ...)) or else
+            // ((lambda (var ...) (if guard body (fn var ...))) arg ...)
+            if(simple)
+              return list(mk_symbol("if"), guard,
+                          optimize(substitute(body, vars, args), scope),
+                          cons(fn, args));
+            fn = list(car(lambda), vars,
+                      list(mk_symbol("if"), guard, body, cons(fn, vars)));
+          }
+        }
+        return cons(fn, args);
+      }
+
+      obj optimize_toplevel(obj x){
+        if(!(optimizations_ & (OPT_FOLD | OPT_IF | OPT_INLINE))) return x;
+        assigned_.clear();
+        collect_assigned(x, assigned_);
+        x = optimize(x, cell::NIL);
+        if(isform(x, "define") && (optimizations_ & OPT_INLINE))
+          note_definition(cadr(x), caddr(x));
+        return x;
+      }
+
+      // ((lambda vars body ...) arg ...) with the right number of args
+      static bool isdirect_lambda(obj fn, size_t argc){
+        if(!isform(fn, "lambda") || !cdr(fn)->ispair()) return false;
+        size_t nfixed = 0;
+        obj vars = cadr(fn);
+        for(; vars->ispair(); vars = cdr(vars)) nfixed++;
+        return vars->issymbol() ? argc >= nfixed
+          : vars == cell::NIL && argc == nfixed;
+      }
+
+      // exps in order, the value of the last one going on to next
+      obj compile_seq(obj exps, obj scope, obj next, obj *syntax){
+        // compiled back to front; the source is left intact since
+        // macro expansions share their constant parts
+        std::vector<obj> seq;
+        for(; exps->ispair(); exps = cdr(exps))
+          seq.push_back(car(exps));
+        for(size_t i = seq.size(); i > 0; i--)
+          next = compile(seq[i - 1], scope, next, syntax);
+        return next;
+      }
+
+      // the body of a lambda, returning at the end
+      obj compile_body(obj exps, obj scope, obj *syntax){
+        return compile_seq(exps, scope, list(mk_opcode(OP_RETURN)), syntax);
+      }
+
+      // drops the n innermost frames of env before next, unless next
+      // returns and restores env anyway
+      static obj leave(int n, obj next){
+        int op = car(next)->ivalue();
+        if(op == OP_RETURN || op == OP_HALT) return next;
+        return list(mk_opcode(OP_LEAVE), mk_number(n), next);
+      }
+
+      // The let family binds in place: the inits are pushed like
+      // arguments, ENTER extends env with them and the body is followed
+      // by LEAVE.  There is no closure and no call frame.
+      //
+      //   init ... ENTER vars n body ... LEAVE 1 next
+      obj compile_enter(obj vars, const std::vector<obj> &inits, obj body,
+                        obj scope, obj next, obj *syntax){
+        obj c = list(mk_opcode(OP_ENTER), vars, mk_number(inits.size()),
+                     compile_seq(body, cons(vars, scope), leave(1, next),
+                                 syntax));
+        for(size_t i = inits.size(); i > 0; i--)
+          c = compile(inits[i - 1], scope, list(mk_opcode(OP_ARGUMENT), c),
+                      syntax);
+        return c;
+      }
+
+      // ((var init . rest) ...) of form into vars (as a list) and inits
+      static obj parse_bindings(obj bindings, const char *form,
+                                std::vector<obj> &inits,
+                                std::vector<obj> *rests = NULL){
+        std::vector<obj> vars;
+        for(; bindings->ispair(); bindings = cdr(bindings)){
+          obj b = car(bindings);
+          if(!b->ispair() || !car(b)->issymbol() || !cdr(b)->ispair())
+            throw std::logic_error(string(form) + ": bad binding");
+          vars.push_back(car(b));
+          inits.push_back(cadr(b));
+          if(rests != NULL) rests->push_back(cddr(b));
+        }
+        if(bindings != cell::NIL)
+          throw std::logic_error(string(form) + ": bad binding");
+        obj ret = cell::NIL;
+        for(size_t i = vars.size(); i > 0; i--)
+          ret = cons(vars[i - 1], ret);
+        return ret;
+      }
+
+      // let* is a let per binding, left with a single LEAVE
+      obj compile_let_star(obj code, obj scope, obj next, obj *syntax){
+        std::vector<obj> inits, scopes;
+        obj vars = parse_bindings(cadr(code), "let*", inits);
+        for(; vars->ispair(); vars = cdr(vars)){
+          scopes.push_back(scope);
+          scope = cons(list(car(vars)), scope);
+        }
+        obj c = compile_seq(cddr(code), scope,
+                            inits.empty() ? next : leave(inits.size(), next),
+                            syntax);
+        for(size_t i = inits.size(); i > 0; i--){
+          c = list(mk_opcode(OP_ENTER), car(scope), mk_number(1), c);
+          scope = cdr(scope);
+          c = compile(inits[i - 1], scopes[i - 1], list(mk_opcode(OP_ARGUMENT), c),
+                      syntax);
+        }
+        return c;
+      }
+
+      // letrec binds the variables to () first and assigns the inits in
+      // order, so it also does for letrec*
+      obj compile_letrec(obj code, obj scope, obj next, obj *syntax){
+        std::vector<obj> inits;
+        obj vars = parse_bindings(cadr(code), "letrec", inits);
+        obj inner = cons(vars, scope);
+        obj c = compile_seq(cddr(code), inner, leave(1, next), syntax);
+        obj v = vars;
+        std::vector<obj> var_list;
+        for(; v->ispair(); v = cdr(v)) var_list.push_back(car(v));
+        for(size_t i = inits.size(); i > 0; i--)
+          c = compile(inits[i - 1], inner,
+                      list(mk_opcode(OP_ASSIGN), var_list[i - 1], c), syntax);
+        c = list(mk_opcode(OP_ENTER), vars, mk_number(inits.size()), c);
+        for(size_t i = inits.size(); i > 0; i--)
+          c = list(mk_opcode(OP_CONSTANT), cell::NIL,
+                   list(mk_opcode(OP_ARGUMENT), c));
+        return c;
+      }
+
+      // Loops.  A loop entry in loops_ is (name exit scope escaped jumps):
+      // a call of name compiled with next exit, or a chain of LEAVEs
+      // ending in it, is in tail position of the loop body, which runs
+      // in scope.  Such a call pushes its arguments and JUMPs back to the
+      // top of the body with the loop's frame of env replaced by them.
+      // escaped is set when name is used any other way, and jumps
+      // collects the JUMPs to point at the body once it is compiled.
+      void push_loop(obj name, obj exit, obj scope){
+        loops_ = cons(list(name, exit, scope, cell::F, cell::NIL), loops_);
+      }
+
+      // pops the innermost loop, pointing its jumps at body; returns
+      // whether name escaped
+      bool pop_loop(obj body){
+        obj entry = car(loops_);
+        loops_ = cdr(loops_);
+        for(obj j = car(cddddr(entry)); j != cell::NIL; j = cdr(j))
+          set_car(cddddr(car(j)), body);
+        return cadddr(entry) == cell::T;
+      }
+
+      // a reference to sym other than a jump: the loop it names needs
+      // its procedure
+      void note_reference(obj sym){
+        for(obj l = loops_; l != cell::NIL; l = cdr(l)){
+          if(caar(l) == sym){
+            set_car(cdddr(car(l)), cell::T);
+            return;
+          }
+        }
+      }
+
+      // (JUMP depth n vars body) for the call (fn arg ...), or NULL if it
+      // isn't a tail call of the innermost loop named fn
+      obj loop_jump(obj fn, size_t argc, obj scope, obj next){
+        if(!fn->issymbol()) return NULL;
+        obj l = loops_;
+        while(l != cell::NIL && caar(l) != fn) l = cdr(l);
+        if(l == cell::NIL) return NULL;
+        obj entry = car(l);
+        obj exit = cadr(entry), loop_scope = caddr(entry);
+        while(next != exit && car(next)->ivalue() == OP_LEAVE)
+          next = caddr(next);
+        if(next != exit) return NULL;
+        // the frames of env to drop, unless one of them rebinds fn
+        int depth = 1;
+        for(; scope != loop_scope; scope = cdr(scope), depth++){
+          if(scope == cell::NIL || occurs(fn, car(scope))) return NULL;
+        }
+        obj vars = car(loop_scope);
+        if(occurs(fn, vars)) return NULL;
+        size_t n = 0;
+        for(obj v = vars; v->ispair(); v = cdr(v)) n++;
+        if(n != argc) return NULL;
+        obj jump = list(mk_opcode(OP_JUMP), mk_number(depth), mk_number(n),
+                        vars, cell::NIL);
+        set_car(cddddr(entry), cons(jump, car(cddddr(entry))));
+        return jump;
+      }
+
+      // (let name ((var init) ...) body ...).  The first round of the
+      // body runs inline in a frame binding name, and calls of name in
+      // tail position jump back to it.  The body returns like a lambda
+      // body, from a frame of its own unless next returns anyway, so
+      // that if name is used otherwise it is bound to a procedure made
+      // from the same code.
+      //
+      //   [FRAME next] init ... () ENTER (name) 1 [CLOSE vars body ASSIGN name]
+      //   ENTER vars n body ... RETURN
+      obj compile_named_let(obj code, obj scope, obj next, obj *syntax){
+        obj name = cadr(code);
+        std::vector<obj> inits;
+        obj vars = parse_bindings(caddr(code), "let", inits);
+        obj body = cdddr(code);
+        obj inner = cons(vars, cons(list(name), scope));
+        std::vector<obj> assigned;
+        collect_assigned(body, assigned);
+        bool jumps = assoc_lookup(globals::head(*syntax), name) == cell::NIL
+          && std::find(assigned.begin(), assigned.end(), name)
+             == assigned.end();
+        obj ret = car(next)->ivalue() == OP_RETURN
+          ? next : list(mk_opcode(OP_RETURN));
+        if(jumps) push_loop(name, ret, inner);
+        obj proc = compile_seq(body, inner, ret, syntax);
+        bool escaped = !jumps || pop_loop(proc);
+        obj c = list(mk_opcode(OP_ENTER), vars, mk_number(inits.size()), proc);
+        if(escaped)
+          c = noted(list(mk_opcode(OP_CLOSE), vars, proc,
+                         list(mk_opcode(OP_ASSIGN), name, c)));
+        c = list(mk_opcode(OP_CONSTANT), cell::NIL,
+                 list(mk_opcode(OP_ARGUMENT),
+                      list(mk_opcode(OP_ENTER), list(name), mk_number(1), c)));
+        for(size_t i = inits.size(); i > 0; i--)
+          c = compile(inits[i - 1], scope, list(mk_opcode(OP_ARGUMENT), c),
+                      syntax);
+        return ret == next ? c : list(mk_opcode(OP_FRAME), next, c);
+      }
+
+      // (do ((var init step) ...) (test expr ...) command ...)
+      //
+      //   init ... ENTER vars n
+      //   top: test TEST [expr ... LEAVE 1 next]
+      //                  [command ... step ... JUMP 1 n vars top]
+      obj compile_do(obj code, obj scope, obj next, obj *syntax){
+        std::vector<obj> inits, steps;
+        obj vars = parse_bindings(cadr(code), "do", inits, &steps);
+        obj clause = caddr(code);
+        if(!clause->ispair())
+          throw std::logic_error("do: bad test clause");
+        obj inner = cons(vars, scope);
+        obj jump = list(mk_opcode(OP_JUMP), mk_number(1),
+                        mk_number(inits.size()), vars, cell::NIL);
+        obj c = jump;
+        obj v = vars;
+        std::vector<obj> var_list;
+        for(; v->ispair(); v = cdr(v)) var_list.push_back(car(v));
+        for(size_t i = steps.size(); i > 0; i--){
+          obj step = steps[i - 1]->ispair() ? car(steps[i - 1])
+            : var_list[i - 1];
+          c = compile(step, inner, list(mk_opcode(OP_ARGUMENT), c), syntax);
+        }
+        c = compile_seq(cdddr(code), inner, c, syntax);
+        c = list(mk_opcode(OP_TEST),
+                 compile_seq(cdr(clause), inner, leave(1, next), syntax), c);
+        obj top = compile(car(clause), inner, c, syntax);
+        set_car(cddddr(jump), top);
+        c = list(mk_opcode(OP_ENTER), vars, mk_number(inits.size()), top);
+        for(size_t i = inits.size(); i > 0; i--)
+          c = compile(inits[i - 1], scope, list(mk_opcode(OP_ARGUMENT), c),
+                      syntax);
+        return c;
+      }
+
+      // where_ is the location of form, if it has one, while in scope
+      struct scoped_where {
+        uint64_t &where_;
+        uint64_t saved_;
+        scoped_where(VM *vm, obj form) : where_(vm->where_), saved_(vm->where_) {
+          uint64_t loc = vm->sources_.find(form);
+          if(loc != 0) where_ = loc;
+        }
+        ~scoped_where(){ where_ = saved_; }
+      };
+
+      // an instruction that reports errors, or a CLOSE the sampler names
+      // a lambda after, at the form being compiled
+      obj noted(obj instr){
+        sources_.note(instr, where_);
+        return instr;
+      }
+
+      //いつか再帰をなくす予定
+      obj compile(obj code, obj scope, obj next, obj *syntax){
+        if(code->issymbol()){
+          if(loops_ != cell::NIL) note_reference(code);
+          return list(mk_opcode(OP_REFER), code, next);
+        }else if(code->ispair()){
+          scoped_where here(this, code);
+          const char *opcode = car(code)->str();
+          obj matched_syntax;
+          const primitive *prim;
+          if(strcmp(opcode, "quote") == 0){
+            return list(mk_opcode(OP_CONSTANT), cadr(code), next);
+          }else if(strcmp(opcode, "quasiquote") == 0){
+            return quasiquote(cadr(code), 1, scope, next, syntax);
+          }else if(strcmp(opcode, "lambda") == 0){
+            obj body = compile_body(cddr(code), cons(cadr(code), scope),
+                                    syntax);
+            return noted(list(mk_opcode(OP_CLOSE), cadr(code), body, next));
+          }else if(strcmp(opcode, "let") == 0){
+            if(cdr(code)->ispair() && cadr(code)->issymbol())
+              return compile_named_let(code, scope, next, syntax);
+            std::vector<obj> inits;
+            obj vars = parse_bindings(cadr(code), "let", inits);
+            if(inits.empty())
+              return compile_seq(cddr(code), scope, next, syntax);
+            return compile_enter(vars, inits, cddr(code), scope, next, syntax);
+          }else if(strcmp(opcode, "let*") == 0){
+            return compile_let_star(code, scope, next, syntax);
+          }else if(strcmp(opcode, "letrec") == 0
+                   || strcmp(opcode, "letrec*") == 0){
+            return compile_letrec(code, scope, next, syntax);
+          }else if(strcmp(opcode, "do") == 0){
+            return compile_do(code, scope, next, syntax);
+          }else if(strcmp(opcode, "if") == 0){
+            return compile(cadr(code), scope,
+                           list(mk_opcode(OP_TEST),
+                                compile(caddr(code), scope, next, syntax),
+                                compile(cadddr(code), scope, next, syntax)),
+                           syntax);
+          }else if(strcmp(opcode, "set!") == 0){
+            return compile(caddr(code), scope,
+                           list(mk_opcode(OP_ASSIGN), cadr(code), next),
+                           syntax);
+          }else if(strcmp(opcode, "define") == 0){
+            if(cadr(code)->ispair()){
+              return compile(cons(mk_symbol("lambda"),
+                                  cons(cdadr(code), cddr(code))), scope,
+                             list(mk_opcode(OP_DEFINE), caadr(code), next),
+                             syntax);
+            }else{
+              return compile(caddr(code), scope,
+                             list(mk_opcode(OP_DEFINE), cadr(code), next),
+                             syntax);
             }
+          }else if(strcmp(opcode, "call/cc") == 0){
+            obj c = list(mk_opcode(OP_CONTI),
+                         list(mk_opcode(OP_ARGUMENT),
+                              compile(cadr(code), scope,
+                                      noted(list(mk_opcode(OP_APPLY),
+                                                 mk_number(1))),
+                                      syntax)));
             if(car(next)->ivalue() == OP_RETURN)
               return c;
             else
               return list(mk_opcode(OP_FRAME), next, c);
+          }else if(strcmp(opcode, "call/1cc") == 0){
+            // one-shot, escape-only: always in a frame of its own, which
+            // marks the extent the continuation is valid in
+            return list(mk_opcode(OP_FRAME), next,
+                        list(mk_opcode(OP_CONTI1),
+                             list(mk_opcode(OP_ARGUMENT),
+                                  compile(cadr(code), scope,
+                                          noted(list(mk_opcode(OP_APPLY),
+                                                     mk_number(1))),
+                                          syntax))));
+          }else if(strcmp(opcode, "define-syntax") == 0){
+            obj name = cadr(code);
+            obj entry = cons(cons(name, SyntaxRules::compile(caddr(code))),
+                             cell::NIL);
+            std::lock_guard<std::mutex> hold(globals_->lock_);
+            set_cdr(entry, *syntax);
+            globals::publish(*syntax, entry);
+            return next;
+          }else if((matched_syntax = assoc_lookup(globals::head(*syntax), car(code)))
+                   != cell::NIL){
+            obj expanded = expand_macro(matched_syntax, code);
+#ifdef DEBUG
+            cout << "expanded: "; printsexp(expanded);
+#endif
+            return compile(expanded, scope, next, syntax);
+          }else if((prim = inline_primitive(code, scope)) != NULL){
+            // (op a b c) => a PUSH b PUSH c OP, (op a) => a OP
+            std::vector<obj> args;
+            for(obj a = cdr(code); a->ispair(); a = cdr(a))
+              args.push_back(car(a));
+            obj c = noted(list(mk_opcode(prim->opcode), next));
+            for(size_t i = args.size(); i-- > 1;){
+              c = compile(args[i], scope, c, syntax);
+              c = list(mk_opcode(OP_PUSH), c);
+            }
+            return compile(args[0], scope, c, syntax);
+          }else{
+            std::vector<obj> args;
+            for(obj a = cdr(code); a->ispair(); a = cdr(a))
+              args.push_back(car(a));
+            obj fn = car(code);
+            obj c;
+            // the arguments bind the variables in place, like a let
+            if((optimizations_ & OPT_BETA) && isdirect_lambda(fn, args.size()))
+              return compile_enter(cadr(fn), args, cddr(fn), scope, next,
+                                   syntax);
+            bool jump = (c = loop_jump(fn, args.size(), scope, next)) != NULL;
+            if(!jump)
+              c = compile(fn, scope,
+                          noted(list(mk_opcode(OP_APPLY),
+                                     mk_number(args.size()))),
+                          syntax);
+            for(size_t i = args.size(); i > 0; i--)
+              c = compile(args[i - 1], scope, list(mk_opcode(OP_ARGUMENT), c),
+                          syntax);
+            if(jump || car(next)->ivalue() == OP_RETURN)
+              return c;
+            else
+              return list(mk_opcode(OP_FRAME), next, c);
           }
         }else{
           return list(mk_opcode(OP_CONSTANT), code, next);
         }
       }
 
-      obj run(obj code, obj *genv){
-        obj acc = cell::NIL;
-        obj env = cell::NIL;
-        obj arg = cell::NIL;
-        obj stack = cell::NIL;
-      recursion:
-#ifdef DEBUG
-        cout << "\n";
-        cout << "acc\t";  printsexp(acc);
-        cout << "code\t";  printsexp(code);
-        cout << "env\t"; printsexp(env);
-        cout << "genv\t"; printsexp(*genv);
-        cout << "arg\t"; printsexp(arg);
-        cout << "stack\t"; printsexp(stack);
-#endif /* DEBUG */
-        switch (car(code)->ivalue()){
-        case OP_HALT:
-          return acc;
-        case OP_REFER:
-          // var x
-          //eval((car (lookup var e)) x e r s)
-          acc = car(lookup(cadr(code), env, genv));
-          code = caddr(code);
-          goto recursion;
-        case OP_CONSTANT:
-          // x
-          //eval(car->cdar() x e r s)
-          acc = cadr(code);
-          code = caddr(code);
-          goto recursion;
-        case OP_CLOSE:
-          // vars body x
-          //eval((closure body e vars) x e r s)
-          acc = closure(caddr(code), env, cadr(code));
-          code = cadddr(code);
-          goto recursion;
-        case OP_TEST:
-          // then else
-          //eval(a (if a then else) e r s)
-          if(acc == cell::T)
-            code = cadr(code);
-          else
-            code = caddr(code);
-          goto recursion;
-        case OP_ASSIGN:
-          // var x
-          // (set-car! (lookup var e) a)
-          // eval(a x e r s)
-          set_car(lookup(cadr(code), env, genv), acc);
-          code = caddr(code);
-          goto recursion;
-        case OP_DEFINE:
-          if(env == cell::NIL)
-            define(cadr(code), acc, genv);
-          else
-            extend(env, cadr(code), acc);
-          acc = cadr(code);
-          code = caddr(code);
-          goto recursion;
-        case OP_CONTI:
-          acc = closure(list(mk_opcode(OP_NUATE), stack,
-                             mk_symbol("#<continuation arg>")),
-                        cell::NIL,
-                        list(mk_symbol("#<continuation arg>")));
-          code = cadr(code);
-          goto recursion;
-        case OP_NUATE:
-          acc = car(lookup(caddr(code), env, genv));
-          stack = cadr(code);
-          code = list(mk_opcode(OP_RETURN));
-          goto recursion;
-        case OP_ARGUMENT:
-          // x
-          // eval(a x e cons(a r) s)
-          arg = cons(acc,arg);
-          code = cadr(code);
-          goto recursion;
-        case OP_FRAME:
-          // ret x
-          // eval(a x e '() (call-frame ret e r s))
-          stack = call_frame(cadr(code), env, arg, stack);
-          arg = cell::NIL;
-          code = caddr(code);
-          goto recursion;
-        case OP_APPLY:
-          // (record a (body e vars)
-          // (apply (lambda (a) eval() ) (body e vars))
-          // eval(a body (extend e vars arg) '() s))
-          if(acc->isproc()){
-            cell::funcp f = acc->func();
-            if(f == NULL)
-              throw std::logic_error("Can't found this procedure!");
-            acc = f(nreverse(arg), env);
-            code = car(stack);
-            env = cadr(stack);
-            arg = caddr(stack);
-            stack = cadddr(stack);
-          }else{
-            code = car(acc);
-            if(code == cell::NIL)
-              throw std::logic_error("It's not defined function!");
-            env = extend(cadr(acc), caddr(acc), nreverse(arg));
-            arg = cell::NIL;
-          }
-          goto recursion;
-        case OP_RETURN:
-          code = car(stack);
-          env = cadr(stack);
-          arg = caddr(stack);
-          stack = cadddr(stack);
-          goto recursion;
-        default:
-          throw std::logic_error("Evaluation Error");
+      // a form of the top level, ending in HALT.  A compile an error cut
+      // short leaves its loops behind, so they are dropped first.
+      obj compile_toplevel(obj form){
+        loops_ = cell::NIL;
+        return compile(optimize_toplevel(form), cell::NIL,
+                       list(mk_opcode(OP_HALT)), &syntax_);
+      }
+
+      // values for the parameters vars from argv: one per fixed
+      // parameter, plus a list of the rest for a dotted parameter list
+      obj bind_arguments(obj vars, const obj *argv, int argc){
+        int nfixed = 0;
+        obj v = vars;
+        for(; v->ispair(); v = cdr(v)) nfixed++;
+        bool rest = v != cell::NIL;
+        if(argc < nfixed || (!rest && argc > nfixed))
+          throw std::logic_error("Wrong number of arguments");
+        obj vals = cell::NIL;
+        if(rest){
+          for(int i = argc; i > nfixed; i--)
+            vals = cons(argv[i - 1], vals);
+          vals = list(vals);
+        }
+        for(int i = nfixed; i > 0; i--)
+          vals = cons(argv[i - 1], vals);
+        return vals;
+      }
+
+      static void check_arity(const native_proc *proc, int argc){
+        if(argc < proc->min_args
+           || (proc->max_args >= 0 && argc > proc->max_args)){
+          string msg = "Wrong number of arguments to ";
+          throw std::logic_error(msg + proc->name);
+        }
+      }
+
+      // the procedures on the stack, from code up
+      __attribute__((noinline)) void sample(obj code){
+        if(!sampler_) return;
+        sampler::due_ = 0;
+        std::vector<const char *> names;
+        names.push_back(sampler_->name_of(code));
+        obj piece = link_;
+        obj *begin = stack_base_, *p = sp_;
+        for(;;){
+          while(p > begin && names.size() < sampler::MAX_DEPTH){
+            obj w = *--p;
+            if(w->ispair() && car(w)->isopcode())
+              names.push_back(sampler_->name_of(w));
+          }
+          if(names.size() >= sampler::MAX_DEPTH || piece == cell::NIL) break;
+          begin = piece_chunk(piece)->data() + piece_start(piece);
+          p = begin + piece_length(piece);
+          piece = piece_parent(piece);
+        }
+        sampler_->add(names, names.size() >= sampler::MAX_DEPTH);
+      }
+
+      // instructions between looks at the clock when there is a time limit
+      static const unsigned long CLOCK_SLICE = 1 << 16;
+      // instructions drawn from the limits of an evaluation at a time
+      static const unsigned long FUEL_LEASE = 1 << 12;
+      // instructions a green thread runs before another ready one
+      static const unsigned long THREAD_SLICE = 1 << 13;
+
+      void spend(unsigned long n){
+        instructions_ += n;
+        fuel_ = n < fuel_ ? fuel_ - n : 0;
+        quantum_ = n < quantum_ ? quantum_ - n : 0;
+      }
+
+      // the instructions a run may go before check_budget
+      unsigned long next_check() const {
+        return std::min(std::min(fuel_, slice_), quantum_);
+      }
+
+      // returns the instructions to the next check, or throws if the
+      // evaluation is out of instructions or time, or the future it runs
+      // was cancelled
+      __attribute__((noinline)) unsigned long check_budget(){
+        if(fuel_ == 0 && limits_) fuel_ = draw(limits_->fuel_, FUEL_LEASE);
+        if(fuel_ == 0)
+          throw std::logic_error("instruction limit exceeded");
+        if(std::chrono::steady_clock::now() >= deadline_)
+          throw std::logic_error("time limit exceeded");
+        if(cancel_ != NULL && (*cancel_ || (limits_ && limits_->failed_)))
+          throw std::logic_error("future cancelled");
+        return next_check();
+      }
+
+      // runs within l, or without limits if it is null
+      void use_limits(const std::shared_ptr<limits> &l){
+        limits_ = l;
+        fuel_ = !l || l->fuel_ == ULONG_MAX ? ULONG_MAX : 0;
+        deadline_ = l ? l->deadline_
+          : std::chrono::steady_clock::time_point::max();
+        slice_ = deadline_ != std::chrono::steady_clock::time_point::max()
+          ? CLOCK_SLICE : ULONG_MAX;
+        cell_manager::get_instance().set_budget(l ? &l->cells_ : NULL);
+      }
+
+      void start_budget(){
+        if(max_instructions_ == 0 && max_cells_ == 0 && max_time_.count() == 0){
+          use_limits(NULL);
+          return;
+        }
+        use_limits(std::make_shared<limits>(
+                     max_instructions_ != 0 ? max_instructions_ : ULONG_MAX,
+                     max_cells_ != 0 ? max_cells_ : SIZE_MAX,
+                     max_time_.count() != 0
+                     ? std::chrono::steady_clock::now() + max_time_
+                     : std::chrono::steady_clock::time_point::max()));
+      }
+
+      // settles the futures made since the budget started, cancelling
+      // them if it failed, and gives back what was drawn and not used
+      void end_budget(bool failed);
+
+      obj run(obj code, obj *genv){
+        obj acc = cell::NIL;
+        obj env = cell::NIL;
+        // every loop goes through APPLY or JUMP, where other mutators
+        // wanting to collect are let in
+        cell_manager &heap = cell_manager::get_instance();
+        // kept in a register, added up when the run ends either way.
+        // When n_ reaches limit_ at a call or a jump, the budget is
+        // looked at.
+        struct counter {
+          unsigned long n_;
+          unsigned long limit_;
+          VM &vm_;
+          explicit counter(VM &vm)
+            : n_(0), limit_(vm.next_check()), vm_(vm) {}
+          ~counter(){ vm_.spend(n_); }
+          void settle(){
+            vm_.spend(n_);
+            n_ = 0;
+          }
+        } steps(*this);
+#ifdef PROFILE
+        profile *prof = profile_.get();
+        if(prof != NULL && depth_ == 1) prof->start();
+#endif /* PROFILE */
+        if(sampler_){
+          sampler_->index(code, mk_symbol("toplevel"));
+          // ticks while the form was read and compiled
+          if(sampler::due_ && depth_ == 1){
+            sampler::due_ = 0;
+            sampler_->add(std::vector<const char *>(1, "[compile]"), false);
+          }
+        }
+        try{
+        recursion:
+          steps.n_++;
+#ifdef PROFILE
+          if(prof != NULL) prof->step(car(code)->ivalue());
+#endif /* PROFILE */
+#ifdef DEBUG
+          cout << "\n";
+          cout << "acc\t";  printsexp(acc);
+          cout << "code\t";  printsexp(code);
+          cout << "env\t"; printsexp(env);
+          cout << "genv\t"; printsexp(*genv);
+          cout << "stack\t" << (sp_ - stack_base_) << "\n";
+#endif /* DEBUG */
+          switch (car(code)->ivalue()){
+          case OP_HALT:
+            // the end of a green thread, or of the main one while others
+            // are ready; the last one to end returns the main value.  A
+            // thread that called a continuation of another one ends as
+            // itself at the bottom of it.
+            if(depth_ == 1 && (code == thread_end_ || ready_ != cell::NIL
+                               || spawned_running())){
+              acc = end_thread(!spawned_running(), acc);
+              env = pop();
+              code = pop();
+              goto recursion;
+            }
+            return acc;
+          case OP_REFER:
+            // var x
+            //eval((car (lookup var e)) x e r s)
+            acc = car(lookup(cadr(code), env, genv));
+            code = caddr(code);
+            goto recursion;
+          case OP_CONSTANT:
+            // x
+            //eval(car->cdar() x e r s)
+            acc = cadr(code);
+            code = caddr(code);
+            goto recursion;
+          case OP_CLOSE:
+            // vars body x
+            //eval((closure body e vars) x e r s)
+            acc = closure(caddr(code), env, cadr(code));
+            code = cadddr(code);
+            goto recursion;
+          case OP_TEST:
+            // then else
+            //eval(a (if a then else) e r s)
+            if(acc == cell::T)
+              code = cadr(code);
+            else
+              code = caddr(code);
+            goto recursion;
+          case OP_ASSIGN:
+            // var x
+            // (set-car! (lookup var e) a)
+            // eval(a x e r s)
+            set_car(lookup(cadr(code), env, genv), acc);
+            code = caddr(code);
+            goto recursion;
+          case OP_DEFINE:
+            if(env == cell::NIL)
+              define(cadr(code), acc, genv);
+            else
+              extend(env, cadr(code), acc);
+            acc = cadr(code);
+            code = caddr(code);
+            goto recursion;
+          case OP_CONTI:
+            // x
+            // the stack is frozen in place, not copied
+            freeze();
+            acc = closure(list(mk_opcode(OP_NUATE), link_,
+                               mk_symbol("#<continuation arg>")),
+                          cell::NIL,
+                          list(mk_symbol("#<continuation arg>")));
+            code = cadr(code);
+            goto recursion;
+          case OP_NUATE:
+            // stack var
+            // the frames of the continuation come back as they are popped
+            acc = car(lookup(caddr(code), env, genv));
+            sp_ = stack_base_;
+            link_ = cadr(code);
+            env = pop();
+            code = pop();
+            goto recursion;
+          case OP_CONTI1:{
+            // x
+            // the frame just pushed for call/1cc gets its own return code
+            if(sp_ - stack_base_ < 2) refill(2);
+            obj k = list(cell::T, mk_number(stack_depth()), cell::NIL);
+            obj marker = list(mk_opcode(OP_EXIT1), k, sp_[-2]);
+            set_car(cddr(k), marker);
+            sp_[-2] = marker;
+            acc = closure(list(mk_opcode(OP_NUATE1), k,
+                               mk_symbol("#<continuation arg>")),
+                          cell::NIL,
+                          list(mk_symbol("#<continuation arg>")));
+            code = cadr(code);
+            goto recursion;
+          }
+          case OP_NUATE1:{
+            // k var
+            obj k = cadr(code);
+            acc = car(lookup(caddr(code), env, genv));
+            if(car(k) == cell::F)
+              throw std::logic_error("call/1cc: continuation already used");
+            if(!escape_to(k))
+              throw std::logic_error("call/1cc: continuation is no longer live");
+            env = pop();
+            code = pop();
+            goto recursion;
+          }
+          case OP_ENTER:{
+            // vars n body
+            // as APPLY of a closure over the current env
+            int argc = caddr(code)->ivalue();
+            if(sp_ - stack_base_ < argc) refill(argc);
+            obj *argv = sp_ - argc;
+            env = extend(env, cadr(code), bind_arguments(cadr(code), argv, argc));
+            sp_ = argv;
+            code = cadddr(code);
+            goto recursion;
+          }
+          case OP_LEAVE:{
+            // n x
+            for(int n = cadr(code)->ivalue(); n > 0; n--)
+              env = cdr(env);
+            code = caddr(code);
+            goto recursion;
+          }
+          case OP_JUMP:{
+            // depth n vars body
+            // a loop's next round: its frame is replaced, nothing is pushed
+            if(steps.n_ >= steps.limit_){
+              steps.settle();
+              steps.limit_ = check_budget();
+              if(quantum_ == 0 && preempt(acc, env, code)){
+                steps.limit_ = next_check();
+                goto recursion;
+              }
+            }
+            int argc = caddr(code)->ivalue();
+            if(sp_ - stack_base_ < argc) refill(argc);
+            obj *argv = sp_ - argc;
+            for(int n = cadr(code)->ivalue(); n > 0; n--)
+              env = cdr(env);
+            env = extend(env, cadddr(code),
+                         bind_arguments(cadddr(code), argv, argc));
+            sp_ = argv;
+            code = car(cddddr(code));
+            if(heap.stopping()) heap.safepoint();
+            if(sampler::due_) sample(code);
+            goto recursion;
+          }
+          case OP_EXIT1:
+            // k ret
+            // leaving the extent of call/1cc, normally or by escaping
+            set_car(cadr(code), cell::F);
+            code = caddr(code);
+            goto recursion;
+          case OP_ARGUMENT:
+            // x
+            // eval(a x e cons(a r) s)
+            push(acc);
+            code = cadr(code);
+            goto recursion;
+          case OP_FRAME:
+            // ret x
+            // eval(a x e '() (call-frame ret e r s))
+            push_frame(cadr(code), env);
+            code = caddr(code);
+            goto recursion;
+          case OP_APPLY:{
+            // n
+            // the n arguments are on top of the stack
+            if(steps.n_ >= steps.limit_){
+              steps.settle();
+              steps.limit_ = check_budget();
+              if(quantum_ == 0 && preempt(acc, env, code)){
+                steps.limit_ = next_check();
+                goto recursion;
+              }
+            }
+            int argc = cadr(code)->ivalue();
+            if(sp_ - stack_base_ < argc) refill(argc);
+            obj *argv = sp_ - argc;
+            if(acc->isproc()){
+              const native_proc *proc = acc->proc();
+              check_arity(proc, argc);
+              // a builtin calling back spends from fuel_ in runs of its own
+              steps.settle();
+              acc = proc->call(argv, argc);
+              steps.limit_ = next_check();
+              // not argv: a builtin that waits moves the stack, see block
+              sp_ -= argc;
+              env = pop();
+              code = pop();
+            }else{
+              if(car(acc) == cell::NIL)
+                throw std::logic_error("It's not defined function!");
+              env = extend(cadr(acc), caddr(acc),
+                           bind_arguments(caddr(acc), argv, argc));
+              code = car(acc);
+              sp_ = argv;
+            }
+            if(heap.stopping()) heap.safepoint();
+            if(sampler::due_) sample(code);
+            goto recursion;
+          }
+          case OP_RETURN:
+            env = pop();
+            code = pop();
+            goto recursion;
+          case OP_PUSH:
+            push(acc);
+            code = cadr(code);
+            goto recursion;
+          case OP_ADD2:
+            acc = Number::add(pop(), acc);
+            code = cadr(code);
+            goto recursion;
+          case OP_SUB2:
+            acc = Number::sub(pop(), acc);
+            code = cadr(code);
+            goto recursion;
+          case OP_NUMEQ:
+            acc = Number::compare(pop(), acc) == 0 ? cell::T : cell::F;
+            code = cadr(code);
+            goto recursion;
+          case OP_CAR1:
+            acc = car(acc);
+            code = cadr(code);
+            goto recursion;
+          case OP_CDR1:
+            acc = cdr(acc);
+            code = cadr(code);
+            goto recursion;
+          case OP_CONS2:
+            acc = cons(pop(), acc);
+            code = cadr(code);
+            goto recursion;
+          case OP_APPEND2:{
+            // the last list of an append is shared, the others copied
+            obj left = pop();
+            if(acc == cell::NIL){
+              acc = left;
+            }else if(left->ispair()){
+              obj head = list(car(left)), last = head;
+              for(left = cdr(left); left->ispair(); left = cdr(left)){
+                obj c = list(car(left));
+                set_cdr(last, c);
+                last = c;
+              }
+              set_cdr(last, acc);
+              acc = head;
+            }else if(left != cell::NIL){
+              throw std::logic_error("unquote-splicing: not a list");
+            }
+            code = cadr(code);
+            goto recursion;
+          }
+          case OP_NULLP:
+            acc = acc == cell::NIL ? cell::T : cell::F;
+            code = cadr(code);
+            goto recursion;
+          case OP_EQ:
+            acc = pop() == acc ? cell::T : cell::F;
+            code = cadr(code);
+            goto recursion;
+          case OP_VREF2:{
+            obj v = checked_vector(pop(), "vector-ref");
+            acc = v->data()[checked_index(acc, v->size(), "vector-ref")];
+            code = cadr(code);
+            goto recursion;
+          }
+          case OP_VSET3:{
+            obj k = pop();
+            obj v = checked_vector(pop(), "vector-set!");
+            v->data()[checked_index(k, v->size(), "vector-set!")] = acc;
+            cell_manager::write_barrier(v);
+            acc = cell::NIL;
+            code = cadr(code);
+            goto recursion;
+          }
+          default:
+            throw std::logic_error("Evaluation Error");
+          }
+        }catch(located_error &){
+          throw;
+        }catch(std::logic_error &e){
+          // the instruction that failed, if the compiler noted it
+          uint64_t loc = sources_.find(code);
+          if(loc == 0) throw;
+          throw located_error(sources_.describe(loc) + ": " + e.what());
+        }
+        return cell::NIL;
+      }
+
+      // Runs code to its HALT.  A builtin that calls back into the VM
+      // gets a short segment of its own for the inner run; the frames of
+      // the run it interrupts stay where they are, rooted, until it
+      // returns.  So continuations don't cross such a call: one captured
+      // inside ends at the builtin, not at the top level.
+      obj execute(obj code){
+        struct counted {
+          int &depth_;
+          VM *saved_;
+          counted(int &depth, VM *vm) : depth_(depth), saved_(current_) {
+            depth_++;
+            current_ = vm;
+          }
+          ~counted(){
+            depth_--;
+            current_ = saved_;
+          }
+        };
+        if(depth_ == 0){
+          // the main thread; if it is left waiting by an error, nothing
+          // wakes it
+          struct main_thread {
+            VM *vm_;
+            explicit main_thread(VM *vm) : vm_(vm) {
+              vm->main_ = vm->running_ = cell::T;
+            }
+            ~main_thread(){
+              if(vm_->main_->ispair()) set_car(vm_->main_, cell::F);
+              vm_->main_ = vm_->running_ = vm_->main_value_ = cell::NIL;
+            }
+          };
+          sp_ = stack_base_;
+          link_ = cell::NIL;
+          counted run_(depth_, this);
+          main_thread main(this);
+          return run(code, &genv_);
+        }
+        struct outer_run {
+          VM *vm_;
+          obj stack_[2];
+          obj *stack_end_;
+          obj *base_, *limit_, *sp_;
+          explicit outer_run(VM *vm)
+            : vm_(vm), stack_end_(stack_ + 2), base_(vm->stack_base_),
+              limit_(vm->stack_limit_), sp_(vm->sp_) {
+            stack_[0] = vm->stack_chunk_;
+            stack_[1] = vm->link_;
+          }
+          ~outer_run(){
+            vm_->stack_chunk_ = stack_[0];
+            vm_->link_ = stack_[1];
+            vm_->stack_base_ = base_;
+            vm_->stack_limit_ = limit_;
+            vm_->sp_ = sp_;
+          }
+        } outer(this);
+        scoped_root_range keep(outer.stack_, &outer.stack_end_);
+        scoped_root_range keep_stack(outer.base_, &outer.sp_);
+        counted run_(depth_, this);
+        link_ = cell::NIL;
+        new_segment(NESTED_SEGMENT_SIZE);
+        return run(code, &genv_);
+      }
+
+
+    public:
+      // optimization passes, each can be turned off
+      enum OPTIMIZATION {
+        OPT_FOLD = 1,     // calls of pure builtins on constants
+        OPT_IF = 2,       // if with a constant test
+        OPT_BETA = 4,     // ((lambda (x ...) body) v ...) without a closure
+        OPT_INLINE = 8,   // calls of small top level procedures
+        OPT_ALL = 15
+      };
+
+      explicit VM(std::shared_ptr<globals> g = std::make_shared<globals>())
+        : globals_(g), genv_(g->genv_), syntax_(g->syntax_),
+          inlines_(g->inlines_), optimizations_(OPT_ALL), loops_(cell::NIL),
+          expand_hits_(0), expand_misses_(0), expand_time_(0),
+          instructions_(0), max_instructions_(0), max_cells_(0),
+          max_time_(0), fuel_(ULONG_MAX), slice_(ULONG_MAX),
+          deadline_(std::chrono::steady_clock::time_point::max()),
+          cancel_(NULL), spawned_(cell::NIL), sources_(g->sources_), where_(0),
+          depth_(0), pool_(NULL), own_pool_(false), quantum_(ULONG_MAX) {
+        cell_manager &cm = cell_manager::get_instance();
+        cm.add_root(&loops_);
+        cm.add_root(&spawned_);
+        stack_chunk_ = link_ = cell::NIL;
+        cm.add_root(&stack_chunk_);
+        cm.add_root(&link_);
+        new_segment(SEGMENT_SIZE);
+        cm.add_root_range(&stack_base_, &sp_);
+        expansions_ = cell::NIL;
+        cm.add_root(&expansions_);
+        expansions_ = mk_table(hash_table::EQUAL);
+        ready_ = ready_last_ = running_ = main_ = main_value_ = cell::NIL;
+        thread_end_ = thread_start_ = evaluation_end_ = cell::NIL;
+        for(obj *r : thread_roots()) cm.add_root(r);
+        // frames of a return code and an env.  The bottom one of a
+        // thread is a piece of its own, shared by all threads, so that
+        // one waiting with nothing else on its stack takes no copy.
+        thread_end_ = list(mk_opcode(OP_HALT));
+        const obj bottom[] = { thread_end_, cell::NIL };
+        thread_start_ = copy_frames(bottom, 2, cell::NIL);
+        const obj apply[] = { list(mk_opcode(OP_APPLY), mk_number(0)),
+                              cell::NIL };
+        thread_start_ = copy_frames(apply, 2, thread_start_);
+        const obj end[] = { list(mk_opcode(OP_HALT)), cell::NIL };
+        evaluation_end_ = copy_frames(end, 2, cell::NIL);
+      }
+
+      ~VM(){
+        if(own_pool_) stop_pool();
+        cell_manager &cm = cell_manager::get_instance();
+        cm.remove_root(&loops_);
+        cm.remove_root(&spawned_);
+        cm.remove_root(&expansions_);
+        cm.remove_root(&stack_chunk_);
+        cm.remove_root(&link_);
+        cm.remove_root_range(&stack_base_);
+        for(obj *r : thread_roots()) cm.remove_root(r);
+      }
+
+      void set_optimizations(unsigned flags){
+        optimizations_ = flags;
+      }
+
+      int depth() const { return depth_; }
+
+      // The worker threads of the pools made from now on, 0 to run
+      // each future when it is touched.  The default is one per core.
+      static void set_workers(unsigned n){
+        workers_ = n;
+      }
+
+      worker_pool &pool();
+      void share_pool(worker_pool *pool){
+        pool_ = pool;
+      }
+
+      // Green threads.  A builtin at argv that has to wait gives the
+      // record of the running thread to whatever is to wake it, and
+      // returns what block does: the next thread to run is set up as if
+      // the builtin were returning to it, arguments and all, from the
+      // bottom of the free part of the chunk.
+      void spawn(obj thunk){
+        make_ready(cons(thread_start_, thunk));
+      }
+
+      bool others_ready() const { return ready_ != cell::NIL; }
+
+      obj waiting_thread(const char *who){
+        if(depth_ != 1)
+          throw std::logic_error(std::string(who)
+                                 + ": can't wait in a callback of a builtin");
+        return record();
+      }
+
+      // the running thread goes on with value when woken, or after the
+      // ready ones if ready
+      obj block(const obj *argv, obj value, bool ready){
+        size_t argc = sp_ - argv;
+        sp_ = const_cast<obj *>(argv);
+        park(value);
+        if(ready) make_ready(running_);
+        obj next = next_thread(free_base());
+        std::fill(sp_, sp_ + argc, cell::NIL);
+        sp_ += argc;
+        return next;
+      }
+
+      void wake(obj t, obj value){
+        set_cdr(t, value);
+        make_ready(t);
+      }
+
+      // Limits on each evaluation, 0 for none: the instructions it runs,
+      // the cells it allocates and the milliseconds it takes.  One that
+      // goes over is an error like any other, after which the VM is used
+      // as before.
+      void set_limits(unsigned long instructions, size_t cells,
+                      unsigned long milliseconds){
+        max_instructions_ = instructions;
+        max_cells_ = cells;
+        max_time_ = std::chrono::milliseconds(milliseconds);
+      }
+
+      // a future made now runs within the limits of the evaluation in
+      // progress, which settles it
+      void lend_budget(obj f){
+        if(!limits_) return;
+        f->fut()->limits_ = limits_;
+        spawned_ = cons(f, spawned_);
+      }
+
+      std::chrono::steady_clock::time_point deadline() const {
+        return deadline_;
+      }
+
+      // An evaluation the limits apply to: a form of the repl, or an
+      // eval or call of a context.  Scheme code that a builtin calls
+      // back into is part of the evaluation in progress.  Its futures
+      // are done when it ends, and cancelled if it fails.
+      class scoped_limits {
+        VM *vm_;
+        scoped_limits(const scoped_limits &);
+      public:
+        explicit scoped_limits(VM *vm) : vm_(vm->depth_ == 0 ? vm : NULL) {
+          if(vm_ != NULL) vm_->start_budget();
+        }
+        ~scoped_limits(){
+          if(vm_ == NULL) return;
+          bool failed = std::uncaught_exceptions() > 0;
+          if(failed && vm_->limits_) vm_->limits_->failed_ = true;
+          vm_->end_budget(failed);
+        }
+      };
+
+      // A future that a VM runs outside of an evaluation of its own,
+      // within the limits of the one that made it; the futures it makes
+      // are settled by end.  One run by touch is part of the evaluation
+      // that touched it.
+      class borrowed_limits {
+        VM *vm_;
+        obj spawned_;
+        borrowed_limits(const borrowed_limits &);
+      public:
+        borrowed_limits(VM *vm, future *f)
+          : vm_(vm->depth_ == 0 ? vm : NULL), spawned_(cell::NIL) {
+          if(vm_ == NULL) return;
+          cell_manager::get_instance().add_root(&spawned_);
+          spawned_ = vm_->spawned_;
+          vm_->spawned_ = cell::NIL;
+          vm_->use_limits(f->limits_);
+          // looks at cancel_ now and then, whatever the limits
+          vm_->slice_ = CLOCK_SLICE;
+          vm_->cancel_ = &f->cancel_;
+        }
+        void end(bool failed){
+          if(vm_ == NULL) return;
+          vm_->end_budget(failed);
+          vm_->spawned_ = spawned_;
+          cell_manager::get_instance().remove_root(&spawned_);
+          vm_ = NULL;
+        }
+        ~borrowed_limits(){
+          end(true);
+        }
+      };
+
+      void set_profiling(bool on){
+        if(!on) profile_.reset();
+        else if(!profile_) profile_.reset(new profile());
+      }
+
+      void print_profile(std::ostream &os) const {
+        if(profile_) profile_->print(os);
+      }
+
+      void start_sampling(long interval_us){
+        sampler_.reset(new sampler(interval_us, sources_));
+      }
+
+      // writes the folded stacks and stops
+      void write_samples(const char *path){
+        if(!sampler_) return;
+        std::unique_ptr<sampler> s(std::move(sampler_));
+        s->write(path);
+      }
+
+      const std::shared_ptr<globals> &shared_globals() const { return globals_; }
+
+      // the entry points of an embedding program, see petitsch.h
+      void init_globals(){
+        if(genv_ == cell::NIL) genv_init(&genv_);
+      }
+
+      obj eval(obj form){
+        return execute(compile_toplevel(form));
+      }
+
+      static VM *current(){ return current_; }
+
+      obj apply(obj proc, obj args){
+        obj call = cons(list(mk_symbol("quote"), proc), cell::NIL);
+        obj tail = call;
+        for(; args != cell::NIL; args = cdr(args)){
+          set_cdr(tail, cons(list(mk_symbol("quote"), car(args)), cell::NIL));
+          tail = cdr(tail);
         }
-        return cell::NIL;
+        return execute(compile(call, cell::NIL, list(mk_opcode(OP_HALT)),
+                               &syntax_));
       }
 
+      // NULL if var is unbound
+      obj lookup_global(obj var){
+        obj vals = _lookup(var, globals::head(genv_));
+        return vals == cell::NIL ? NULL : car(vals);
+      }
 
-    public:
-      void repl()
+      void define_global(obj var, obj val){
+        define(var, val, &genv_);
+      }
+
+      source_map &sources(){ return sources_; }
+
+      // those of its workers too
+      unsigned long instructions() const;
+
+      void print_stats(std::ostream &os) const {
+        os << "instructions: " << instructions() << "\n";
+        cell_manager::get_instance().print_stats(os);
+        os << "macro expansions: " << expand_hits_ << " cached, "
+           << expand_misses_ << " expanded in "
+           << std::chrono::duration<double, std::milli>(expand_time_).count()
+           << " ms" << endl;
+      }
+
+      // the globals, macros and inlining candidates, to start from
+      // instead of the builtins alone
+      void save_image(const char *path){
+        std::vector<obj> roots;
+        roots.push_back(genv_);
+        roots.push_back(syntax_);
+        roots.push_back(inlines_);
+        Image::save(path, roots);
+      }
+
+      void load_image(const char *path){
+        cell_manager::get_instance().set_stack_top(
+          static_cast<obj *>(__builtin_frame_address(0)));
+        std::vector<obj> roots = Image::load(path);
+        if(roots.size() != 3)
+          throw std::logic_error("image: corrupt");
+        genv_ = roots[0];
+        syntax_ = roots[1];
+        inlines_ = roots[2];
+      }
+
+      static size_t nbuiltins(){
+        size_t n = 0;
+        while(builtins[n].name != NULL) n++;
+        return n + 1;
+      }
+
+      // the same as an image, mapped in place as an immortal region
+      void save_snapshot(const char *path){
+        std::vector<obj> roots;
+        roots.push_back(genv_);
+        roots.push_back(syntax_);
+        roots.push_back(inlines_);
+        cell_manager::get_instance().save_snapshot(path, roots, builtins,
+                                                   nbuiltins());
+      }
+
+      void load_snapshot(const char *path){
+        std::vector<obj> tables;
+        std::vector<obj> roots = cell_manager::get_instance()
+          .load_snapshot(path, builtins, nbuiltins(), tables);
+        if(roots.size() != 3)
+          throw std::logic_error("snapshot: corrupt");
+        for(size_t i = 0; i < tables.size(); i++)
+          Base::rebuild_table(tables[i]);
+        genv_ = roots[0];
+        syntax_ = roots[1];
+        inlines_ = roots[2];
+      }
+
+      // reads from path, or from stdin if it is NULL
+      void repl(bool interactive = true, const char *path = NULL)
       {
-        obj stack_top = NULL;
-        cell_manager::get_instance().set_stack_top(&stack_top);
+        // the frame address lies above every local of this frame (genv,
+        // syntax, ...) even when the optimiser reorders them
+        cell_manager::get_instance().set_stack_top(
+          static_cast<obj *>(__builtin_frame_address(0)));
 
-        SexpIO io;
-        obj genv = cell::NIL;
-        genv_init(&genv);
-        obj syntax = cell::NIL;
+        std::ifstream in;
+        if(path != NULL){
+          in.open(path);
+          if(!in)
+            throw std::logic_error(std::string("can't open ") + path);
+        }
+        SexpIO io(interactive, path != NULL ? &in : &std::cin);
+        unsigned file = sources_.file(path != NULL ? path : "<stdin>");
+        if(genv_ == cell::NIL) genv_init(&genv_);
         while(1){
           try{
 #ifdef DEBUG
@@ -1430,25 +6984,30 @@ namespace PetitScheme {
               " (my-and e2 ...)"
               " (f)))))";
             obj scode = Parser(str.c_str(), str.size()).parse();
-            obj sbcode = compile(scode, list(mk_opcode(OP_HALT)), &syntax);
-            run(sbcode, &genv);
-            printsexp(syntax);
+            obj sbcode = compile(scode, cell::NIL, list(mk_opcode(OP_HALT)),
+                                 &syntax_);
+            run(sbcode, &genv_);
+            printsexp(syntax_);
             str = "(if (my-and (= 1 1) (= 2 2) (= 3 3)) (display 2) (display 3))";
             */
 #else
             string str = io.read();
 #endif /* DEBUG */
             if(io.isfail()) break;
-            obj code = Parser(str.c_str(), str.size()).parse();
+            Parser parser(str.c_str(), str.size(), &sources_, file, io.line());
+            obj code;
+            while((code = parser.parse()) != NULL){
 #ifdef DEBUG
-            printsexp(code);
+              printsexp(code);
 #endif
-            obj bcode = compile(code, list(mk_opcode(OP_HALT)), &syntax);
+              scoped_limits limits(this);
+              obj bcode = compile_toplevel(code);
 #ifdef DEBUG
-            printsexp(bcode);
+              printsexp(bcode);
 #endif
-            obj ret = run(bcode, &genv);
-            printsexp(ret);
+              obj ret = execute(bcode);
+              printsexp(ret);
+            }
 #ifdef DEBUG
             break;
 #endif
@@ -1461,26 +7020,861 @@ namespace PetitScheme {
       }
 
       void genv_init(obj* genv){
-        define("+", OP_ADD, genv);
-        define("-", OP_SUB, genv);
-        define("*", OP_MULTIPLY, genv);
-        define("/", OP_DIVIDE, genv);
-        define("=", OP_EQUAL, genv);
-        define("list", OP_LIST, genv);
-        define("list**", OP_LIST_ASTA_ASTA, genv);
-        define("car", OP_CAR, genv);
-        define("cdr", OP_CDR, genv);
-        define("begin", OP_BEGIN, genv);
-        define("display", OP_DISPLAY, genv);
-      }
-
-    } vm;
+        for(const native_proc *proc = builtins; proc->name != NULL; proc++)
+          define(proc->name, proc, genv);
+      }
+
+    };
+
+    const VM::primitive VM::primitives[] = {
+      { "+", OP_ADD, 2, VM::OP_ADD2 },
+      { "-", OP_SUB, 2, VM::OP_SUB2 },
+      { "=", OP_EQUAL, 2, VM::OP_NUMEQ },
+      { "car", OP_CAR, 1, VM::OP_CAR1 },
+      { "cdr", OP_CDR, 1, VM::OP_CDR1 },
+      { "cons", OP_CONS, 2, VM::OP_CONS2 },
+      { "null?", OP_IS_NULL, 1, VM::OP_NULLP },
+      { "eq?", OP_IS_EQ, 2, VM::OP_EQ },
+      { "vector-ref", OP_VECTOR_REF, 2, VM::OP_VREF2 },
+      { "vector-set!", OP_VECTOR_SET, 3, VM::OP_VSET3 },
+      { NULL, NULL, 0, VM::OP_HALT }
+    };
+
+    volatile std::sig_atomic_t VM::sampler::due_ = 0;
+    thread_local VM *VM::current_ = NULL;
+
+    obj call_procedure(obj proc, obj args){
+      if(VM::current() == NULL)
+        throw std::logic_error("no VM is running to call the procedure");
+      return VM::current()->apply(proc, args);
+    }
+
+    // Threads that run futures, each a mutator on the heap of the VM
+    // that started them, with a VM sharing its globals.  A worker runs
+    // the futures it queued itself newest first and, when it has none
+    // left, steals the oldest ones of the others; those of threads that
+    // are not workers are dealt out in turn.  Idle workers are outside
+    // the heap, so collections don't wait for them.
+    class worker_pool {
+      // a queued future, a root until a worker takes it off a queue
+      struct task {
+        obj future_;
+      };
+      struct queue {
+        std::mutex lock_;
+        std::deque<task *> tasks_;
+      };
+
+      cell_manager &heap_;
+      std::shared_ptr<VM::globals> globals_;
+      std::vector<std::unique_ptr<queue> > queues_;
+      std::vector<std::thread> threads_;
+      // lock_ guards pending_ and quit_; work_ is signalled when they
+      // change
+      std::mutex lock_;
+      std::condition_variable work_;
+      long pending_;
+      bool quit_;
+      std::atomic<size_t> next_;
+      // run by the workers
+      std::atomic<unsigned long> instructions_;
+      // the pool and queue of a worker thread
+      static thread_local worker_pool *self_;
+      static thread_local size_t index_;
+      // signalled when any future is done, whichever pool ran it
+      static std::mutex done_lock_;
+      static std::condition_variable done_;
+
+      // a task from the queue index, or stolen from another; none once the
+      // pool is quitting
+      task *take(size_t index){
+        {
+          std::lock_guard<std::mutex> hold(lock_);
+          if(quit_) return NULL;
+        }
+        for(size_t k = 0; k < queues_.size(); k++){
+          queue &q = *queues_[(index + k) % queues_.size()];
+          task *t;
+          {
+            std::lock_guard<std::mutex> hold(q.lock_);
+            if(q.tasks_.empty()) continue;
+            if(k == 0){
+              t = q.tasks_.back();
+              q.tasks_.pop_back();
+            }else{
+              t = q.tasks_.front();
+              q.tasks_.pop_front();
+            }
+          }
+          std::lock_guard<std::mutex> hold(lock_);
+          pending_--;
+          return t;
+        }
+        return NULL;
+      }
+
+      void work(size_t index){
+        self_ = this;
+        index_ = index;
+        cell_manager::mutator *m = heap_.attach();
+        scoped_heap heap(m);
+        heap_.enter(m);
+        heap_.set_stack_top(static_cast<obj *>(__builtin_frame_address(0)));
+        {
+          VM vm(globals_);
+          vm.share_pool(this);
+          while(1){
+            task *t = take(index);
+            if(t != NULL){
+              run(vm, t->future_, &instructions_);
+              heap_.remove_root(&t->future_);
+              delete t;
+              continue;
+            }
+            heap_.leave(m);
+            bool quit;
+            {
+              std::unique_lock<std::mutex> hold(lock_);
+              work_.wait(hold, [this]{ return quit_ || pending_ > 0; });
+              quit = quit_;
+            }
+            heap_.enter(m);
+            if(quit) break;
+          }
+        }
+        heap_.leave(m);
+        heap_.detach(m);
+      }
+
+    public:
+      worker_pool(cell_manager &heap, std::shared_ptr<VM::globals> globals,
+                  unsigned workers)
+        : heap_(heap), globals_(globals), pending_(0), quit_(false), next_(0),
+          instructions_(0) {
+        for(unsigned i = 0; i < workers; i++)
+          queues_.push_back(std::unique_ptr<queue>(new queue()));
+        for(unsigned i = 0; i < workers; i++)
+          threads_.push_back(std::thread(&worker_pool::work, this, i));
+      }
+
+      // by the thread that made the pool, running on the heap; workers
+      // finish the future they are running, and those still queued are
+      // left for touch to run
+      ~worker_pool(){
+        {
+          std::lock_guard<std::mutex> hold(lock_);
+          quit_ = true;
+        }
+        work_.notify_all();
+        heap_.blocking([this]{
+            for(size_t i = 0; i < threads_.size(); i++) threads_[i].join();
+          });
+        for(size_t i = 0; i < queues_.size(); i++){
+          for(size_t j = 0; j < queues_[i]->tasks_.size(); j++){
+            heap_.remove_root(&queues_[i]->tasks_[j]->future_);
+            delete queues_[i]->tasks_[j];
+          }
+        }
+      }
+
+      size_t size() const { return threads_.size(); }
+      unsigned long instructions() const { return instructions_; }
+
+      // queues the pending future f
+      void submit(obj f){
+        if(queues_.empty()) return;
+        task *t = new task();
+        t->future_ = f;
+        heap_.add_root(&t->future_);
+        size_t i = self_ == this ? index_ : next_++ % queues_.size();
+        {
+          std::lock_guard<std::mutex> hold(queues_[i]->lock_);
+          queues_[i]->tasks_.push_back(t);
+        }
+        {
+          std::lock_guard<std::mutex> hold(lock_);
+          pending_++;
+        }
+        work_.notify_one();
+      }
+
+      // Runs the future f on vm unless it has been started already.
+      // A worker adds the instructions to counted before f is done, so
+      // that they are in the total of whoever waits for it.
+      static void run(VM &vm, obj f,
+                      std::atomic<unsigned long> *counted = NULL){
+        future *p = f->fut();
+        int pending = future::PENDING;
+        if(!p->state_.compare_exchange_strong(pending, future::RUNNING))
+          return;
+        unsigned long before = vm.instructions();
+        int state = future::DONE;
+        VM::borrowed_limits limits(&vm, p);
+        try{
+          if(p->count_ < 0){
+            p->value_ = vm.apply(p->proc_, cell::NIL);
+          }else{
+            obj head = cell::NIL, tail = cell::NIL, items = p->items_;
+            for(long i = 0; i < p->count_; i++, items = cdr(items)){
+              obj pair = cons(vm.apply(p->proc_, list(car(items))), cell::NIL);
+              if(tail == cell::NIL) head = pair;
+              else set_cdr(tail, pair);
+              tail = pair;
+            }
+            p->value_ = head;
+          }
+        }catch(located_error &e){
+          p->error_ = e.what();
+          p->located_ = true;
+          state = future::FAILED;
+        }catch(std::exception &e){
+          p->error_ = e.what();
+          state = future::FAILED;
+        }
+        limits.end(state == future::FAILED);
+        if(counted != NULL) *counted += vm.instructions() - before;
+        finish(p, state);
+      }
+
+      static void finish(future *p, int state){
+        p->state_ = state;
+        {
+          std::lock_guard<std::mutex> hold(done_lock_);
+        }
+        done_.notify_all();
+      }
+
+      // Waits for the futures in the list fs to be done.  Those still
+      // pending run here, or fail at once if cancel is set, when those
+      // running are told to stop.
+      static void settle(VM &vm, obj fs, bool cancel){
+        for(obj l = fs; l != cell::NIL; l = cdr(l)){
+          future *p = car(l)->fut();
+          if(!cancel){
+            run(vm, car(l));
+            continue;
+          }
+          p->cancel_ = true;
+          int pending = future::PENDING;
+          if(p->state_.compare_exchange_strong(pending, future::RUNNING)){
+            p->error_ = "future cancelled";
+            finish(p, future::FAILED);
+          }
+        }
+        cell_manager::get_instance().blocking([fs]{
+            std::unique_lock<std::mutex> hold(done_lock_);
+            for(obj l = fs; l != cell::NIL; l = cdr(l))
+              while(car(l)->fut()->state_ == future::RUNNING) done_.wait(hold);
+          });
+      }
+
+      // the value of the future f; it runs here if it is still pending,
+      // and a worker running it is waited for off the heap until the
+      // time limit of the evaluation, if any, when it is cancelled
+      static obj touch(obj f){
+        future *p = f->fut();
+        VM &vm = *VM::current();
+        run(vm, f);
+        if(p->state_ == future::RUNNING){
+          std::chrono::steady_clock::time_point deadline = vm.deadline();
+          bool done = true;
+          cell_manager::get_instance().blocking([p, deadline, &done]{
+              std::unique_lock<std::mutex> hold(done_lock_);
+              while(p->state_ == future::RUNNING){
+                if(deadline == std::chrono::steady_clock::time_point::max()){
+                  done_.wait(hold);
+                }else if(done_.wait_until(hold, deadline)
+                         == std::cv_status::timeout){
+                  done = p->state_ != future::RUNNING;
+                  return;
+                }
+              }
+            });
+          if(!done){
+            p->cancel_ = true;
+            throw std::logic_error("time limit exceeded");
+          }
+        }
+        if(p->state_ == future::FAILED && p->located_)
+          throw located_error(p->error_);
+        if(p->state_ == future::FAILED)
+          throw std::logic_error(p->error_);
+        return p->value_;
+      }
+    };
+
+    thread_local worker_pool *worker_pool::self_ = NULL;
+    thread_local size_t worker_pool::index_ = 0;
+    std::mutex worker_pool::done_lock_;
+    std::condition_variable worker_pool::done_;
+    unsigned VM::workers_ = std::max(1u, std::thread::hardware_concurrency());
+
+    worker_pool &VM::pool(){
+      if(pool_ == NULL){
+        pool_ = new worker_pool(cell_manager::get_instance(), globals_,
+                                workers_);
+        own_pool_ = true;
+      }
+      return *pool_;
+    }
+
+    unsigned long VM::instructions() const {
+      return instructions_ + (own_pool_ ? pool_->instructions() : 0);
+    }
+
+    void VM::stop_pool(){
+      delete pool_;
+      pool_ = NULL;
+      own_pool_ = false;
+    }
+
+    void VM::end_budget(bool failed){
+      // running those left pending may make more
+      while(spawned_ != cell::NIL){
+        obj fs[1] = { nreverse(spawned_) };
+        obj *fs_end = fs + 1;
+        scoped_root_range keep(fs, &fs_end);
+        spawned_ = cell::NIL;
+        worker_pool::settle(*this, fs[0], failed);
+      }
+      if(limits_ && fuel_ != ULONG_MAX) give_back(limits_->fuel_, fuel_);
+      use_limits(NULL);
+      cancel_ = NULL;
+    }
+
+    obj touch_future(obj f){
+      if(!f->isfuture()) return f;
+      return worker_pool::touch(f);
+    }
+
+    obj spawn_future(obj proc, obj items, long count){
+      obj f = mk_future(proc, items, count);
+      VM::current()->lend_budget(f);
+      VM::current()->pool().submit(f);
+      return f;
+    }
+
+    obj parallel_map(obj proc, obj lst){
+      long n = 0;
+      obj l = lst;
+      for(; l->ispair(); l = cdr(l)) n++;
+      if(l != cell::NIL)
+        throw std::logic_error("parallel-map: not a list");
+      if(n == 0) return cell::NIL;
+      // a few chunks per worker, so that one slow chunk is not the last
+      // one left
+      long chunks = std::min<long>(n, 4 * std::max<size_t>(
+                                     VM::current()->pool().size(), 1));
+      std::vector<obj> futures(chunks, cell::NIL);
+      obj *futures_end = futures.data() + futures.size();
+      scoped_root_range guard(futures.data(), &futures_end);
+      obj items = lst;
+      for(long i = 0; i < chunks; i++){
+        long count = n / chunks + (i < n % chunks);
+        futures[i] = spawn_future(proc, items, count);
+        for(long k = 0; k < count; k++) items = cdr(items);
+      }
+      // the chunks' lists are fresh, so they are joined in place
+      obj ret = cell::NIL, tail = cell::NIL;
+      for(long i = 0; i < chunks; i++){
+        obj chunk = worker_pool::touch(futures[i]);
+        if(chunk == cell::NIL) continue;
+        if(tail == cell::NIL) ret = chunk;
+        else set_cdr(tail, chunk);
+        for(tail = chunk; cdr(tail) != cell::NIL; tail = cdr(tail));
+      }
+      return ret;
+    }
+
+    obj spawn_thread(obj thunk){
+      if(!thunk->isproc()
+         && !(thunk->ispair() && car(thunk)->ispair() && caar(thunk)->isopcode()))
+        throw std::logic_error("spawn: not a procedure");
+      VM::current()->spawn(thunk);
+      return cell::NIL;
+    }
+
+    obj yield_thread(const obj *argv){
+      VM *vm = VM::current();
+      if(vm->depth() != 1 || !vm->others_ready()) return cell::NIL;
+      return vm->block(argv, cell::NIL, true);
+    }
+
+    obj make_channel(size_t capacity){
+      return mk_channel(capacity, VM::current());
+    }
+
+    channel *checked_channel(obj ch, const char *who){
+      if(!ch->ischannel())
+        throw std::logic_error(std::string(who) + ": not a channel");
+      if(ch->chan()->owner_ != VM::current())
+        throw std::logic_error(std::string(who) + ": channel of another VM");
+      return ch->chan();
+    }
+
+    // threads that ended while waiting are passed over
+    obj channel_put(const obj *argv){
+      channel *ch = checked_channel(argv[0], "channel-put");
+      VM *vm = VM::current();
+      while(ch->getters_ != cell::NIL){
+        obj t = dequeue(ch->getters_);
+        if(car(t) == cell::F) continue;
+        vm->wake(t, argv[1]);
+        return cell::NIL;
+      }
+      if(ch->count_ < ch->capacity_){
+        enqueue(ch->values_, ch->values_last_, argv[1]);
+        ch->count_++;
+        return cell::NIL;
+      }
+      enqueue(ch->putters_, ch->putters_last_,
+              cons(vm->waiting_thread("channel-put"), argv[1]));
+      return vm->block(argv, cell::NIL, false);
+    }
+
+    obj channel_get(const obj *argv){
+      channel *ch = checked_channel(argv[0], "channel-get");
+      VM *vm = VM::current();
+      // the first waiting put goes in after the values before it
+      while(ch->putters_ != cell::NIL){
+        obj put = dequeue(ch->putters_);
+        if(car(car(put)) == cell::F) continue;
+        enqueue(ch->values_, ch->values_last_, cdr(put));
+        ch->count_++;
+        vm->wake(car(put), cell::NIL);
+        break;
+      }
+      if(ch->values_ != cell::NIL){
+        ch->count_--;
+        return dequeue(ch->values_);
+      }
+      enqueue(ch->getters_, ch->getters_last_,
+              vm->waiting_thread("channel-get"));
+      return vm->block(argv, cell::NIL, false);
+    }
+
+    const char *const VM::opcode_names[] = {
+      "", "HALT", "REFER", "CONSTANT", "CLOSE", "TEST", "ASSIGN", "CONTI",
+      "NUATE", "FRAME", "ARGUMENT", "APPLY", "RETURN", "DEFINE", "PUSH",
+      "ADD2", "SUB2", "NUMEQ", "CAR1", "CDR1", "CONS2", "NULLP", "EQ",
+      "APPEND2", "CONTI1", "NUATE1", "EXIT1", "ENTER", "LEAVE", "JUMP",
+      "VREF2", "VSET3"
+    };
+  }
+}
+
+namespace PetitScheme {
+
+  // A context is a mutator with a VM of its own on a heap that contexts
+  // made from it share, along with the globals.  While one of its entry
+  // points runs, the mutator is the current one of the thread.
+  struct Context::impl {
+    // a procedure registered with define; its native_proc points here
+    struct native {
+      native_proc proc_;
+      std::string name_;
+      native_function fn_;
+    };
+
+    // what the contexts on a heap share besides the globals, which
+    // the VMs hold
+    struct shared {
+      Base::cell_manager heap_;
+      std::mutex lock_;
+      std::vector<std::unique_ptr<native> > natives_;
+    };
+
+    std::shared_ptr<shared> shared_;
+    Base::cell_manager::mutator *mutator_;
+    VM::VM *vm_;
+
+    // the context of the thread, which registered procedures are called
+    // from and get as their first argument
+    static thread_local Context *current_;
+
+    static cell *call_native(const native_proc *self,
+                             cell *const *argv, int argc){
+      native *n = static_cast<native *>(self->data);
+      Context &ctx = *current_;
+      std::vector<Value> args;
+      for(int i = 0; i < argc; i++)
+        args.push_back(Value(&ctx.impl_->shared_->heap_, argv[i]));
+      Value ret = n->fn_(ctx, args);
+      return ctx.own(ret, n->name_.c_str());
+    }
+  };
+
+  thread_local Context *Context::impl::current_ = NULL;
+
+  // Enters a context: its mutator becomes current and, unless it is
+  // running already because a builtin called back into it, it starts
+  // running with the C stack scanned from the caller's frame.
+  class context_entry {
+    scoped_heap heap_;
+    Context *saved_;
+    Context::impl *impl_;
+    bool outermost_;
+    context_entry(const context_entry &);
+  public:
+    context_entry(Context *ctx, Context::impl *impl, void *frame)
+      : heap_(impl->mutator_), saved_(Context::impl::current_), impl_(impl),
+        outermost_(impl->vm_ == NULL || impl->vm_->depth() == 0) {
+      Context::impl::current_ = ctx;
+      if(outermost_){
+        impl_->shared_->heap_.enter(impl_->mutator_);
+        impl_->shared_->heap_.set_stack_top(static_cast<obj *>(frame));
+      }
+    }
+    ~context_entry(){
+      if(outermost_) impl_->shared_->heap_.leave(impl_->mutator_);
+      Context::impl::current_ = saved_;
+    }
+  };
+
+#define PETITSCH_ENTER() \
+  context_entry enter_(this, impl_, __builtin_frame_address(0))
+
+  Value::Value() : heap_(NULL), cell_(cell::NIL) {}
+
+  Value::Value(Base::cell_manager *heap, cell *c) : heap_(heap), cell_(c) {
+    if(heap_ != NULL) heap_->add_root(&cell_);
+  }
+
+  Value::Value(const Value &v) : heap_(v.heap_), cell_(v.cell_) {
+    if(heap_ != NULL) heap_->add_root(&cell_);
+  }
+
+  Value &Value::operator=(const Value &v){
+    if(heap_ != v.heap_){
+      if(heap_ != NULL) heap_->remove_root(&cell_);
+      heap_ = v.heap_;
+      if(heap_ != NULL) heap_->add_root(&cell_);
+    }
+    cell_ = v.cell_;
+    return *this;
+  }
+
+  Value::~Value(){
+    if(heap_ != NULL) heap_->remove_root(&cell_);
   }
+
+  bool Value::isnull() const { return cell_ == cell::NIL; }
+  bool Value::isboolean() const { return cell_ == cell::T || cell_ == cell::F; }
+  bool Value::isnumber() const { return Number::isnumeric(cell_); }
+  bool Value::isstring() const { return cell_->isstring(); }
+  bool Value::issymbol() const { return cell_->issymbol(); }
+  bool Value::ispair() const { return cell_->ispair(); }
+
+  // builtins and closures, which are (code env vars)
+  bool Value::isprocedure() const {
+    return cell_->isproc()
+      || (cell_->ispair() && Base::car(cell_)->ispair()
+          && Base::caar(cell_)->isopcode());
+  }
+
+  bool Value::tobool() const { return cell_ != cell::F; }
+
+  long Value::toint() const {
+    if(!cell_->isnumber())
+      throw std::logic_error("Not a fixnum");
+    return cell_->fixnum();
+  }
+
+  double Value::todouble() const { return Number::to_double(cell_); }
+
+  std::string Value::tostring() const {
+    if(!cell_->isstring() && !cell_->issymbol())
+      throw std::logic_error("Not a string or symbol");
+    return cell_->str();
+  }
+
+  Value Value::car() const {
+    if(!cell_->ispair()) throw std::logic_error("Not a pair");
+    return Value(heap_, Base::car(cell_));
+  }
+
+  Value Value::cdr() const {
+    if(!cell_->ispair()) throw std::logic_error("Not a pair");
+    return Value(heap_, Base::cdr(cell_));
+  }
+
+  std::string Value::write() const {
+    VM::Printer p;
+    p.print(cell_, true);
+    return p.take();
+  }
+
+  Context::Context() : impl_(new impl) {
+    impl_->shared_ = std::make_shared<impl::shared>();
+    impl_->mutator_ = impl_->shared_->heap_.attach();
+    impl_->vm_ = NULL;
+    PETITSCH_ENTER();
+    impl_->vm_ = new VM::VM();
+    impl_->vm_->init_globals();
+  }
+
+  Context::Context(Context &parent) : impl_(new impl) {
+    impl_->shared_ = parent.impl_->shared_;
+    impl_->mutator_ = impl_->shared_->heap_.attach();
+    impl_->vm_ = NULL;
+    PETITSCH_ENTER();
+    impl_->vm_ = new VM::VM(parent.impl_->vm_->shared_globals());
+  }
+
+  Context::~Context(){
+    {
+      scoped_heap heap(impl_->mutator_);
+      delete impl_->vm_;
+    }
+    impl_->shared_->heap_.detach(impl_->mutator_);
+    delete impl_;
+  }
+
+  // the cell of v, which can't come from another heap
+  cell *Context::own(const Value &v, const char *who){
+    if(v.heap_ != NULL && v.heap_ != &impl_->shared_->heap_)
+      throw std::logic_error(std::string(who) + ": a value of another heap");
+    return v.cell_;
+  }
+
+  Value Context::wrap(cell *c){
+    return Value(&impl_->shared_->heap_, c);
+  }
+
+  Value Context::eval(const std::string &source){
+    PETITSCH_ENTER();
+    VM::VM::scoped_limits limits(impl_->vm_);
+    source_map &sources = impl_->vm_->sources();
+    Parser parser(source.c_str(), source.size(), &sources,
+                  sources.file("<eval>"), 1);
+    obj ret = cell::NIL;
+    obj form;
+    while((form = parser.parse()) != NULL)
+      ret = impl_->vm_->eval(form);
+    return wrap(ret);
+  }
+
+  Value Context::call(const Value &proc, const std::vector<Value> &args){
+    PETITSCH_ENTER();
+    VM::VM::scoped_limits limits(impl_->vm_);
+    obj lst = cell::NIL;
+    own(proc, "call");
+    for(size_t i = args.size(); i-- > 0; )
+      lst = Base::cons(own(args[i], "call"), lst);
+    return wrap(impl_->vm_->apply(proc.cell_, lst));
+  }
+
+  void Context::set_limits(unsigned long instructions, unsigned long cells,
+                           unsigned long milliseconds){
+    impl_->vm_->set_limits(instructions, cells, milliseconds);
+  }
+
+  Value Context::lookup(const std::string &name){
+    PETITSCH_ENTER();
+    obj val = impl_->vm_->lookup_global(mk_symbol(name.c_str()));
+    if(val == NULL) throw std::logic_error(name + ": unbound variable");
+    return wrap(val);
+  }
+
+  void Context::define(const std::string &name, const Value &value){
+    PETITSCH_ENTER();
+    impl_->vm_->define_global(mk_symbol(name.c_str()), own(value, "define"));
+  }
+
+  void Context::define(const std::string &name, native_function fn,
+                       int min_args, int max_args){
+    PETITSCH_ENTER();
+    std::unique_ptr<impl::native> n(new impl::native());
+    n->name_ = name;
+    n->fn_ = fn;
+    n->proc_.name = n->name_.c_str();
+    n->proc_.min_args = min_args;
+    n->proc_.max_args = max_args;
+    n->proc_.func = NULL;
+    n->proc_.closure = impl::call_native;
+    n->proc_.data = n.get();
+    obj proc = mk_proc(&n->proc_);
+    {
+      std::lock_guard<std::mutex> hold(impl_->shared_->lock_);
+      impl_->shared_->natives_.push_back(std::move(n));
+    }
+    impl_->vm_->define_global(mk_symbol(name.c_str()), proc);
+  }
+
+  Value Context::number(long n){
+    PETITSCH_ENTER();
+    return wrap(mk_number(n));
+  }
+
+  Value Context::number(double d){
+    PETITSCH_ENTER();
+    return wrap(mk_flonum(d));
+  }
+
+  Value Context::boolean(bool b){
+    return wrap(b ? cell::T : cell::F);
+  }
+
+  Value Context::string(const std::string &s){
+    PETITSCH_ENTER();
+    return wrap(mk_string(s.c_str()));
+  }
+
+  Value Context::symbol(const std::string &name){
+    PETITSCH_ENTER();
+    return wrap(mk_symbol(name.c_str()));
+  }
+
+  Value Context::cons(const Value &car, const Value &cdr){
+    PETITSCH_ENTER();
+    return wrap(Base::cons(own(car, "cons"), own(cdr, "cons")));
+  }
+
+  Value Context::list(const std::vector<Value> &elems){
+    PETITSCH_ENTER();
+    obj lst = cell::NIL;
+    for(size_t i = elems.size(); i-- > 0; )
+      lst = Base::cons(own(elems[i], "list"), lst);
+    return wrap(lst);
+  }
+
+#undef PETITSCH_ENTER
+}
+
+#ifndef PETITSCH_LIBRARY
+static void usage(const char *prog)
+{
+  cerr << "usage: " << prog << " [-b|--batch] [-i|--interactive] [-s|--stats] [-O0]" << endl;
+  cerr << "       [--no-fold] [--no-if] [--no-beta] [--no-inline]" << endl;
+  cerr << "       [--image FILE] [--dump-image FILE]" << endl;
+  cerr << "       [--snapshot FILE] [--dump-snapshot FILE] [--sample FILE]" << endl;
+  cerr << "       [--max-instructions N] [--max-cells N] [--max-time MS]" << endl;
+  cerr << "       [--workers N] [FILE]" << endl;
+  cerr << "  FILE               read the program from FILE instead of stdin" << endl;
+  cerr << "  -b, --batch        no prompt, buffered output (default with FILE or if stdin" << endl;
+  cerr << "                     is not a tty)" << endl;
+  cerr << "  -i, --interactive  prompt and line buffered output" << endl;
+  cerr << "  -s, --stats        print statistics to stderr at exit" << endl;
+#ifdef PROFILE
+  cerr << "  -p, --profile      count and time each opcode and opcode pair, print at exit" << endl;
+#endif /* PROFILE */
+  cerr << "  -O0                no optimization passes" << endl;
+  cerr << "  --no-fold          no constant folding of builtin calls" << endl;
+  cerr << "  --no-if            no folding of if with a constant test" << endl;
+  cerr << "  --no-beta          apply ((lambda ...) args) through a closure" << endl;
+  cerr << "  --no-inline        no inlining of small procedures" << endl;
+  cerr << "  --image FILE       start from the globals and macros saved in FILE" << endl;
+  cerr << "  --dump-image FILE  save the globals and macros to FILE at exit" << endl;
+  cerr << "  --snapshot FILE    map the heap snapshot FILE, shared and never collected" << endl;
+  cerr << "  --dump-snapshot FILE  save the globals and macros as a heap snapshot at exit" << endl;
+  cerr << "  --sample FILE      sample the Scheme stack every ms of cpu time, write" << endl;
+  cerr << "                     folded stacks to FILE at exit" << endl;
+  cerr << "  --max-instructions N  limit each top level form to N instructions" << endl;
+  cerr << "  --max-cells N      limit each top level form to allocating N cells" << endl;
+  cerr << "  --max-time MS      limit each top level form to MS milliseconds" << endl;
+  cerr << "  --workers N        run futures on N threads, 0 to run each when touched" << endl;
+  cerr << "                     (default: one per core)" << endl;
+}
+
+// a count given on the command line
+static bool parse_count(const char *arg, unsigned long &n)
+{
+  char *end;
+  errno = 0;
+  n = strtoul(arg, &end, 10);
+  return *arg >= '0' && *arg <= '9' && *end == '\0' && errno == 0;
 }
 
 int main(int argc, char *argv[])
 {
-  PetitScheme::VM::VM().repl();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  // -1: unless stdin is a tty or FILE is given
+  int interactive = -1;
+  bool stats = false;
+  bool profile = false;
+  unsigned optimizations = PetitScheme::VM::VM::OPT_ALL;
+  const char *image = NULL, *dump_image = NULL;
+  const char *snapshot = NULL, *dump_snapshot = NULL;
+  const char *samples = NULL;
+  const char *script = NULL;
+  unsigned long max_instructions = 0, max_cells = 0, max_time = 0;
+  unsigned long workers;
+  for(int i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--batch") == 0){
+      interactive = 0;
+    }else if(strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--interactive") == 0){
+      interactive = 1;
+    }else if(strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--stats") == 0){
+      stats = true;
+#ifdef PROFILE
+    }else if(strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--profile") == 0){
+      profile = true;
+#endif /* PROFILE */
+    }else if(strcmp(argv[i], "-O0") == 0){
+      optimizations = 0;
+    }else if(strcmp(argv[i], "--no-fold") == 0){
+      optimizations &= ~PetitScheme::VM::VM::OPT_FOLD;
+    }else if(strcmp(argv[i], "--no-if") == 0){
+      optimizations &= ~PetitScheme::VM::VM::OPT_IF;
+    }else if(strcmp(argv[i], "--no-beta") == 0){
+      optimizations &= ~PetitScheme::VM::VM::OPT_BETA;
+    }else if(strcmp(argv[i], "--no-inline") == 0){
+      optimizations &= ~PetitScheme::VM::VM::OPT_INLINE;
+    }else if(strcmp(argv[i], "--image") == 0 && i + 1 < argc){
+      image = argv[++i];
+    }else if(strcmp(argv[i], "--dump-image") == 0 && i + 1 < argc){
+      dump_image = argv[++i];
+    }else if(strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc){
+      snapshot = argv[++i];
+    }else if(strcmp(argv[i], "--dump-snapshot") == 0 && i + 1 < argc){
+      dump_snapshot = argv[++i];
+    }else if(strcmp(argv[i], "--sample") == 0 && i + 1 < argc){
+      samples = argv[++i];
+    }else if(strcmp(argv[i], "--max-instructions") == 0 && i + 1 < argc
+             && parse_count(argv[i + 1], max_instructions)){
+      i++;
+    }else if(strcmp(argv[i], "--max-cells") == 0 && i + 1 < argc
+             && parse_count(argv[i + 1], max_cells)){
+      i++;
+    }else if(strcmp(argv[i], "--max-time") == 0 && i + 1 < argc
+             && parse_count(argv[i + 1], max_time)){
+      i++;
+    }else if(strcmp(argv[i], "--workers") == 0 && i + 1 < argc
+             && parse_count(argv[i + 1], workers) && workers <= 1024){
+      PetitScheme::VM::VM::set_workers(workers);
+      i++;
+    }else if(argv[i][0] != '-' && script == NULL){
+      script = argv[i];
+    }else{
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if(interactive < 0)
+    interactive = script == NULL && SexpIO::isatty_stdin();
+  PetitScheme::VM::VM vm;
+  vm.set_optimizations(optimizations);
+  vm.set_profiling(profile);
+  vm.set_limits(max_instructions, max_cells, max_time);
+  try{
+    if(snapshot != NULL) vm.load_snapshot(snapshot);
+    if(image != NULL) vm.load_image(image);
+    if(samples != NULL) vm.start_sampling(1000);
+    vm.repl(interactive, script);
+    if(samples != NULL) vm.write_samples(samples);
+    if(dump_image != NULL) vm.save_image(dump_image);
+    if(dump_snapshot != NULL) vm.save_snapshot(dump_snapshot);
+  }catch(std::exception &e){
+    cerr << e.what() << endl;
+    return 1;
+  }
+  if(stats){
+    cerr << "time: " << std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count() << " ms" << endl;
+    vm.print_stats(cerr);
+  }
+  if(profile) vm.print_profile(cerr);
 
   return 0;
 }
+#endif /* PETITSCH_LIBRARY */